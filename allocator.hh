@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace chan {
+
+// the MPOL_BIND mbind policy, defined here so that numaif.h, and libnuma,
+// is not needed
+static const int mpol_bind = 2;
+
+/**
+ * huge_page_size is the size of a transparent huge page on the common
+ * platforms
+ * */
+const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+/**
+ * page_size returns the size of a regular page
+ * */
+inline std::size_t page_size() {
+	static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	return size;
+}
+
+inline std::size_t round_up(std::size_t n, std::size_t multiple) {
+	return (n + multiple - 1) / multiple * multiple;
+}
+
+/**
+ * map_aligned maps "bytes" of anonymous memory starting at a multiple of
+ * "alignment". bytes must be a multiple of the page size.
+ *
+ * mmap only guarantees page alignment, so this maps an extra alignment
+ * worth of memory and trims the ends.
+ * */
+inline void* map_aligned(std::size_t bytes, std::size_t alignment) {
+	std::size_t length = bytes + alignment;
+
+	void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+
+	uintptr_t start = reinterpret_cast<uintptr_t>(p);
+	uintptr_t aligned = (start + alignment - 1) / alignment * alignment;
+
+	if (aligned > start) {
+		munmap(p, aligned - start);
+	}
+
+	if (start + length > aligned + bytes) {
+		munmap(reinterpret_cast<void*>(aligned + bytes), start + length - aligned - bytes);
+	}
+
+	return reinterpret_cast<void*>(aligned);
+}
+
+/**
+ * current_numa_node returns the NUMA node of the cpu the calling thread
+ * is running on, or 0 if that cannot be determined.
+ * */
+inline int current_numa_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned cpu = 0;
+	unsigned node = 0;
+
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+		return static_cast<int>(node);
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * bind_numa_node sets a MPOL_BIND memory policy for a range, so that its
+ * pages are placed on the given node when they are first touched.
+ *
+ * This uses the raw mbind system call, so it works without libnuma. On
+ * kernels or platforms without NUMA support it does nothing, and the
+ * pages are placed by the default first touch policy.
+ *
+ * @return  bool   true if the policy was applied
+ * */
+inline bool bind_numa_node(void* p, std::size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+	const std::size_t bits = sizeof(unsigned long) * 8;
+
+	std::vector<unsigned long> mask(node / bits + 1, 0);
+	mask[node / bits] |= 1UL << (node % bits);
+
+	return syscall(SYS_mbind, p, bytes, mpol_bind, mask.data(), mask.size() * bits + 1, 0) == 0;
+#else
+	(void)p;
+	(void)bytes;
+	(void)node;
+	return false;
+#endif
+}
+
+/**
+ * huge_page_allocator allocates memory in multiples of huge_page_size,
+ * aligned to huge_page_size and advised for transparent huge pages, which
+ * cuts TLB misses when walking large channel buffers.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<int, chan::huge_page_allocator<int>> c(1 << 20);
+ * ```
+ * */
+template <typename T>
+class huge_page_allocator {
+public:
+	typedef T value_type;
+
+	huge_page_allocator() noexcept {}
+
+	template <typename U>
+	huge_page_allocator(const huge_page_allocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		if (n == 0) {
+			return nullptr;
+		}
+
+		std::size_t bytes = round_up(n * sizeof(T), huge_page_size);
+		void* p = map_aligned(bytes, huge_page_size);
+
+#ifdef MADV_HUGEPAGE
+		madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept {
+		if (p != nullptr) {
+			munmap(p, round_up(n * sizeof(T), huge_page_size));
+		}
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const huge_page_allocator<T>&, const huge_page_allocator<U>&) {
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const huge_page_allocator<T>&, const huge_page_allocator<U>&) {
+	return false;
+}
+
+/**
+ * numa_allocator allocates memory whose pages are bound to a NUMA node,
+ * typically the node of the thread consuming from the channel. It can
+ * optionally use huge pages as well.
+ *
+ * When the system has no NUMA support the memory is allocated normally.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::numa_allocator<int> alloc(chan::current_numa_node());
+ * chan::buffered_chan<int, chan::numa_allocator<int>> c(1 << 20, alloc);
+ * ```
+ * */
+template <typename T>
+class numa_allocator {
+private:
+	template <typename U>
+	friend class numa_allocator;
+
+	int node;
+	bool huge_pages;
+
+	std::size_t granularity() const {
+		return huge_pages ? huge_page_size : page_size();
+	}
+
+public:
+	typedef T value_type;
+
+	explicit numa_allocator(int node, bool huge_pages = false) noexcept
+	    : node(node), huge_pages(huge_pages) {}
+
+	template <typename U>
+	numa_allocator(const numa_allocator<U>& other) noexcept
+	    : node(other.node), huge_pages(other.huge_pages) {}
+
+	T* allocate(std::size_t n) {
+		if (n == 0) {
+			return nullptr;
+		}
+
+		std::size_t bytes = round_up(n * sizeof(T), granularity());
+		void* p = map_aligned(bytes, granularity());
+
+#ifdef MADV_HUGEPAGE
+		if (huge_pages) {
+			madvise(p, bytes, MADV_HUGEPAGE);
+		}
+#endif
+
+		bind_numa_node(p, bytes, node);
+
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept {
+		if (p != nullptr) {
+			munmap(p, round_up(n * sizeof(T), granularity()));
+		}
+	}
+
+	int numa_node() const { return node; }
+
+	template <typename U>
+	bool operator==(const numa_allocator<U>& other) const {
+		return node == other.node && huge_pages == other.huge_pages;
+	}
+
+	template <typename U>
+	bool operator!=(const numa_allocator<U>& other) const {
+		return !(*this == other);
+	}
+};
+
+}  // namespace chan
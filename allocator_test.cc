@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "allocator.hh"
+#include "chan.hh"
+
+TEST(huge_page_allocator, alignment) {
+	chan::huge_page_allocator<int> alloc;
+
+	int* p = alloc.allocate(10);
+	ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(p) % chan::huge_page_size);
+
+	p[0] = 1;
+	p[9] = 2;
+	ASSERT_EQ(1, p[0]);
+	ASSERT_EQ(2, p[9]);
+
+	alloc.deallocate(p, 10);
+}
+
+TEST(huge_page_allocator, circular_queue) {
+	chan::circular_queue<int, chan::huge_page_allocator<int>> queue(1 << 20);
+
+	for (int i = 0; i < (1 << 20); i++) {
+		ASSERT_EQ(true, queue.push(i));
+	}
+
+	ASSERT_EQ(true, queue.full());
+
+	for (int i = 0; i < (1 << 20); i++) {
+		ASSERT_EQ(i, queue.front());
+		queue.pop();
+	}
+
+	ASSERT_EQ(true, queue.empty());
+}
+
+TEST(numa_allocator, circular_queue) {
+	chan::numa_allocator<std::string> alloc(chan::current_numa_node());
+	chan::circular_queue<std::string, chan::numa_allocator<std::string>> queue(3, alloc);
+
+	queue.push("numa");
+	queue.push("allocator");
+
+	ASSERT_STREQ("numa", queue.front().c_str());
+	queue.pop();
+	ASSERT_STREQ("allocator", queue.front().c_str());
+	queue.pop();
+
+	ASSERT_EQ(true, queue.empty());
+}
+
+TEST(numa_allocator, buffered_chan) {
+	chan::numa_allocator<int> alloc(chan::current_numa_node(), true);
+	chan::buffered_chan<int, chan::numa_allocator<int>> c(1024, alloc);
+
+	std::thread t([&](){
+		for (int i = 0; i < 10000; i++) {
+			c << i;
+		}
+	});
+
+	for (int i = 0; i < 10000; i++) {
+		int x = -1;
+		c >> x;
+		ASSERT_EQ(i, x);
+	}
+
+	t.join();
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "chan.hh"
+
+namespace chan {
+
+/**
+ * batcher is a pipeline stage that groups the values read from a channel
+ * into vectors, and writes them to another channel.
+ *
+ * A batch is flushed when it reaches max_items, or when max_delay has
+ * passed since its first value was read, whichever comes first. One thread
+ * reads the input into the current batch, and another one waits for the
+ * batch to fill up or get old and writes it, so the delay works with any
+ * read_chan, whether or not it supports reads with a context. The reader
+ * waits while a full batch hasn't been taken yet, so a slow output slows
+ * down the reading.
+ *
+ * When the input is closed and drained, the last partial batch is flushed
+ * and the output is closed. If the output is closed, the stage stops, the
+ * reader once it reads its next value.
+ *
+ * Consumers can hand batches back with recycle, after which their storage
+ * is reused for new batches, so a steady pipeline doesn't allocate.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<record> in(1024);
+ * chan::buffered_chan<std::vector<record>> out(16);
+ *
+ * chan::batcher<record> b(in, out, 256, std::chrono::microseconds(500));
+ *
+ * std::vector<record> batch;
+ * while (out.read(batch)) {
+ * 	write_to_disk(batch);
+ * 	b.recycle(std::move(batch));
+ * }
+ * ```
+ * */
+template <typename T>
+class batcher {
+private:
+	read_chan<T>& in;
+	write_chan<std::vector<T>>& out;
+
+	size_t max_items;
+	std::chrono::microseconds max_delay;
+
+	std::mutex free_mutex;
+	std::vector<std::vector<T>> free_batches;
+
+	// guards the batch being filled, and the state below
+	std::mutex state_mutex;
+	std::condition_variable batch_changed;
+	std::condition_variable batch_taken;
+
+	std::vector<T> current;
+	std::chrono::steady_clock::time_point deadline;
+
+	bool drained;
+	bool stopped;
+
+	std::thread reader;
+	std::thread thread;
+
+	/**
+	 * fresh returns an empty batch, reusing a recycled one if possible
+	 * */
+	std::vector<T> fresh() {
+		std::vector<T> batch;
+
+		{
+			std::unique_lock<std::mutex> free_lock(free_mutex);
+
+			if (!free_batches.empty()) {
+				batch = std::move(free_batches.back());
+				free_batches.pop_back();
+			}
+		}
+
+		batch.clear();
+		batch.reserve(max_items);
+
+		return batch;
+	}
+
+	/**
+	 * read_input adds the values read to the current batch, starting its
+	 * window with its first value
+	 * */
+	void read_input() {
+		T val;
+
+		while (in.read(val)) {
+			std::unique_lock<std::mutex> state_lock(state_mutex);
+
+			while (!stopped && current.size() >= max_items) {
+				batch_taken.wait(state_lock);
+			}
+
+			if (stopped) {
+				return;
+			}
+
+			current.push_back(std::move(val));
+
+			if (current.size() == 1) {
+				deadline = std::chrono::steady_clock::now() + max_delay;
+				batch_changed.notify_one();
+			} else if (current.size() >= max_items) {
+				batch_changed.notify_one();
+			}
+		}
+
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+		drained = true;
+		batch_changed.notify_one();
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		while (true) {
+			while (!drained && current.empty()) {
+				batch_changed.wait(state_lock);
+			}
+
+			while (!drained && current.size() < max_items) {
+				if (batch_changed.wait_until(state_lock, deadline) == std::cv_status::timeout) {
+					break;
+				}
+			}
+
+			if (current.empty()) {
+				break;
+			}
+
+			std::vector<T> batch = fresh();
+			std::swap(batch, current);
+			batch_taken.notify_one();
+
+			state_lock.unlock();
+
+			bool written = true;
+			try {
+				out.write(std::move(batch));
+			} catch (closed_channel_write_exception&) {
+				written = false;
+			}
+
+			state_lock.lock();
+
+			if (!written) {
+				stopped = true;
+				batch_taken.notify_one();
+				return;
+			}
+		}
+
+		state_lock.unlock();
+
+		try {
+			out.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+public:
+	/**
+	 * @param   in          read_chan<T>&                the channel to read from
+	 * @param   out         write_chan<std::vector<T>>&  the channel batches are written to
+	 * @param   max_items   size_t                       the size that flushes a batch
+	 * @param   max_delay   std::chrono::microseconds    the age that flushes a batch
+	 * */
+	batcher(
+	    read_chan<T>& in,
+	    write_chan<std::vector<T>>& out,
+	    size_t max_items,
+	    std::chrono::microseconds max_delay)
+	    : in(in),
+	      out(out),
+	      max_items(max_items > 0 ? max_items : 1),
+	      max_delay(max_delay),
+	      drained(false),
+	      stopped(false) {
+		current = fresh();
+
+		reader = std::thread(&batcher::read_input, this);
+		thread = std::thread(&batcher::run, this);
+	}
+
+	/**
+	 * The destructor waits for the stage to finish, so the input has to be
+	 * closed, or the output has to be closed and written to, before it
+	 * */
+	~batcher() { join(); }
+
+	batcher(const batcher& other) = delete;
+	batcher& operator=(const batcher& other) = delete;
+
+	/**
+	 * join waits until the input is drained and the output closed
+	 * */
+	void join() {
+		if (reader.joinable()) {
+			reader.join();
+		}
+
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	/**
+	 * recycle hands a batch that was read from the output back, so that
+	 * its storage is reused
+	 * */
+	void recycle(std::vector<T>&& batch) {
+		std::unique_lock<std::mutex> free_lock(free_mutex);
+		free_batches.push_back(std::move(batch));
+	}
+};
+
+}  // namespace chan
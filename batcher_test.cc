@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "batcher.hh"
+#include "compact_chan.hh"
+
+TEST(batcher, size_flush) {
+	chan::buffered_chan<int> in(64);
+	chan::buffered_chan<std::vector<int>> out(16);
+
+	chan::batcher<int> b(in, out, 4, std::chrono::seconds(10));
+
+	for (int i = 0 ; i < 8 ; i++) {
+		in << i;
+	}
+
+	std::vector<int> batch;
+	for (int n = 0 ; n < 2 ; n++) {
+		ASSERT_TRUE(out.read(batch));
+		ASSERT_EQ(4u, batch.size());
+		ASSERT_EQ(n * 4, batch[0]);
+		ASSERT_EQ(n * 4 + 3, batch[3]);
+	}
+
+	in.close();
+	ASSERT_FALSE(out.read(batch));
+}
+
+TEST(batcher, time_flush) {
+	chan::buffered_chan<int> in(64);
+	chan::buffered_chan<std::vector<int>> out(16);
+
+	chan::batcher<int> b(in, out, 100, std::chrono::microseconds(20000));
+
+	auto start = std::chrono::steady_clock::now();
+
+	in << 1;
+	in << 2;
+
+	// the batch is flushed once its first value is 20ms old
+	std::vector<int> batch;
+	ASSERT_TRUE(out.read(batch));
+	ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+	ASSERT_EQ(2u, batch.size());
+	ASSERT_EQ(1, batch[0]);
+	ASSERT_EQ(2, batch[1]);
+
+	in.close();
+	ASSERT_FALSE(out.read(batch));
+}
+
+TEST(batcher, time_flush_without_context_reads) {
+	// compact_chan reads don't take a context, the delay must not rely on it
+	chan::compact_chan<int> in(64);
+	chan::buffered_chan<std::vector<int>> out(16);
+
+	chan::batcher<int> b(in, out, 100, std::chrono::microseconds(20000));
+
+	auto start = std::chrono::steady_clock::now();
+
+	in << 1;
+	in << 2;
+
+	// no more values arrive, the partial batch is flushed by its age alone
+	std::vector<int> batch;
+	ASSERT_TRUE(out.read(batch));
+
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	ASSERT_GE(elapsed, std::chrono::milliseconds(20));
+	ASSERT_LT(elapsed, std::chrono::seconds(5));
+
+	ASSERT_EQ(2u, batch.size());
+	ASSERT_EQ(1, batch[0]);
+	ASSERT_EQ(2, batch[1]);
+
+	in.close();
+	ASSERT_FALSE(out.read(batch));
+}
+
+TEST(batcher, flush_on_close) {
+	chan::buffered_chan<int> in(64);
+	chan::buffered_chan<std::vector<int>> out(16);
+
+	chan::batcher<int> b(in, out, 100, std::chrono::seconds(10));
+
+	for (int i = 0 ; i < 10 ; i++) {
+		in << i;
+	}
+
+	in.close();
+
+	std::vector<int> batch;
+	ASSERT_TRUE(out.read(batch));
+	ASSERT_EQ(10u, batch.size());
+
+	ASSERT_FALSE(out.read(batch));
+	ASSERT_TRUE(out.isClosed());
+}
+
+TEST(batcher, recycle) {
+	chan::buffered_chan<int> in(64);
+	chan::buffered_chan<std::vector<int>> out(1);
+
+	chan::batcher<int> b(in, out, 2, std::chrono::seconds(10));
+
+	in << 1;
+	in << 2;
+
+	std::vector<int> batch;
+	ASSERT_TRUE(out.read(batch));
+	ASSERT_EQ(2u, batch.size());
+
+	// batches are moved through the output, so the storage handed back is
+	// the storage the next batch is built in
+	const int* storage = batch.data();
+	b.recycle(std::move(batch));
+
+	// the stage may have started the next batch already, so go through one
+	in << 3;
+	in << 4;
+	in << 5;
+	in << 6;
+
+	std::vector<int> second;
+	std::vector<int> third;
+	ASSERT_TRUE(out.read(second));
+	ASSERT_TRUE(out.read(third));
+
+	ASSERT_EQ(3, second[0]);
+	ASSERT_EQ(5, third[0]);
+	ASSERT_TRUE(second.data() == storage || third.data() == storage);
+
+	in.close();
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "chan.hh"
+#include "wait_queue.hh"
+
+namespace chan {
+
+struct byte_chan_map_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot map the byte channel ring";
+	}
+} _byte_chan_map_exception;
+
+/**
+ * byte_span is a contiguous range of bytes inside a byte_chan's ring
+ * */
+struct byte_span {
+	char* data;
+	size_t size;
+};
+
+/**
+ * byte_chan is a byte stream with pipe semantics, for moving unframed data
+ * like protocol streams or compressed blocks between threads, without a
+ * lock per byte or an allocation per chunk.
+ *
+ * The bytes live in a ring whose memory is mapped twice, back to back, so
+ * any range of the ring is contiguous in memory, even if it wraps around.
+ * This allows both copying and zero-copy access:
+ *
+ * - write copies all the bytes, blocking while the ring is full, and
+ * read_some copies whatever is available, up to a limit, blocking only
+ * while the ring is empty. A write of at most capacity bytes is never
+ * interleaved with other writes.
+ *
+ * - writable_span returns the free part of the ring, to be filled in place
+ * and published with commit, and readable_span returns the bytes that are
+ * available, to be used in place and released with consume. Spans stay
+ * valid until their commit or consume, so there must be a single writer
+ * and a single reader using them.
+ *
+ * The capacity is rounded up to a multiple of the page size.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::byte_chan pipe(64 * 1024);
+ *
+ * // producer
+ * chan::byte_span out = pipe.writable_span();
+ * size_t n = compress(block, out.data, out.size);
+ * pipe.commit(n);
+ *
+ * // consumer
+ * chan::byte_span in;
+ * while ((in = pipe.readable_span()).size > 0) {
+ * 	size_t n = parse_frames(in.data, in.size);
+ * 	pipe.consume(n);
+ * }
+ * ```
+ * */
+class byte_chan {
+private:
+	char* ring;
+	size_t ring_capacity;
+
+	// both only grow, the ring holds tail - head bytes
+	size_t head;
+	size_t tail;
+
+	bool is_closed;
+
+	mutable std::mutex data_mutex;
+
+	int read_wait_count;
+	int write_wait_count;
+
+	wait_queue read_available;
+	wait_queue write_available;
+
+	/**
+	 * map reserves twice the capacity of address space, and maps the same
+	 * anonymous shared memory object into both halves
+	 * */
+	void map() {
+		static std::atomic<unsigned> counter(0);
+
+		char name[64];
+		snprintf(name, sizeof(name), "/byte_chan-%ld-%u", static_cast<long>(getpid()), counter.fetch_add(1));
+
+		int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1) {
+			throw _byte_chan_map_exception;
+		}
+
+		// only the mappings keep the object alive
+		shm_unlink(name);
+
+		if (ftruncate(fd, ring_capacity) == -1) {
+			::close(fd);
+			throw _byte_chan_map_exception;
+		}
+
+		void* base = mmap(nullptr, 2 * ring_capacity, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (base == MAP_FAILED) {
+			::close(fd);
+			throw _byte_chan_map_exception;
+		}
+
+		char* lower = static_cast<char*>(base);
+
+		void* first = mmap(lower, ring_capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+		void* second = mmap(lower + ring_capacity, ring_capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+
+		::close(fd);
+
+		if (first != lower || second != lower + ring_capacity) {
+			munmap(base, 2 * ring_capacity);
+			throw _byte_chan_map_exception;
+		}
+
+		ring = lower;
+	}
+
+	static size_t round_to_pages(size_t n) {
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		return std::max(page, (n + page - 1) / page * page);
+	}
+
+	/**
+	 * wait_writable waits until n bytes are free, and throws if the channel
+	 * is closed
+	 * */
+	void wait_writable(std::unique_lock<std::mutex>& lock, size_t n) {
+		while (!is_closed && ring_capacity - (tail - head) < n) {
+			write_wait_count++;
+			write_available.wait(lock);
+			write_wait_count--;
+		}
+
+		if (is_closed) {
+			throw _closed_channel_write_exception;
+		}
+	}
+
+	/**
+	 * wait_readable waits until n bytes are available, or the channel is
+	 * closed
+	 * */
+	void wait_readable(std::unique_lock<std::mutex>& lock, size_t n) {
+		while (!is_closed && tail - head < n) {
+			read_wait_count++;
+			read_available.wait(lock);
+			read_wait_count--;
+		}
+	}
+
+	char* at(size_t pos) const {
+		return ring + pos % ring_capacity;
+	}
+
+	void committed(size_t n) {
+		tail += n;
+
+		if (read_wait_count > 0) {
+			read_available.notify_all();
+		}
+	}
+
+	void consumed(size_t n) {
+		head += n;
+
+		if (write_wait_count > 0) {
+			write_available.notify_all();
+		}
+	}
+
+public:
+	/**
+	 * @param   capacity   size_t   the size of the ring in bytes
+	 * */
+	explicit byte_chan(size_t capacity)
+	    : ring(nullptr),
+	      ring_capacity(round_to_pages(capacity)),
+	      head(0),
+	      tail(0),
+	      is_closed(false),
+	      read_wait_count(0),
+	      write_wait_count(0) {
+		if (capacity == 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+
+		map();
+	}
+
+	~byte_chan() {
+		munmap(ring, 2 * ring_capacity);
+	}
+
+	byte_chan(const byte_chan& other) = delete;
+	byte_chan& operator=(const byte_chan& other) = delete;
+
+	size_t capacity() const {
+		return ring_capacity;
+	}
+
+	/**
+	 * size returns the number of bytes waiting to be read
+	 * */
+	size_t size() const {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+		return tail - head;
+	}
+
+	/**
+	 * close closes the channel, readers still get the bytes that are left
+	 * */
+	bool close() {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+
+		if (is_closed) {
+			throw _channel_closed_exception;
+		}
+
+		is_closed = true;
+
+		read_available.notify_all();
+		write_available.notify_all();
+
+		return true;
+	}
+
+	bool isClosed() const {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+		return is_closed;
+	}
+
+	/**
+	 * write copies all the bytes into the ring, blocking while it is full.
+	 * Writes larger than the capacity are copied in several parts.
+	 *
+	 *
+	 * @param   buf   const void*   the bytes to write
+	 * @param   n     size_t        the number of bytes
+	 * */
+	void write(const void* buf, size_t n) {
+		const char* src = static_cast<const char*>(buf);
+
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+
+		while (n > 0) {
+			wait_writable(data_lock, std::min(n, ring_capacity));
+
+			size_t part = std::min(n, ring_capacity - (tail - head));
+			memcpy(at(tail), src, part);
+			committed(part);
+
+			src += part;
+			n -= part;
+		}
+	}
+
+	/**
+	 * read_some copies up to n bytes out of the ring, blocking only while
+	 * it is empty
+	 *
+	 *
+	 * @param   buf   void*    the buffer to copy the bytes to
+	 * @param   n     size_t   the size of the buffer
+	 *
+	 * @return        size_t   the number of bytes read, 0 if the channel is
+	 *                         closed and drained
+	 * */
+	size_t read_some(void* buf, size_t n) {
+		if (n == 0) {
+			return 0;
+		}
+
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+
+		wait_readable(data_lock, 1);
+
+		size_t part = std::min(n, tail - head);
+		memcpy(buf, at(head), part);
+		consumed(part);
+
+		return part;
+	}
+
+	/**
+	 * writable_span waits until at least min bytes of the ring are free,
+	 * and returns all the free space, which is filled in place and then
+	 * published with commit. It throws closed_channel_write_exception if
+	 * the channel is closed.
+	 *
+	 *
+	 * @param   min   size_t      the number of bytes needed, at most the capacity
+	 *
+	 * @return        byte_span   the free space
+	 * */
+	byte_span writable_span(size_t min = 1) {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+
+		wait_writable(data_lock, std::min(std::max(min, static_cast<size_t>(1)), ring_capacity));
+
+		byte_span span = {at(tail), ring_capacity - (tail - head)};
+		return span;
+	}
+
+	/**
+	 * commit publishes the first n bytes of the last writable span
+	 * */
+	void commit(size_t n) {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+		committed(std::min(n, ring_capacity - (tail - head)));
+	}
+
+	/**
+	 * readable_span waits until at least min bytes are available, and
+	 * returns all of them, to be used in place and then released with
+	 * consume. Once the channel is closed it returns what is left, which
+	 * may be less than min, and an empty span after that.
+	 *
+	 *
+	 * @param   min   size_t      the number of bytes needed, at most the capacity
+	 *
+	 * @return        byte_span   the available bytes
+	 * */
+	byte_span readable_span(size_t min = 1) {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+
+		wait_readable(data_lock, std::min(std::max(min, static_cast<size_t>(1)), ring_capacity));
+
+		byte_span span = {at(head), tail - head};
+		return span;
+	}
+
+	/**
+	 * consume releases the first n bytes of the last readable span
+	 * */
+	void consume(size_t n) {
+		std::unique_lock<std::mutex> data_lock(data_mutex);
+		consumed(std::min(n, tail - head));
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "byte_chan.hh"
+
+TEST(byte_chan, write_read) {
+	chan::byte_chan c(100);
+
+	ASSERT_EQ(0u, c.capacity() % static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+
+	c.write("hello world", 11);
+	ASSERT_EQ(11u, c.size());
+
+	char buf[16] = {0};
+	ASSERT_EQ(5u, c.read_some(buf, 5));
+	ASSERT_EQ(std::string("hello"), std::string(buf, 5));
+
+	ASSERT_EQ(6u, c.read_some(buf, sizeof(buf)));
+	ASSERT_EQ(std::string(" world"), std::string(buf, 6));
+}
+
+TEST(byte_chan, spans_never_wrap) {
+	chan::byte_chan c(1);
+	size_t capacity = c.capacity();
+
+	// move the positions close to the end of the ring
+	std::vector<char> filler(capacity - 3, 'x');
+	c.write(filler.data(), filler.size());
+
+	chan::byte_span in = c.readable_span();
+	ASSERT_EQ(filler.size(), in.size);
+	c.consume(in.size);
+
+	chan::byte_span out = c.writable_span(10);
+	ASSERT_EQ(capacity, out.size);
+
+	// the span crosses the end of the ring
+	memcpy(out.data, "0123456789", 10);
+	c.commit(10);
+
+	in = c.readable_span();
+	ASSERT_EQ(10u, in.size);
+	ASSERT_EQ(std::string("0123456789"), std::string(in.data, in.size));
+
+	c.consume(4);
+	in = c.readable_span();
+	ASSERT_EQ(std::string("456789"), std::string(in.data, in.size));
+}
+
+TEST(byte_chan, stream) {
+	chan::byte_chan c(1);
+	const size_t total = c.capacity() * 10 + 123;
+
+	std::thread producer([&](){
+		std::vector<char> buf(c.capacity() * 3);
+		size_t sent = 0;
+
+		while (sent < total) {
+			size_t n = std::min(buf.size(), total - sent);
+			for (size_t i = 0 ; i < n ; i++) {
+				buf[i] = static_cast<char>((sent + i) % 251);
+			}
+
+			c.write(buf.data(), n);
+			sent += n;
+		}
+
+		c.close();
+	});
+
+	size_t received = 0;
+	chan::byte_span in;
+	while ((in = c.readable_span()).size > 0) {
+		for (size_t i = 0 ; i < in.size ; i++) {
+			ASSERT_EQ(static_cast<char>((received + i) % 251), in.data[i]);
+		}
+
+		received += in.size;
+		c.consume(in.size);
+	}
+
+	producer.join();
+
+	ASSERT_EQ(total, received);
+}
+
+TEST(byte_chan, close) {
+	chan::byte_chan c(64);
+
+	c.write("abc", 3);
+	c.close();
+
+	ASSERT_THROW(c.write("d", 1), chan::closed_channel_write_exception);
+	ASSERT_THROW(c.writable_span(), chan::closed_channel_write_exception);
+
+	char buf[8];
+	ASSERT_EQ(3u, c.read_some(buf, sizeof(buf)));
+	ASSERT_EQ(0u, c.read_some(buf, sizeof(buf)));
+	ASSERT_EQ(0u, c.readable_span().size);
+}
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 #include "circular_queue.hh"
+#include "context.hh"
+#include "spin_ring.hh"
+#include "trace.hh"
+#include "wait_queue.hh"
 
 namespace chan {
 
@@ -26,6 +37,12 @@ struct buffered_chan_zero_size_exception: public std::exception {
 	}
 } _buffered_chan_zero_size_exception;
 
+struct buffered_chan_hook_taken_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot set a hook on a buffered channel that already has one, remove it first";
+	}
+} _buffered_chan_hook_taken_exception;
+
 /**
  * read_chan defines an interface for a channel that only supports reads
  *
@@ -57,6 +74,19 @@ public:
 	virtual bool isClosed() const = 0;
 	virtual bool read(T&) = 0;
 
+	/**
+	 * read with a context blocks like read, but gives up when ctx is
+	 * cancelled or its deadline passes, throwing
+	 * context_cancelled_exception or context_deadline_exceeded_exception.
+	 *
+	 * Channels that cannot abort a blocked read only check the context
+	 * before reading.
+	 * */
+	virtual bool read(T& val, context& ctx) {
+		ctx.check();
+		return this->read(val);
+	}
+
 	/**
 	 * recv is an alias for read.
 	 * */
@@ -105,6 +135,27 @@ public:
 	virtual bool isClosed() const = 0;
 	virtual void write(const T&) = 0;
 
+	/**
+	 * write with a context blocks like write, but gives up when ctx is
+	 * cancelled or its deadline passes, throwing
+	 * context_cancelled_exception or context_deadline_exceeded_exception.
+	 *
+	 * Channels that cannot abort a blocked write only check the context
+	 * before writing.
+	 * */
+	virtual void write(const T& val, context& ctx) {
+		ctx.check();
+		this->write(val);
+	}
+
+	/**
+	 * write with an rvalue lets channels that store values move them in,
+	 * others copy it
+	 * */
+	virtual void write(T&& val) {
+		this->write(static_cast<const T&>(val));
+	}
+
 	/**
 	 * send is an alias for write.
 	 * */
@@ -125,7 +176,7 @@ public:
 /**
  * chan defines the common interface for a channel supporting reads and writes.
  * It defines all required functions except for read and write, which are
- * implemented individually by buffered_chan and unbuffered_chan.
+ * implemented individually by buffered_engine and unbuffered_engine.
  *
  * The abscence of these 2 functions makes this an abstract type, so it cannot
  * be instantiated.
@@ -140,8 +191,30 @@ protected:
 	int read_wait_count;
 	int write_wait_count;
 
-	mutable std::condition_variable read_available;
-	mutable std::condition_variable write_available;
+	mutable wait_queue read_available;
+	mutable wait_queue write_available;
+
+	/**
+	 * wait_on waits on a queue, under ctx if it isn't null. It returns
+	 * false if ctx is done, in which case the caller should restore its
+	 * state and call raise.
+	 * */
+	bool wait_on(wait_queue& queue, std::unique_lock<std::mutex>& lock, context* ctx) {
+		if (ctx == nullptr) {
+			queue.wait(lock);
+			return true;
+		}
+
+		return queue.wait(lock, *ctx) == wait_status::notified;
+	}
+
+	/**
+	 * raise throws the exception for a context that ended a wait
+	 * */
+	static void raise(const context* ctx) {
+		ctx->check();
+		throw _context_cancelled_exception;
+	}
 
 public:
 	chan() : is_closed(false), read_wait_count(0), write_wait_count(0) {}
@@ -166,8 +239,9 @@ public:
 		}
 
 		is_closed = true;
+		CHAN_TRACE_CLOSE(this);
 
-		// notify any waiting read and write condition variables
+		// notify any waiting readers and writers
 		read_available.notify_all();
 		write_available.notify_all();
 
@@ -187,8 +261,8 @@ public:
 };
 
 /**
- * unbuffered_chan implements chan with unbuffered bidirectional reads and
- * writes.
+ * unbuffered_engine implements chan with unbuffered bidirectional reads and
+ * writes. It is the engine behind unbuffered_chan, see basic_chan.
  *
  * In addition to synchronizing data, it also synchronizes reads and
  * writes and at a time only one thread is allowed to read or write data.
@@ -200,27 +274,156 @@ public:
  * - https://golang.org/doc/effective_go.html#channels
  * */
 template <typename T>
-class unbuffered_chan : public chan<T> {
+class unbuffered_engine : public chan<T> {
 private:
 	T data;
 	bool set;
 
-	mutable std::mutex read_mutex;
-	mutable std::mutex write_mutex;
+	// only one reader and one writer take part in an exchange at a time,
+	// the rest wait for their turn
+	bool reading;
+	bool writing;
+
+	mutable wait_queue read_turn;
+	mutable wait_queue write_turn;
+
+	void end_read_turn() {
+		reading = false;
+		read_turn.notify_one();
+	}
+
+	void end_write_turn() {
+		writing = false;
+		write_turn.notify_one();
+	}
+
+	void write_with(const T& val, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		while (!this->is_closed && writing) {
+			CHAN_TRACE_BLOCK_BEGIN(this, write);
+			bool woken = this->wait_on(write_turn, data_lock, ctx);
+			CHAN_TRACE_BLOCK_END(this, write);
+
+			if (!woken) {
+				this->raise(ctx);
+			}
+		}
+
+		if (this->is_closed) {
+			throw _closed_channel_write_exception;
+		}
+
+		writing = true;
+
+		data = val;
+		set = true;
+		this->write_wait_count++;
+
+		if (this->read_wait_count > 0) {
+			this->read_available.notify_one();
+		}
+
+		// wait until data is consumed
+		while (!this->is_closed && set) {
+			CHAN_TRACE_BLOCK_BEGIN(this, write);
+			bool woken = this->wait_on(this->write_available, data_lock, ctx);
+			CHAN_TRACE_BLOCK_END(this, write);
+
+			if (!woken && set && !this->is_closed) {
+				// nobody has taken the value yet, so take it back
+				set = false;
+				this->write_wait_count--;
+
+				end_write_turn();
+				this->raise(ctx);
+			}
+		}
+
+		end_write_turn();
+	}
+
+	bool read_with(T& valref, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		while (!this->is_closed && reading) {
+			CHAN_TRACE_BLOCK_BEGIN(this, read);
+			bool woken = this->wait_on(read_turn, data_lock, ctx);
+			CHAN_TRACE_BLOCK_END(this, read);
+
+			if (!woken) {
+				this->raise(ctx);
+			}
+		}
+
+		reading = true;
+
+		while (!this->is_closed && this->write_wait_count == 0) {
+			this->read_wait_count++;
+			CHAN_TRACE_BLOCK_BEGIN(this, read);
+			bool woken = this->wait_on(this->read_available, data_lock, ctx);
+			CHAN_TRACE_BLOCK_END(this, read);
+			this->read_wait_count--;
+
+			if (!woken && this->write_wait_count == 0) {
+				end_read_turn();
+				this->raise(ctx);
+			}
+		}
+
+		end_read_turn();
+
+		if (this->is_closed) {
+			// TODO: figure out error here
+			valref = T();
+			return false;
+		}
+
+		valref = data;
+		set = false;
+		CHAN_TRACE_HANDOFF(this, read);
+
+		this->write_wait_count--;
+		this->write_available.notify_one();
+
+		return true;
+	}
 
 public:
-	unbuffered_chan() : data(T()), set(false) {}
+	unbuffered_engine() : data(T()), set(false), reading(false), writing(false) {}
+
+	unbuffered_engine(const unbuffered_engine& other) = delete;
+	unbuffered_engine& operator=(const unbuffered_engine& other) = delete;
+	unbuffered_engine(unbuffered_engine&& other) = delete;
+	unbuffered_engine& operator=(unbuffered_engine&& other) = delete;
+
+	/**
+	 * close closes the channel, also waking up readers and writers waiting
+	 * for their turn
+	 * */
+	bool close() {
+		bool result = chan<T>::close();
+
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		read_turn.notify_all();
+		write_turn.notify_all();
 
-	unbuffered_chan(const unbuffered_chan& other) = delete;
-	unbuffered_chan& operator=(const unbuffered_chan& other) = delete;
-	unbuffered_chan(unbuffered_chan&& other) = delete;
-	unbuffered_chan& operator=(unbuffered_chan&& other) = delete;
+		return result;
+	}
 
 	/**
 	 * write here implements writing to an unbuffered channel in a manner
 	 * that is semantically similar to the mechanism in golang.
 	 *
-	 * It first synchronizes write, then data.
+	 * It first waits for its turn among writers.
 	 *
 	 * It proceeds with first writing the value, and then proceeding to
 	 * notify any waiting readers, following which, if the data still hasn't
@@ -236,29 +439,19 @@ public:
 	 * @param   val   const T&   the value to add
 	 * */
 	void write(const T& val) {
-		std::unique_lock<std::mutex> write_lock(write_mutex);
-		std::unique_lock<std::mutex> data_lock(this->data_mutex);
-
-		if (this->is_closed) {
-			throw _closed_channel_write_exception;
-		}
-
-		data = val;
-		set = true;
-		this->write_wait_count++;
-
-		if (this->read_wait_count > 0) {
-			this->read_available.notify_one();
-		}
+		write_with(val, nullptr);
+	}
 
-		// wait until data is consumed
-		while (!this->is_closed && set) {
-			this->write_available.wait(data_lock);
-		}
+	/**
+	 * write with a context gives up if ctx is done before a reader took
+	 * the value, in which case the value is not delivered
+	 * */
+	void write(const T& val, context& ctx) {
+		write_with(val, &ctx);
 	}
 
 	/**
-	 * read first synchronizes the read, then data. Then it first waits for
+	 * read first waits for its turn among readers. Then it first waits for
 	 * a write to happen, following which if the channel is still open, it
 	 * will consume the data and notify any blocked writers to unblock
 	 * themselves.
@@ -274,55 +467,428 @@ public:
 	 * @return           bool  the result of this mission
 	 * */
 	bool read(T& valref) {
-		std::unique_lock<std::mutex> read_lock(read_mutex);
-		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return read_with(valref, nullptr);
+	}
 
-		while (!this->is_closed && this->write_wait_count == 0) {
-			this->read_wait_count++;
-			this->read_available.wait(data_lock);
-			this->read_wait_count--;
-		}
+	bool read(T& valref, context& ctx) {
+		return read_with(valref, &ctx);
+	}
+};
 
-		if (this->is_closed) {
-			// TODO: figure out error here
-			valref = T();
-			return false;
-		}
+/**
+ * wake_policy decides when a buffered_chan wakes up blocked readers and
+ * writers.
+ *
+ * By default every write wakes a blocked reader and every read wakes a
+ * blocked writer, which under bursts costs a futex wake per element, and
+ * readers that wake up only to find a single element and go back to sleep.
+ *
+ * With coalescing, writers only wake a reader when the buffer goes from
+ * empty to non empty, and a woken reader that still sees data hands the
+ * wakeup on to the next blocked reader. A reader that had to block can
+ * then also linger until min_batch elements are buffered, or max_delay
+ * has passed, before it starts consuming, which bounds the added latency.
+ * Blocked writers are released together once min_batch slots are free.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<int> c(1024, chan::wake_policy::batch(64, std::chrono::microseconds(50)));
+ * ```
+ * */
+struct wake_policy {
+	int min_batch;
+	std::chrono::microseconds max_delay;
+	bool coalesce;
 
-		valref = data;
-		set = false;
+	wake_policy(
+	    int min_batch = 1,
+	    std::chrono::microseconds max_delay = std::chrono::microseconds::zero(),
+	    bool coalesce = false)
+	    : min_batch(min_batch), max_delay(max_delay), coalesce(coalesce) {}
 
-		this->write_wait_count--;
-		this->write_available.notify_one();
+	/**
+	 * every wakes a blocked reader or writer on every operation, this is the
+	 * default
+	 * */
+	static wake_policy every() {
+		return wake_policy();
+	}
 
-		return true;
+	/**
+	 * transition wakes readers only when the buffer becomes non empty
+	 * */
+	static wake_policy transition() {
+		return wake_policy(1, std::chrono::microseconds::zero(), true);
 	}
+
+	/**
+	 * batch lets a woken reader wait for up to max_delay until n elements
+	 * are buffered
+	 * */
+	static wake_policy batch(int n, std::chrono::microseconds max_delay) {
+		return wake_policy(n, max_delay, true);
+	}
+
+	/**
+	 * window lets a woken reader collect elements for max_delay, or until
+	 * the buffer is full
+	 * */
+	static wake_policy window(std::chrono::microseconds max_delay) {
+		return wake_policy(INT_MAX, max_delay, true);
+	}
+};
+
+/**
+ * readiness is told whether a buffered channel can be read from and
+ * written to without blocking, after every change, with the channel's
+ * lock held. A closed channel is both. It lets a channel be watched from
+ * outside, see pollable_chan in pollable_chan.hh.
+ * */
+struct readiness {
+	virtual ~readiness() {}
+
+	virtual void update(bool readable, bool writable) = 0;
 };
 
 /**
- * buffered_chan implements a buffered channel that supports multiple read/write
- * operations, upto a fixed "capacity".
+ * buffered_engine implements a buffered channel that supports multiple read/write
+ * operations, upto a fixed "capacity". It is the engine behind buffered_chan,
+ * and any basic_chan with a blocking wait policy, see basic_chan.
+ *
+ * It can be used to perform operations in batches. To bound concurrency
+ * like a semaphore, token_chan in token_chan.hh does the same without
+ * storing values or taking a lock.
  *
- * It can be used as a semaphore, to perform operations in batches.
+ * The buffer is allocated through Allocator, see allocator.hh for huge
+ * page and NUMA local allocators suitable for large buffers.
+ *
+ * When blocked readers and writers are woken up is controlled by a
+ * wake_policy.
  * */
-template <typename T>
-class buffered_chan : public chan<T> {
+template <typename T, typename Allocator = std::allocator<T>>
+class buffered_engine : public chan<T> {
 private:
 	int capacity;
-	circular_queue<T> data;
+	circular_queue<T, Allocator> data;
+
+	wake_policy policy;
+
+	// the number of elements that a lingering reader waits for, and the
+	// number of free slots that release blocked writers
+	int batch;
+
+	int linger_count;
+	mutable std::condition_variable batch_available;
+
+	// called with data_mutex held after values are written or read, see
+	// on_readable and on_writable
+	std::function<void()> readable_hook;
+	std::function<void()> writable_hook;
+
+	readiness* watcher;
+
+	void notify_watcher() {
+		if (watcher != nullptr) {
+			watcher->update(this->is_closed || !data.empty(), this->is_closed || data.size() < capacity);
+		}
+	}
+
+	/**
+	 * pushed wakes readers as required by the wake policy, after count
+	 * values were added to the buffer. It must be called with data_mutex
+	 * held.
+	 * */
+	void pushed(bool was_empty, int count) {
+		CHAN_TRACE_DEPTH(this, data.size());
+		notify_watcher();
+
+		if (readable_hook) {
+			readable_hook();
+		}
+
+		// signal waiting readers
+		if (this->read_wait_count > 0 && (!policy.coalesce || was_empty)) {
+			if (count > 1 && !policy.coalesce) {
+				this->read_available.notify_all();
+			} else {
+				this->read_available.notify_one();
+			}
+		}
+
+		if (linger_count > 0 && data.size() >= batch) {
+			batch_available.notify_one();
+		}
+	}
+
+	/**
+	 * popped wakes readers and writers as required by the wake policy,
+	 * after count values were removed from the buffer. It must be called
+	 * with data_mutex held.
+	 * */
+	void popped(int count) {
+		notify_watcher();
+
+		if (writable_hook) {
+			writable_hook();
+		}
+
+		if (!policy.coalesce) {
+			if (this->write_wait_count > 0) {
+				if (count > 1) {
+					this->write_available.notify_all();
+				} else {
+					this->write_available.notify_one();
+				}
+			}
+
+			return;
+		}
+
+		// writers only wake a reader on the empty to non empty transition, so
+		// pass the wakeup on while there is data left
+		if (this->read_wait_count > 0 && !data.empty()) {
+			this->read_available.notify_one();
+		}
+
+		if (this->write_wait_count > 0 && capacity - data.size() >= batch) {
+			if (count > 1) {
+				this->write_available.notify_all();
+			} else {
+				this->write_available.notify_one();
+			}
+		}
+	}
+
+	template <typename U>
+	void push(U&& val) {
+		bool was_empty = data.empty();
+		data.push(std::forward<U>(val));
+
+		pushed(was_empty, 1);
+	}
+
+	void pop(T& valref) {
+		data.pop(valref);
+
+		popped(1);
+	}
+
+	template <typename U>
+	void write_with(U&& val, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		while (!this->is_closed && data.size() == capacity) {
+			this->write_wait_count++;
+			CHAN_TRACE_BLOCK_BEGIN(this, write);
+			bool woken = this->wait_on(this->write_available, data_lock, ctx);
+			CHAN_TRACE_BLOCK_END(this, write);
+			this->write_wait_count--;
+
+			if (!woken && data.size() == capacity) {
+				this->raise(ctx);
+			}
+		}
+
+		if (this->is_closed) {
+			throw _closed_channel_write_exception;
+		}
+
+		push(std::forward<U>(val));
+
+		// NOTE: this doesn't immediately block for read
+	}
+
+	bool read_with(T& valref, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		bool blocked = false;
+
+		while (true) {
+			while (data.empty()) {
+				if (this->is_closed) {
+					// TODO: figure out error handling here
+					valref = T();
+					return false;
+				}
+
+				this->read_wait_count++;
+				CHAN_TRACE_BLOCK_BEGIN(this, read);
+				bool woken = this->wait_on(this->read_available, data_lock, ctx);
+				CHAN_TRACE_BLOCK_END(this, read);
+				this->read_wait_count--;
+
+				if (!woken && data.empty()) {
+					this->raise(ctx);
+				}
+
+				blocked = true;
+			}
+
+			if (!blocked || batch <= 1 || data.size() >= batch) {
+				break;
+			}
+
+			auto deadline = std::chrono::steady_clock::now() + policy.max_delay;
+
+			linger_count++;
+			while (!this->is_closed && data.size() < batch) {
+				if (batch_available.wait_until(data_lock, deadline) == std::cv_status::timeout) {
+					break;
+				}
+			}
+			linger_count--;
+
+			// the lock was released while lingering, so other readers may
+			// have taken what was there
+			if (!data.empty()) {
+				break;
+			}
+		}
+
+		pop(valref);
+
+		return true;
+	}
+
+protected:
+	/**
+	 * watch sets the readiness that is told about every change of the
+	 * channel, and tells it the current state. The readiness is not owned
+	 * by the channel, and has to stay alive until it is removed with
+	 * nullptr, or the channel is destroyed.
+	 * */
+	void watch(readiness* r) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		watcher = r;
+		notify_watcher();
+	}
 
 public:
-	buffered_chan(int capacity)
-	    : capacity(capacity), data(circular_queue<T>(capacity)) {
+	buffered_engine(int capacity, const Allocator& alloc = Allocator())
+	    : buffered_engine(capacity, wake_policy(), alloc) {}
+
+	buffered_engine(int capacity, wake_policy policy, const Allocator& alloc = Allocator())
+	    : capacity(capacity),
+	      data(capacity, alloc),
+	      policy(policy),
+	      batch(policy.min_batch < capacity ? policy.min_batch : capacity),
+	      linger_count(0),
+	      watcher(nullptr) {
 		if (capacity == 0) {
 			throw _buffered_chan_zero_size_exception;
 		}
+
+		if (batch < 1) {
+			batch = 1;
+		}
+	}
+
+	buffered_engine(const buffered_engine& other) = delete;
+	buffered_engine& operator=(const buffered_engine& other) = delete;
+	buffered_engine(buffered_engine&& other) = delete;
+	buffered_engine& operator=(buffered_engine&& other) = delete;
+
+	/**
+	 * size returns the number of values in the buffer
+	 * */
+	int size() const {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return data.size();
+	}
+
+	/**
+	 * space returns the number of values that can be written without
+	 * blocking
+	 * */
+	int space() const {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return capacity - data.size();
 	}
 
-	buffered_chan(const buffered_chan& other) = delete;
-	buffered_chan& operator=(const buffered_chan& other) = delete;
-	buffered_chan(buffered_chan&& other) = delete;
-	buffered_chan& operator=(buffered_chan&& other) = delete;
+	/**
+	 * readers_waiting returns the number of readers blocked on the channel,
+	 * which are ready to take a value right away
+	 * */
+	int readers_waiting() const {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return this->read_wait_count;
+	}
+
+	/**
+	 * on_readable sets a function that is called after every write, once
+	 * the buffer has values, and when the channel is closed. It lets
+	 * something that reads from several channels, like a fair_consumer,
+	 * wait for any of them.
+	 *
+	 * The function is called with the channel's lock held, so it must be
+	 * short and must not use the channel. A channel has a single hook,
+	 * setting one while another is set throws
+	 * buffered_chan_hook_taken_exception, so one owner can't silently take
+	 * the hook of another. It can be removed at any time.
+	 *
+	 *
+	 * @param   hook   std::function<void()>   the function, or nullptr to remove it
+	 * */
+	void on_readable(std::function<void()> hook) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (hook && readable_hook) {
+			throw _buffered_chan_hook_taken_exception;
+		}
+
+		readable_hook = hook;
+	}
+
+	/**
+	 * on_writable sets a function that is called after every read, once
+	 * the buffer has room again, and when the channel is closed, like
+	 * on_readable. It lets something that writes to several channels, like
+	 * a dispatcher, wait for any of them.
+	 *
+	 *
+	 * @param   hook   std::function<void()>   the function, or nullptr to remove it
+	 * */
+	void on_writable(std::function<void()> hook) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (hook && writable_hook) {
+			throw _buffered_chan_hook_taken_exception;
+		}
+
+		writable_hook = hook;
+	}
+
+	/**
+	 * close closes the channel, also waking up any lingering readers, and
+	 * calling the hooks, so that whoever waits through them sees it
+	 * */
+	bool close() {
+		bool result = chan<T>::close();
+
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		batch_available.notify_all();
+		notify_watcher();
+
+		if (readable_hook) {
+			readable_hook();
+		}
+
+		if (writable_hook) {
+			writable_hook();
+		}
+
+		return result;
+	}
 
 	/**
 	 * write implements writing to a buffered channel. There is no call
@@ -334,26 +900,198 @@ public:
 	 * @param   val   const T&   the value to add
 	 * */
 	void write(const T& val) {
-		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		write_with(val, nullptr);
+	}
 
-		while (!this->is_closed && data.size() == capacity) {
-			this->write_wait_count++;
-			this->write_available.wait(data_lock);
-			this->write_wait_count--;
-		}
+	/**
+	 * write with a context gives up if ctx is done while the buffer is
+	 * full, in which case the value is not added
+	 * */
+	void write(const T& val, context& ctx) {
+		write_with(val, &ctx);
+	}
+
+	/**
+	 * write with an rvalue moves the value into the buffer
+	 * */
+	void write(T&& val) {
+		write_with(std::move(val), nullptr);
+	}
+
+	/**
+	 * try_write is the non blocking counterpart of write. If the buffer
+	 * is full it returns immediately without adding the value, otherwise
+	 * it behaves exactly like write.
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 *
+	 * @return        bool       true if the value was added, false if the
+	 *                           buffer was full
+	 * */
+	bool try_write(const T& val) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
 
 		if (this->is_closed) {
 			throw _closed_channel_write_exception;
 		}
 
-		data.push(val);
+		if (data.size() == capacity) {
+			return false;
+		}
+
+		push(val);
 
-		// signal waiting reader
-		if (this->read_wait_count > 0) {
-			this->read_available.notify_one();
+		return true;
+	}
+
+	/**
+	 * try_read is the non blocking counterpart of read. If the buffer is
+	 * empty it returns false, whether or not the channel is closed.
+	 *
+	 *
+	 * @param   valref   T&     the reference that is assigned the value in the front
+	 *
+	 * @return           bool   true if a value was read
+	 * */
+	bool try_read(T& valref) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (data.empty()) {
+			return false;
 		}
 
-		// NOTE: this doesn't immediately block for read
+		pop(valref);
+
+		return true;
+	}
+
+	/**
+	 * write_range writes n values in order, blocking while the buffer is
+	 * full. Runs of values are copied in and out of the buffer in bulk,
+	 * with memcpy for trivially copyable types, see
+	 * circular_queue::push_range.
+	 *
+	 * Values from concurrent writers may be interleaved with them. If the
+	 * channel is closed midway, the values written so far stay in the
+	 * channel and closed_channel_write_exception is thrown.
+	 *
+	 *
+	 * @param   vals   const T*   the values to add
+	 * @param   n      int        the number of values
+	 * */
+	void write_range(const T* vals, int n) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		while (n > 0) {
+			while (!this->is_closed && data.size() == capacity) {
+				this->write_wait_count++;
+				CHAN_TRACE_BLOCK_BEGIN(this, write);
+				this->write_available.wait(data_lock);
+				CHAN_TRACE_BLOCK_END(this, write);
+				this->write_wait_count--;
+			}
+
+			if (this->is_closed) {
+				throw _closed_channel_write_exception;
+			}
+
+			bool was_empty = data.empty();
+			int count = data.push_range(vals, n);
+
+			pushed(was_empty, count);
+
+			vals += count;
+			n -= count;
+		}
+	}
+
+	/**
+	 * write_transform stores the results of n units of work, each of which
+	 * produces at most one value, straight into the buffer, without going
+	 * through an intermediate array. It waits for free slots, then calls
+	 * fill(slots, offset, count) with a contiguous run of them, for units
+	 * offset to offset + count, where count is at most the length of the
+	 * run. fill stores its values at the start of the run, and returns how
+	 * many it stored.
+	 *
+	 * fill is called with the channel locked, it should be a short kernel
+	 * that doesn't use the channel, see vector_stage.hh.
+	 *
+	 *
+	 * @param   n      int   the number of units of work
+	 * @param   fill   F     int(T* slots, int offset, int count)
+	 * */
+	template <typename F>
+	void write_transform(int n, F fill) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		int offset = 0;
+
+		while (offset < n) {
+			while (!this->is_closed && data.size() == capacity) {
+				this->write_wait_count++;
+				CHAN_TRACE_BLOCK_BEGIN(this, write);
+				this->write_available.wait(data_lock);
+				CHAN_TRACE_BLOCK_END(this, write);
+				this->write_wait_count--;
+			}
+
+			if (this->is_closed) {
+				throw _closed_channel_write_exception;
+			}
+
+			int run = 0;
+			T* slots = data.back_run(run);
+
+			int count = std::min(run, n - offset);
+			int stored = fill(slots, offset, count);
+
+			if (stored > 0) {
+				bool was_empty = data.empty();
+				data.commit(stored);
+
+				pushed(was_empty, stored);
+			}
+
+			offset += count;
+		}
+	}
+
+	/**
+	 * read_range blocks until the channel has values, then reads up to n of
+	 * them in bulk, without waiting for more.
+	 *
+	 *
+	 * @param   out   T*    where the values are stored
+	 * @param   n     int   the maximum number of values
+	 *
+	 * @return        int   the number of values read, 0 once the channel
+	 *                      is closed and drained
+	 * */
+	int read_range(T* out, int n) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (n <= 0) {
+			return 0;
+		}
+
+		while (data.empty()) {
+			if (this->is_closed) {
+				return 0;
+			}
+
+			this->read_wait_count++;
+			CHAN_TRACE_BLOCK_BEGIN(this, read);
+			this->read_available.wait(data_lock);
+			CHAN_TRACE_BLOCK_END(this, read);
+			this->read_wait_count--;
+		}
+
+		int count = data.pop_range(out, n);
+		popped(count);
+
+		return count;
 	}
 
 	/**
@@ -363,35 +1101,215 @@ public:
 	 * and saves it in the passed reference, following which it notifies any
 	 * waiting writers.
 	 *
+	 * With a batching wake_policy, a reader that had to block waits for the
+	 * batch to fill up, or for the policy's max_delay, before consuming.
+	 *
 	 *
 	 * @param   valref   T&    the reference that is assigned the value in the front
 	 *
 	 * @return           bool  the result of this mission
 	 * */
 	bool read(T& valref) {
-		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return read_with(valref, nullptr);
+	}
 
-		while (data.empty()) {
-			if (this->is_closed) {
-				// TODO: figure out error handling here
-				valref = T();
-				return false;
+	bool read(T& valref, context& ctx) {
+		return read_with(valref, &ctx);
+	}
+};
+
+/**
+ * static_buffered_engine is a buffered_engine with a capacity fixed at
+ * compile time
+ * */
+template <typename T, size_t Capacity, typename Allocator = std::allocator<T>>
+class static_buffered_engine : public buffered_engine<T, Allocator> {
+public:
+	explicit static_buffered_engine(const Allocator& alloc = Allocator())
+	    : buffered_engine<T, Allocator>(static_cast<int>(Capacity), alloc) {}
+
+	static_buffered_engine(wake_policy policy, const Allocator& alloc = Allocator())
+	    : buffered_engine<T, Allocator>(static_cast<int>(Capacity), policy, alloc) {}
+};
+
+/**
+ * spinning_engine implements a channel over a lock free ring, spsc_ring or
+ * mpmc_ring, for latency sensitive code with a core per thread. Blocked
+ * readers and writers spin, yielding the processor after a while, instead
+ * of sleeping, so there are no system calls at all.
+ *
+ * Values written concurrently with close may be lost, close after the
+ * writers are done.
+ * */
+template <typename T, typename Ring>
+class spinning_engine : public read_chan<T>, public write_chan<T> {
+private:
+	static const int spin_limit = 64;
+
+	Ring ring;
+	std::atomic<bool> is_closed;
+
+	static void backoff(int& spins) {
+		if (++spins > spin_limit) {
+			std::this_thread::yield();
+		}
+	}
+
+	template <typename U>
+	void write_with(U&& val) {
+		int spins = 0;
+
+		while (true) {
+			if (is_closed.load(std::memory_order_relaxed)) {
+				throw _closed_channel_write_exception;
 			}
 
-			this->read_wait_count++;
-			this->read_available.wait(data_lock);
-			this->read_wait_count--;
+			if (ring.try_push(std::forward<U>(val))) {
+				return;
+			}
+
+			backoff(spins);
 		}
+	}
+
+public:
+	template <typename... Args>
+	explicit spinning_engine(Args&&... args) : ring(std::forward<Args>(args)...), is_closed(false) {}
+
+	spinning_engine(const spinning_engine& other) = delete;
+	spinning_engine& operator=(const spinning_engine& other) = delete;
 
-		valref = data.front();
-		data.pop();
+	size_t capacity() const {
+		return ring.capacity();
+	}
 
-		if (this->write_wait_count > 0) {
-			this->write_available.notify_one();
+	bool close() {
+		if (is_closed.exchange(true)) {
+			throw _channel_closed_exception;
 		}
 
 		return true;
 	}
+
+	bool isClosed() const {
+		return is_closed.load();
+	}
+
+	void write(const T& val) {
+		write_with(val);
+	}
+
+	void write(T&& val) {
+		write_with(std::move(val));
+	}
+
+	bool read(T& valref) {
+		int spins = 0;
+
+		while (!ring.try_pop(valref)) {
+			if (is_closed.load(std::memory_order_acquire)) {
+				// values written right before closing
+				if (ring.try_pop(valref)) {
+					return true;
+				}
+
+				valref = T();
+				return false;
+			}
+
+			backoff(spins);
+		}
+
+		return true;
+	}
+};
+
+/**
+ * ProducerKind and ConsumerKind of a basic_chan, whether one or many
+ * threads write or read it
+ * */
+struct single {};
+struct multi {};
+
+/**
+ * WaitPolicy of a basic_chan, whether blocked threads sleep or spin
+ * */
+struct blocking {};
+struct spinning {};
+
+/**
+ * chan_engine selects the implementation of a basic_chan
+ * */
+template <typename T, size_t Capacity, typename ProducerKind, typename ConsumerKind, typename WaitPolicy, typename Allocator>
+struct chan_engine {
+	static_assert(std::is_same<WaitPolicy, blocking>::value || std::is_same<WaitPolicy, spinning>::value,
+	              "WaitPolicy must be chan::blocking or chan::spinning");
+
+	static const bool spsc = std::is_same<ProducerKind, single>::value && std::is_same<ConsumerKind, single>::value;
+
+	typedef typename std::conditional<
+	    Capacity == dynamic_capacity,
+	    buffered_engine<T, Allocator>,
+	    static_buffered_engine<T, Capacity, Allocator>>::type blocking_engine;
+
+	typedef typename std::conditional<
+	    spsc,
+	    spinning_engine<T, spsc_ring<T, Capacity, Allocator>>,
+	    spinning_engine<T, mpmc_ring<T, Capacity, Allocator>>>::type spinning_engine_type;
+
+	typedef typename std::conditional<
+	    Capacity == 0,
+	    unbuffered_engine<T>,
+	    typename std::conditional<
+	        std::is_same<WaitPolicy, blocking>::value,
+	        blocking_engine,
+	        spinning_engine_type>::type>::type type;
 };
 
+/**
+ * basic_chan is a channel whose implementation is picked at compile time
+ * from its parameters, so the cheapest one that is correct for the use is
+ * chosen without any runtime dispatch:
+ *
+ * - Capacity 0 is an unbuffered channel, unbuffered_engine.
+ *
+ * - A blocking WaitPolicy uses buffered_engine, with the capacity given to
+ * the constructor if Capacity is dynamic_capacity, or fixed otherwise.
+ *
+ * - A spinning WaitPolicy uses a lock free ring, spsc_ring if there is a
+ * single producer and a single consumer, and mpmc_ring otherwise. With a
+ * fixed Capacity the ring is stored inline.
+ *
+ * unbuffered_chan and buffered_chan are aliases of basic_chan.
+ *
+ * example usage:
+ *
+ * ```
+ * // a fixed size channel from one thread to another, without system calls
+ * chan::basic_chan<sample, 1024, chan::single, chan::single, chan::spinning> c;
+ *
+ * // a buffered channel for several threads, with a capacity decided at runtime
+ * chan::basic_chan<job> jobs(n);
+ * ```
+ * */
+template <
+    typename T,
+    size_t Capacity = dynamic_capacity,
+    typename ProducerKind = multi,
+    typename ConsumerKind = multi,
+    typename WaitPolicy = blocking,
+    typename Allocator = std::allocator<T>>
+class basic_chan : public chan_engine<T, Capacity, ProducerKind, ConsumerKind, WaitPolicy, Allocator>::type {
+public:
+	typedef typename chan_engine<T, Capacity, ProducerKind, ConsumerKind, WaitPolicy, Allocator>::type engine;
+
+	using engine::engine;
+};
+
+template <typename T>
+using unbuffered_chan = basic_chan<T, 0>;
+
+template <typename T, typename Allocator = std::allocator<T>>
+using buffered_chan = basic_chan<T, dynamic_capacity, multi, multi, blocking, Allocator>;
+
 }  // namespace chan
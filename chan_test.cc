@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <string>
+#include <type_traits>
 #include <thread>
+#include <vector>
 
 #include "chan.hh"
 
@@ -264,3 +267,276 @@ TEST(unbuffered_chan, multi_with_pause) {
 		pool[i].join();
 	}
 }
+
+TEST(buffered_chan, transition_wake_policy) {
+	chan::buffered_chan<int> c(16, chan::wake_policy::transition());
+
+	std::atomic<long> sum;
+	sum.store(0);
+
+	std::thread readers[4];
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i] = std::thread([&](){
+			int x = 0;
+			while (c.read(x)) {
+				sum += x;
+			}
+		});
+	}
+
+	std::thread writers[4];
+	for (int i = 0 ; i < 4 ; i++) {
+		writers[i] = std::thread([&](){
+			for (int j = 1 ; j <= 10000 ; j++) {
+				c << j;
+			}
+		});
+	}
+
+	for (int i = 0 ; i < 4 ; i++) {
+		writers[i].join();
+	}
+
+	c.close();
+
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i].join();
+	}
+
+	ASSERT_EQ(4L * 10000 * 10001 / 2, sum.load());
+}
+
+TEST(buffered_chan, batch_wake_policy_bounds_latency) {
+	chan::buffered_chan<int> c(64, chan::wake_policy::batch(32, std::chrono::microseconds(20000)));
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		c << 1;
+	});
+
+	// a single element never fills the batch, so it is delivered once the
+	// lingering reader times out
+	auto start = std::chrono::steady_clock::now();
+
+	int x = 0;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+
+	t.join();
+}
+
+TEST(buffered_chan, batch_wake_policy_fills_batch) {
+	chan::buffered_chan<int> c(64, chan::wake_policy::batch(8, std::chrono::seconds(10)));
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		for (int i = 0 ; i < 8 ; i++) {
+			c << i;
+		}
+	});
+
+	// the reader is released as soon as the batch is full, long before
+	// max_delay
+	auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0 ; i < 8 ; i++) {
+		int x = -1;
+		ASSERT_TRUE(c.read(x));
+		ASSERT_EQ(i, x);
+	}
+
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+	t.join();
+}
+
+TEST(buffered_chan, batch_wake_policy_many_readers) {
+	chan::buffered_chan<int> c(64, chan::wake_policy::batch(4, std::chrono::microseconds(200)));
+
+	std::atomic<long> sum;
+	sum.store(0);
+
+	std::atomic<int> bad;
+	bad.store(0);
+
+	// lingering readers release the lock, so the others, and try_read, can
+	// take the values they were waiting on
+	auto reader = [&](bool nonblocking){
+		while (true) {
+			int x = -1;
+
+			if (nonblocking && c.try_read(x)) {
+				// taken without waiting
+			} else if (!c.read(x)) {
+				break;
+			}
+
+			if (x <= 0) {
+				bad++;
+			}
+
+			sum += x;
+		}
+	};
+
+	std::thread readers[4];
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i] = std::thread(reader, i % 2 == 0);
+	}
+
+	for (int j = 1 ; j <= 2000 ; j++) {
+		c << j;
+
+		if (j % 3 == 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+
+	c.close();
+
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i].join();
+	}
+
+	ASSERT_EQ(0, bad.load());
+	ASSERT_EQ(2000L * 2001 / 2, sum.load());
+}
+
+TEST(buffered_chan, window_wake_policy_close) {
+	chan::buffered_chan<int> c(64, chan::wake_policy::window(std::chrono::seconds(10)));
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		c << 1;
+		c.close();
+	});
+
+	// closing the channel releases a lingering reader
+	auto start = std::chrono::steady_clock::now();
+
+	int x = 0;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+	ASSERT_FALSE(c.read(x));
+
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+	t.join();
+}
+
+TEST(buffered_chan, range) {
+	chan::buffered_chan<int> c(7);
+
+	std::thread t([&](){
+		std::vector<int> vals(1000);
+		for (int i = 0 ; i < 1000 ; i++) {
+			vals[i] = i;
+		}
+
+		c.write_range(vals.data(), 1000);
+		c.close();
+	});
+
+	int buf[16];
+	int expected = 0;
+
+	while (true) {
+		int n = c.read_range(buf, 16);
+		if (n == 0) {
+			break;
+		}
+
+		for (int i = 0 ; i < n ; i++) {
+			ASSERT_EQ(expected, buf[i]);
+			expected++;
+		}
+	}
+
+	ASSERT_EQ(1000, expected);
+
+	t.join();
+}
+
+TEST(basic_chan, engine_selection) {
+	ASSERT_TRUE((std::is_base_of<chan::unbuffered_engine<int>, chan::unbuffered_chan<int>>::value));
+	ASSERT_TRUE((std::is_base_of<chan::buffered_engine<int>, chan::buffered_chan<int>>::value));
+	ASSERT_TRUE((std::is_base_of<chan::static_buffered_engine<int, 8>, chan::basic_chan<int, 8>>::value));
+
+	typedef chan::basic_chan<int, 8, chan::single, chan::single, chan::spinning> spsc;
+	ASSERT_TRUE((std::is_base_of<chan::spinning_engine<int, chan::spsc_ring<int, 8>>, spsc>::value));
+
+	typedef chan::basic_chan<int, chan::dynamic_capacity, chan::multi, chan::single, chan::spinning> mpsc;
+	ASSERT_TRUE((std::is_base_of<chan::spinning_engine<int, chan::mpmc_ring<int, chan::dynamic_capacity>>, mpsc>::value));
+
+	chan::basic_chan<int, 8> fixed;
+	for (int i = 0 ; i < 8 ; i++) {
+		ASSERT_TRUE(fixed.try_write(i));
+	}
+	ASSERT_FALSE(fixed.try_write(8));
+}
+
+TEST(basic_chan, spsc_spinning) {
+	chan::basic_chan<std::string, 16, chan::single, chan::single, chan::spinning> c;
+	const int n = 10000;
+
+	std::thread t([&](){
+		for (int i = 0 ; i < n ; i++) {
+			c << std::to_string(i);
+		}
+
+		c.close();
+	});
+
+	std::string s;
+	int expected = 0;
+	while (c.read(s)) {
+		ASSERT_EQ(std::to_string(expected), s);
+		expected++;
+	}
+
+	t.join();
+
+	ASSERT_EQ(n, expected);
+	ASSERT_THROW(c << std::string("x"), chan::closed_channel_write_exception);
+}
+
+TEST(basic_chan, mpmc_spinning) {
+	chan::basic_chan<int, chan::dynamic_capacity, chan::multi, chan::multi, chan::spinning> c(10);
+	ASSERT_EQ(16u, c.capacity());
+
+	const int n = 5000;
+
+	std::vector<std::thread> writers;
+	for (int w = 0 ; w < 3 ; w++) {
+		writers.push_back(std::thread([&](){
+			for (int i = 1 ; i <= n ; i++) {
+				c << i;
+			}
+		}));
+	}
+
+	std::vector<long long> sums(2, 0);
+	std::vector<std::thread> readers;
+	for (int r = 0 ; r < 2 ; r++) {
+		readers.push_back(std::thread([&, r](){
+			int x = 0;
+			while (c.read(x)) {
+				sums[r] += x;
+			}
+		}));
+	}
+
+	for (auto& t : writers) {
+		t.join();
+	}
+
+	c.close();
+
+	for (auto& t : readers) {
+		t.join();
+	}
+
+	ASSERT_EQ(3LL * n * (n + 1) / 2, sums[0] + sums[1]);
+}
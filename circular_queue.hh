@@ -1,55 +1,122 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
 namespace chan {
 
 /**
  * circular_queue implements a simple fixed size
  * circular buffer supporting FIFO order insertion and deletion.
+ *
+ * The storage is obtained from Allocator, which makes it possible to back
+ * large queues with huge pages or memory local to a NUMA node, see
+ * allocator.hh
  * */
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class circular_queue {
 private:
+	typedef std::allocator_traits<Allocator> traits;
+
 	int capacity;
 	int filled;
 
 	int f;
 	int b;
 
+	Allocator alloc;
 	T* data;
 
+	void allocate() {
+		data = traits::allocate(alloc, capacity);
+		for (int i = 0; i < capacity; i++) {
+			traits::construct(alloc, data + i);
+		}
+	}
+
+	void release() {
+		if (data == nullptr) {
+			return;
+		}
+
+		for (int i = 0; i < capacity; i++) {
+			traits::destroy(alloc, data + i);
+		}
+
+		traits::deallocate(alloc, data, capacity);
+		data = nullptr;
+	}
+
+	/**
+	 * copy_run copies a contiguous run of n values. Trivially copyable
+	 * types are copied with a single memcpy, anything else is copied, or
+	 * moved, element by element.
+	 * */
+	static void copy_run(T* dst, const T* src, int n, std::true_type) {
+		if (n > 0) {
+			memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+		}
+	}
+
+	static void copy_run(T* dst, const T* src, int n, std::false_type) {
+		std::copy(src, src + n, dst);
+	}
+
+	static void move_run(T* dst, T* src, int n, std::true_type) {
+		copy_run(dst, src, n, std::true_type());
+	}
+
+	static void move_run(T* dst, T* src, int n, std::false_type) {
+		std::move(src, src + n, dst);
+	}
+
+	typedef typename std::is_trivially_copyable<T>::type trivial;
+
 public:
-	circular_queue(int capacity)
-	    : capacity(capacity), filled(0), f(0), b(-1) {
-		data = new T[capacity];
+	circular_queue(int capacity, const Allocator& alloc = Allocator())
+	    : capacity(capacity), filled(0), f(0), b(-1), alloc(alloc) {
+		allocate();
 	}
 
-	~circular_queue() { delete[] data; }
+	~circular_queue() { release(); }
 
-	circular_queue(const circular_queue<T>& other) {
+	circular_queue(const circular_queue& other)
+	    : alloc(traits::select_on_container_copy_construction(other.alloc)) {
 		capacity = other.capacity;
 		filled = other.filled;
 		f = other.f;
 		b = other.b;
 
-		data = new T[capacity];
+		allocate();
 		for (int i = 0; i < capacity; i++) {
 			data[i] = other.data[i];
 		}
 	}
 
-	circular_queue& operator=(const circular_queue<T>& other) {
+	circular_queue& operator=(const circular_queue& other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		release();
+
 		capacity = other.capacity;
 		filled = other.filled;
 		f = other.f;
 		b = other.b;
 
-		data = new T[capacity];
+		allocate();
 		for (int i = 0; i < capacity; i++) {
 			data[i] = other.data[i];
 		}
+
+		return *this;
 	}
 
-	circular_queue(circular_queue<T>&& other) {
+	circular_queue(circular_queue&& other) : alloc(std::move(other.alloc)) {
 		capacity = other.capacity;
 		other.capacity = 0;
 
@@ -66,7 +133,14 @@ public:
 		other.data = nullptr;
 	}
 
-	circular_queue& operator=(circular_queue<T>&& other) {
+	circular_queue& operator=(circular_queue&& other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		release();
+		alloc = std::move(other.alloc);
+
 		capacity = other.capacity;
 		other.capacity = 0;
 
@@ -81,6 +155,8 @@ public:
 
 		data = other.data;
 		other.data = nullptr;
+
+		return *this;
 	}
 
 	/**
@@ -88,21 +164,21 @@ public:
 	 *
 	 * @return  bool   true if the queue is empty
 	 * */
-	inline bool empty() { return filled == 0; }
+	inline bool empty() const { return filled == 0; }
 
 	/**
 	 * size counts the number of elements
 	 *
 	 * @return  int   the number of elements in the queue
 	 * */
-	inline int size() { return filled; }
+	inline int size() const { return filled; }
 
 	/**
 	 * full checks if the queue is completely occupied
 	 *
 	 * @return  bool   true if the queue is full
 	 * */
-	inline bool full() { return filled == capacity; }
+	inline bool full() const { return filled == capacity; }
 
 	/**
 	 * push pushes a value to the front of the queue
@@ -125,6 +201,100 @@ public:
 		return true;
 	}
 
+	/**
+	 * push moves a value to the back of the queue
+	 * */
+	bool push(T&& val) {
+		if (filled == capacity) {
+			return false;
+		}
+
+		b = (b + 1) % capacity;
+		data[b] = std::move(val);
+
+		filled++;
+		return true;
+	}
+
+	/**
+	 * push_range pushes as many values from vals as there is space for, in
+	 * order. The values are copied in at most two contiguous runs, one up
+	 * to the end of the buffer and one from its start.
+	 *
+	 * @param   vals   const T*   the values to push
+	 * @param   n      int        the number of values
+	 *
+	 * @return         int        the number of values pushed
+	 * */
+	int push_range(const T* vals, int n) {
+		int count = std::min(n, capacity - filled);
+		if (count <= 0) {
+			return 0;
+		}
+
+		int start = (b + 1) % capacity;
+		int first = std::min(count, capacity - start);
+
+		copy_run(data + start, vals, first, trivial());
+		copy_run(data, vals + first, count - first, trivial());
+
+		b = (start + count - 1) % capacity;
+		filled += count;
+
+		return count;
+	}
+
+	/**
+	 * pop_range removes up to n values from the front of the queue, and
+	 * moves them to out, in at most two contiguous runs.
+	 *
+	 * @param   out   T*    where the values are stored
+	 * @param   n     int   the maximum number of values
+	 *
+	 * @return        int   the number of values removed
+	 * */
+	int pop_range(T* out, int n) {
+		int count = std::min(n, filled);
+		if (count <= 0) {
+			return 0;
+		}
+
+		int first = std::min(count, capacity - f);
+
+		move_run(out, data + f, first, trivial());
+		move_run(out + first, data, count - first, trivial());
+
+		f = (f + count) % capacity;
+		filled -= count;
+
+		return count;
+	}
+
+	/**
+	 * back_run returns the longest contiguous run of free slots after the
+	 * back of the queue, so values can be stored in place and then added
+	 * with commit.
+	 *
+	 * @param   n    int&   set to the length of the run
+	 *
+	 * @return       T*     the first slot of the run
+	 * */
+	T* back_run(int& n) {
+		int start = (b + 1) % capacity;
+		n = std::min(capacity - filled, capacity - start);
+
+		return data + start;
+	}
+
+	/**
+	 * commit adds the first n slots of the run returned by back_run to
+	 * the back of the queue
+	 * */
+	void commit(int n) {
+		b = (b + n) % capacity;
+		filled += n;
+	}
+
 	/**
 	 * front reads and returns the current item at the front of the queue
 	 *
@@ -133,12 +303,30 @@ public:
 	T front() {
 		if (filled == 0) {
 			// TODO: figure out error handling here
-			return T(0);
+			return T();
 		}
 
 		return data[f];
 	}
 
+	/**
+	 * pop moves the item at the front of the queue into valref, and removes
+	 * it from the queue
+	 *
+	 * @return  bool   the result of the operation, true if successful
+	 * */
+	bool pop(T& valref) {
+		if (filled == 0) {
+			return false;
+		}
+
+		valref = std::move(data[f]);
+
+		f = (f + 1) % capacity;
+		filled--;
+		return true;
+	}
+
 	/**
 	 * pop will remove the item at the front from the queue
 	 *
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <string>
+
 #include "circular_queue.hh"
 
 TEST(circular_queue, basic) {
@@ -35,3 +37,68 @@ TEST(circular_queue, basic) {
 	ASSERT_EQ(true, queue.empty());
 	ASSERT_EQ(false, queue.full());
 }
+
+TEST(circular_queue, range) {
+	chan::circular_queue<int> queue(5);
+
+	int in[] = {1, 2, 3, 4, 5, 6, 7};
+	int out[7] = {0};
+
+	// only as many values as there is space for are pushed
+	ASSERT_EQ(5, queue.push_range(in, 7));
+	ASSERT_EQ(true, queue.full());
+
+	ASSERT_EQ(3, queue.pop_range(out, 3));
+	ASSERT_EQ(1, out[0]);
+	ASSERT_EQ(3, out[2]);
+
+	// wraps around the end of the buffer
+	ASSERT_EQ(3, queue.push_range(in + 5, 2) + queue.push_range(in, 1));
+	ASSERT_EQ(5, queue.size());
+
+	ASSERT_EQ(5, queue.pop_range(out, 7));
+	ASSERT_EQ(4, out[0]);
+	ASSERT_EQ(5, out[1]);
+	ASSERT_EQ(6, out[2]);
+	ASSERT_EQ(7, out[3]);
+	ASSERT_EQ(1, out[4]);
+
+	ASSERT_EQ(true, queue.empty());
+	ASSERT_EQ(0, queue.pop_range(out, 7));
+
+	// single element operations still line up with the range ones
+	queue.push(8);
+	ASSERT_EQ(8, queue.front());
+}
+
+TEST(circular_queue, range_non_trivial) {
+	chan::circular_queue<std::string> queue(3);
+
+	std::string in[] = {"a", "b", "c"};
+	std::string out[3];
+
+	ASSERT_EQ(2, queue.push_range(in, 2));
+	ASSERT_EQ(1, queue.pop_range(out, 1));
+	ASSERT_EQ(2, queue.push_range(in + 1, 2));
+
+	ASSERT_EQ(3, queue.pop_range(out, 3));
+	ASSERT_EQ("b", out[0]);
+	ASSERT_EQ("b", out[1]);
+	ASSERT_EQ("c", out[2]);
+}
+
+TEST(circular_queue, move) {
+	chan::circular_queue<std::string> queue(2);
+
+	std::string s(100, 'x');
+	const char* storage = s.data();
+
+	queue.push(std::move(s));
+
+	std::string out;
+	ASSERT_EQ(true, queue.pop(out));
+	ASSERT_EQ(storage, out.data());
+
+	ASSERT_EQ(true, queue.empty());
+	ASSERT_EQ(false, queue.pop(out));
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+#include "chan.hh"
+#include "futex.hh"
+
+namespace chan {
+
+/**
+ * compact_chan is a buffered channel with a small idle footprint, for
+ * programs that keep a channel per connection or per request, and so may
+ * have millions of them, mostly idle.
+ *
+ * Instead of mutexes and condition variables, the state is guarded by a
+ * one word spinlock, and blocked readers and writers park on a futex word
+ * each, so there is no waiter state until someone actually blocks, and
+ * then it lives in the kernel. The ring is allocated on the first write,
+ * and shrink frees it again while the channel is empty. An idle channel
+ * is a handful of words, see misc/compact_chan_memory_test.
+ *
+ * The lock is held only for a few instructions, it is not meant for
+ * heavily contended channels, use buffered_chan for those.
+ *
+ * example usage:
+ *
+ * ```
+ * std::deque<chan::compact_chan<message>> inboxes;
+ * inboxes.emplace_back(16);
+ *
+ * inboxes[i] << m;
+ *
+ * message m;
+ * inboxes[i] >> m;
+ * ```
+ * */
+template <typename T, typename Allocator = std::allocator<T>>
+class compact_chan : public read_chan<T>, public write_chan<T> {
+private:
+	typedef std::allocator_traits<Allocator> traits;
+
+	mutable std::atomic<uint32_t> lock_word;
+
+	// bumped under the lock whenever a parked reader or writer should look
+	// again, they wait for it to change
+	std::atomic<uint32_t> read_seq;
+	std::atomic<uint32_t> write_seq;
+
+	uint32_t capacity;
+	uint32_t head;
+	uint32_t count;
+
+	uint16_t read_wait_count;
+	uint16_t write_wait_count;
+	bool is_closed;
+
+	T* ring;
+	Allocator alloc;
+
+	void lock() const {
+		for (int spins = 0; lock_word.exchange(1, std::memory_order_acquire) != 0; spins++) {
+			if (spins > 16) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void unlock() const {
+		lock_word.store(0, std::memory_order_release);
+	}
+
+	/**
+	 * park releases the lock and waits for seq to change, then takes the
+	 * lock again
+	 * */
+	void park(std::atomic<uint32_t>& seq, uint16_t& wait_count) {
+		wait_count++;
+		uint32_t s = seq.load(std::memory_order_relaxed);
+		unlock();
+
+		futex_wait(&seq, s);
+
+		lock();
+		wait_count--;
+	}
+
+	/**
+	 * signal bumps seq if anyone is parked on it, it must be called with
+	 * the lock held, and returns whether wake has to be called after
+	 * unlocking
+	 * */
+	static bool signal(std::atomic<uint32_t>& seq, uint16_t wait_count) {
+		if (wait_count == 0) {
+			return false;
+		}
+
+		seq.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	template <typename U>
+	void write_with(U&& val) {
+		lock();
+
+		while (!is_closed && count == capacity) {
+			park(write_seq, write_wait_count);
+		}
+
+		if (is_closed) {
+			unlock();
+			throw _closed_channel_write_exception;
+		}
+
+		if (ring == nullptr) {
+			try {
+				ring = traits::allocate(alloc, capacity);
+			} catch (...) {
+				unlock();
+				throw;
+			}
+		}
+
+		T* slot = ring + (head + count) % capacity;
+
+		try {
+			traits::construct(alloc, slot, std::forward<U>(val));
+		} catch (...) {
+			unlock();
+			throw;
+		}
+
+		count++;
+
+		bool wake = signal(read_seq, read_wait_count);
+		unlock();
+
+		if (wake) {
+			futex_wake(&read_seq, 1);
+		}
+	}
+
+public:
+	/**
+	 * @param   capacity   uint32_t    the maximum number of values in the channel
+	 * @param   alloc      Allocator   allocates the ring
+	 * */
+	explicit compact_chan(uint32_t capacity, const Allocator& alloc = Allocator())
+	    : lock_word(0),
+	      read_seq(0),
+	      write_seq(0),
+	      capacity(capacity),
+	      head(0),
+	      count(0),
+	      read_wait_count(0),
+	      write_wait_count(0),
+	      is_closed(false),
+	      ring(nullptr),
+	      alloc(alloc) {
+		if (capacity == 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+	}
+
+	~compact_chan() {
+		if (ring == nullptr) {
+			return;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			traits::destroy(alloc, ring + (head + i) % capacity);
+		}
+
+		traits::deallocate(alloc, ring, capacity);
+	}
+
+	compact_chan(const compact_chan& other) = delete;
+	compact_chan& operator=(const compact_chan& other) = delete;
+
+	/**
+	 * size returns the number of values in the channel
+	 * */
+	uint32_t size() const {
+		lock();
+		uint32_t result = count;
+		unlock();
+
+		return result;
+	}
+
+	/**
+	 * allocated checks if the channel currently holds a ring
+	 * */
+	bool allocated() const {
+		lock();
+		bool result = ring != nullptr;
+		unlock();
+
+		return result;
+	}
+
+	/**
+	 * shrink frees the ring if the channel is empty, it is allocated again
+	 * by the next write
+	 *
+	 *
+	 * @return   bool   true if the ring was freed
+	 * */
+	bool shrink() {
+		lock();
+
+		if (ring == nullptr || count != 0) {
+			unlock();
+			return false;
+		}
+
+		T* old = ring;
+		ring = nullptr;
+		head = 0;
+
+		unlock();
+
+		traits::deallocate(alloc, old, capacity);
+		return true;
+	}
+
+	bool close() {
+		lock();
+
+		if (is_closed) {
+			unlock();
+			throw _channel_closed_exception;
+		}
+
+		is_closed = true;
+
+		bool wake_readers = signal(read_seq, read_wait_count);
+		bool wake_writers = signal(write_seq, write_wait_count);
+		unlock();
+
+		if (wake_readers) {
+			futex_wake(&read_seq);
+		}
+
+		if (wake_writers) {
+			futex_wake(&write_seq);
+		}
+
+		return true;
+	}
+
+	bool isClosed() const {
+		lock();
+		bool result = is_closed;
+		unlock();
+
+		return result;
+	}
+
+	/**
+	 * write adds a value, allocating the ring if this is the first write
+	 * since it was created or shrunk, and blocks while the channel is full
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 * */
+	void write(const T& val) {
+		write_with(val);
+	}
+
+	void write(T&& val) {
+		write_with(std::move(val));
+	}
+
+	/**
+	 * read removes the oldest value, blocking while the channel is empty
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value in the front
+	 *
+	 * @return           bool  the result of this mission
+	 * */
+	bool read(T& valref) {
+		lock();
+
+		while (count == 0) {
+			if (is_closed) {
+				unlock();
+				valref = T();
+				return false;
+			}
+
+			park(read_seq, read_wait_count);
+		}
+
+		T* slot = ring + head;
+
+		try {
+			valref = std::move(*slot);
+		} catch (...) {
+			unlock();
+			throw;
+		}
+
+		traits::destroy(alloc, slot);
+
+		head = (head + 1) % capacity;
+		count--;
+
+		bool wake = signal(write_seq, write_wait_count);
+		unlock();
+
+		if (wake) {
+			futex_wake(&write_seq, 1);
+		}
+
+		return true;
+	}
+};
+
+}  // namespace chan
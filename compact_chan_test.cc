@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compact_chan.hh"
+
+TEST(compact_chan, lazy_ring) {
+	chan::compact_chan<std::string> c(4);
+
+	ASSERT_FALSE(c.allocated());
+	ASSERT_FALSE(c.shrink());
+
+	c << std::string("hello");
+	ASSERT_TRUE(c.allocated());
+
+	// the ring is only freed when empty
+	ASSERT_FALSE(c.shrink());
+
+	std::string s;
+	c >> s;
+	ASSERT_EQ("hello", s);
+
+	ASSERT_TRUE(c.shrink());
+	ASSERT_FALSE(c.allocated());
+
+	c << std::string("again");
+	c >> s;
+	ASSERT_EQ("again", s);
+}
+
+TEST(compact_chan, blocking) {
+	chan::compact_chan<int> c(2);
+	const int n = 10000;
+
+	std::vector<std::thread> writers;
+	for (int w = 0 ; w < 2 ; w++) {
+		writers.push_back(std::thread([&](){
+			for (int i = 1 ; i <= n ; i++) {
+				c << i;
+			}
+		}));
+	}
+
+	std::vector<std::thread> readers;
+	std::vector<long long> sums(2, 0);
+	for (int r = 0 ; r < 2 ; r++) {
+		readers.push_back(std::thread([&, r](){
+			int x = 0;
+			while (c.read(x)) {
+				sums[r] += x;
+			}
+		}));
+	}
+
+	for (auto& t : writers) {
+		t.join();
+	}
+
+	c.close();
+
+	for (auto& t : readers) {
+		t.join();
+	}
+
+	ASSERT_EQ(2LL * n * (n + 1) / 2, sums[0] + sums[1]);
+}
+
+TEST(compact_chan, close) {
+	chan::compact_chan<std::string> c(1);
+
+	c << std::string("first");
+
+	std::thread writer([&](){
+		ASSERT_THROW(c << std::string("second"), chan::closed_channel_write_exception);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	c.close();
+	writer.join();
+
+	std::string s;
+	ASSERT_TRUE(c.read(s));
+	ASSERT_EQ("first", s);
+	ASSERT_FALSE(c.read(s));
+	ASSERT_TRUE(c.isClosed());
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+#include "chan.hh"
+#include "futex.hh"
+
+namespace chan {
+
+/**
+ * conflating_chan holds only the latest value written to it, for state
+ * like configuration or prices, where consumers only care about the
+ * newest value and intermediate updates can be skipped.
+ *
+ * A write replaces the pending value and never blocks, and every write
+ * gets a new version number, starting at 1. The value is published
+ * through a seqlock, so readers never block writers, and a reader that
+ * races with a write retries instead of seeing a torn value. For this T
+ * must be trivially copyable.
+ *
+ * There are 2 ways to read:
+ *
+ * - load and wait_next return the latest value and its version, without
+ * consuming it, so any number of readers can follow the same stream of
+ * versions.
+ *
+ * - read, from read_chan, consumes the latest value, it blocks until a
+ * version that no reader has read yet is available.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::conflating_chan<quote> prices;
+ *
+ * // publisher
+ * prices << q;
+ *
+ * // subscriber
+ * quote q;
+ * uint64_t version = 0;
+ * while ((version = prices.wait_next(q, version)) != 0) { ... }
+ * ```
+ * */
+template <typename T>
+class conflating_chan : public read_chan<T>, public write_chan<T> {
+	static_assert(std::is_trivially_copyable<T>::value, "conflating_chan requires a trivially copyable type");
+
+private:
+	static const size_t words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	// odd while a write is in progress, the version is seq / 2
+	alignas(64) std::atomic<uint64_t> seq;
+	std::atomic<uint64_t> value[words];
+
+	// serializes writers, readers never take it
+	std::mutex write_mutex;
+
+	// the last version consumed through read
+	alignas(64) std::atomic<uint64_t> taken;
+
+	std::atomic<uint32_t> wake_seq;
+	std::atomic<uint32_t> waiters;
+	std::atomic<bool> closed;
+
+	void wake() {
+		if (waiters.load() > 0) {
+			wake_seq.fetch_add(1);
+			futex_wake(&wake_seq);
+		}
+	}
+
+public:
+	conflating_chan() : seq(0), taken(0), wake_seq(0), waiters(0), closed(false) {
+		for (size_t i = 0; i < words; i++) {
+			value[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	conflating_chan(const conflating_chan& other) = delete;
+	conflating_chan& operator=(const conflating_chan& other) = delete;
+
+	bool close() {
+		if (closed.exchange(true)) {
+			throw _channel_closed_exception;
+		}
+
+		wake_seq.fetch_add(1);
+		futex_wake(&wake_seq);
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return closed.load();
+	}
+
+	/**
+	 * version returns the version of the latest value, 0 if nothing was
+	 * written yet
+	 * */
+	uint64_t version() const {
+		return seq.load(std::memory_order_acquire) / 2;
+	}
+
+	/**
+	 * write replaces the current value, without waiting for readers
+	 *
+	 *
+	 * @param   val   const T&   the new value
+	 * */
+	void write(const T& val) {
+		uint64_t buf[words] = {0};
+		memcpy(buf, &val, sizeof(T));
+
+		std::unique_lock<std::mutex> write_lock(write_mutex);
+
+		if (closed.load()) {
+			throw _closed_channel_write_exception;
+		}
+
+		uint64_t s = seq.load(std::memory_order_relaxed);
+
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < words; i++) {
+			value[i].store(buf[i], std::memory_order_relaxed);
+		}
+
+		seq.store(s + 2);
+		write_lock.unlock();
+
+		wake();
+	}
+
+	/**
+	 * load copies the latest value, without blocking
+	 *
+	 *
+	 * @param   valref   T&         assigned the latest value, if there is one
+	 *
+	 * @return           uint64_t   the version of the value, 0 if nothing was
+	 *                              written yet
+	 * */
+	uint64_t load(T& valref) const {
+		uint64_t buf[words];
+
+		while (true) {
+			uint64_t before = seq.load(std::memory_order_acquire);
+
+			if (before == 0) {
+				return 0;
+			}
+
+			if (before % 2 == 1) {
+				continue;
+			}
+
+			for (size_t i = 0; i < words; i++) {
+				buf[i] = value[i].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (seq.load(std::memory_order_relaxed) == before) {
+				memcpy(&valref, buf, sizeof(T));
+				return before / 2;
+			}
+		}
+	}
+
+	/**
+	 * wait_next blocks until there is a version newer than seen, and copies
+	 * its value. Versions written in between are skipped.
+	 *
+	 *
+	 * @param   valref   T&         assigned the latest value
+	 * @param   seen     uint64_t   the last version seen by the caller
+	 *
+	 * @return           uint64_t   the version of the value, 0 if the channel
+	 *                              was closed before a newer one was written
+	 * */
+	uint64_t wait_next(T& valref, uint64_t seen) {
+		while (true) {
+			uint32_t w = wake_seq.load();
+
+			uint64_t v = load(valref);
+			if (v > seen) {
+				return v;
+			}
+
+			if (closed.load()) {
+				return 0;
+			}
+
+			waiters.fetch_add(1);
+
+			if (version() <= seen && !closed.load()) {
+				futex_wait(&wake_seq, w);
+			}
+
+			waiters.fetch_sub(1);
+		}
+	}
+
+	/**
+	 * read consumes the latest value, blocking until there is a version
+	 * that no reader has read yet. Once the channel is closed, the pending
+	 * value, if any, is still returned before read starts returning false.
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value
+	 *
+	 * @return           bool  the result of this mission
+	 * */
+	bool read(T& valref) {
+		uint64_t last = taken.load();
+
+		while (true) {
+			uint64_t v = load(valref);
+
+			if (v > last) {
+				if (taken.compare_exchange_weak(last, v)) {
+					return true;
+				}
+
+				continue;
+			}
+
+			if (wait_next(valref, last) == 0) {
+				// a value may have been written right before closing
+				if (version() > taken.load()) {
+					last = taken.load();
+					continue;
+				}
+
+				valref = T();
+				return false;
+			}
+
+			last = taken.load();
+		}
+	}
+};
+
+}  // namespace chan
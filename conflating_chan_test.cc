@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "conflating_chan.hh"
+
+struct snapshot {
+	uint64_t a;
+	uint64_t b;
+	uint64_t c;
+};
+
+TEST(conflating_chan, latest_value) {
+	chan::conflating_chan<int> c;
+
+	int x = -1;
+	ASSERT_EQ(0u, c.load(x));
+	ASSERT_EQ(-1, x);
+
+	// writes never block, and overwrite the pending value
+	for (int i = 1 ; i <= 1000 ; i++) {
+		c << i;
+	}
+
+	ASSERT_EQ(1000u, c.load(x));
+	ASSERT_EQ(1000, x);
+
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1000, x);
+
+	// loading doesn't consume
+	ASSERT_EQ(1000u, c.version());
+	ASSERT_EQ(1000u, c.load(x));
+}
+
+TEST(conflating_chan, read_consumes) {
+	chan::conflating_chan<int> c;
+
+	c << 1;
+
+	int x = 0;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		c << 2;
+		c << 3;
+		c.close();
+	});
+
+	// blocks until there is a new version, and the pending value is still
+	// read after closing
+	ASSERT_TRUE(c.read(x));
+	ASSERT_TRUE(x == 2 || x == 3);
+
+	if (x == 2) {
+		ASSERT_TRUE(c.read(x));
+		ASSERT_EQ(3, x);
+	}
+
+	ASSERT_FALSE(c.read(x));
+
+	t.join();
+}
+
+TEST(conflating_chan, wait_next) {
+	chan::conflating_chan<int> c;
+
+	std::thread t([&](){
+		for (int i = 1 ; i <= 100 ; i++) {
+			c << i;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		c.close();
+	});
+
+	int x = 0;
+	int last = 0;
+	uint64_t version = 0;
+
+	while ((version = c.wait_next(x, version)) != 0) {
+		// versions and values only move forward
+		ASSERT_GT(x, last);
+		ASSERT_EQ(static_cast<uint64_t>(x), version);
+		last = x;
+	}
+
+	ASSERT_EQ(100, last);
+
+	t.join();
+}
+
+TEST(conflating_chan, no_torn_reads) {
+	chan::conflating_chan<snapshot> c;
+
+	std::atomic<bool> done;
+	done.store(false);
+
+	std::thread writers[2];
+	for (int w = 0 ; w < 2 ; w++) {
+		writers[w] = std::thread([&](){
+			for (uint64_t i = 1 ; i <= 100000 ; i++) {
+				snapshot s = {i, i * 2, i * 3};
+				c << s;
+			}
+		});
+	}
+
+	std::thread reader([&](){
+		snapshot s;
+		while (!done.load()) {
+			if (c.load(s) != 0) {
+				ASSERT_EQ(s.a * 2, s.b);
+				ASSERT_EQ(s.a * 3, s.c);
+			}
+		}
+	});
+
+	for (int w = 0 ; w < 2 ; w++) {
+		writers[w].join();
+	}
+
+	done.store(true);
+	reader.join();
+
+	ASSERT_EQ(200000u, c.version());
+}
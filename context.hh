@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+
+namespace chan {
+
+struct context_cancelled_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "the operation was cancelled by its context";
+	}
+} _context_cancelled_exception;
+
+struct context_deadline_exceeded_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "the deadline of the operation's context has passed";
+	}
+} _context_deadline_exceeded_exception;
+
+class context;
+
+/**
+ * context_listener is a callback registered with a context, invoked once
+ * when the context is cancelled. Listeners are intrusive and doubly
+ * linked into the context, so registering and removing one is constant
+ * time and never allocates.
+ * */
+class context_listener {
+	friend class context;
+
+private:
+	context_listener* next;
+	context_listener** pprev;
+
+public:
+	context_listener() : next(nullptr), pprev(nullptr) {}
+	virtual ~context_listener() {}
+
+	/**
+	 * on_cancel is invoked on the cancelling thread, with the context
+	 * locked. Implementations must not block and must not call back into
+	 * the context.
+	 * */
+	virtual void on_cancel() = 0;
+};
+
+/**
+ * context carries a cancellation signal and an optional deadline to
+ * blocking channel operations, across any number of channels.
+ *
+ * Cancelling a context wakes up exactly the operations blocked under it,
+ * and its descendants, in time proportional to their number. Waiters on
+ * the same channels under other contexts are not disturbed.
+ *
+ * Contexts form a tree. A child is cancelled along with its parent, and
+ * its deadline is never later than the parent's. A parent must outlive
+ * its children.
+ *
+ * Operations that are cancelled throw context_cancelled_exception, and
+ * operations that are still blocked at the deadline throw
+ * context_deadline_exceeded_exception.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::context request;
+ *
+ * std::thread t([&](){
+ * 	chan::context step(request, std::chrono::milliseconds(100));
+ *
+ * 	int x = 0;
+ * 	c.read(x, step);
+ * });
+ *
+ * // on disconnect
+ * request.cancel();
+ * ```
+ * */
+class context : private context_listener {
+public:
+	typedef std::chrono::steady_clock clock;
+
+private:
+	context* parent;
+
+	mutable std::mutex mutex;
+	std::atomic<bool> is_cancelled;
+	context_listener* listeners;
+
+	bool has_deadline;
+	clock::time_point expires;
+
+	void attach() {
+		if (parent == nullptr) {
+			return;
+		}
+
+		if (parent->has_deadline && (!has_deadline || parent->expires < expires)) {
+			has_deadline = true;
+			expires = parent->expires;
+		}
+
+		if (!parent->add(this)) {
+			is_cancelled.store(true);
+		}
+	}
+
+	void on_cancel() {
+		cancel();
+	}
+
+public:
+	/**
+	 * This constructor creates a root context, without a deadline
+	 * */
+	context()
+	    : parent(nullptr), is_cancelled(false), listeners(nullptr), has_deadline(false) {}
+
+	/**
+	 * This constructor creates a child of parent, that is cancelled along
+	 * with it
+	 * */
+	explicit context(context& parent)
+	    : parent(&parent), is_cancelled(false), listeners(nullptr), has_deadline(false) {
+		attach();
+	}
+
+	/**
+	 * This constructor creates a child of parent, that also expires at
+	 * deadline
+	 * */
+	context(context& parent, clock::time_point deadline)
+	    : parent(&parent), is_cancelled(false), listeners(nullptr), has_deadline(true), expires(deadline) {
+		attach();
+	}
+
+	/**
+	 * This constructor creates a child of parent, that also expires after
+	 * timeout
+	 * */
+	template <typename Rep, typename Period>
+	context(context& parent, std::chrono::duration<Rep, Period> timeout)
+	    : parent(&parent),
+	      is_cancelled(false),
+	      listeners(nullptr),
+	      has_deadline(true),
+	      expires(clock::now() + std::chrono::duration_cast<clock::duration>(timeout)) {
+		attach();
+	}
+
+	~context() {
+		if (parent != nullptr) {
+			parent->remove(this);
+		}
+	}
+
+	context(const context& other) = delete;
+	context& operator=(const context& other) = delete;
+
+	/**
+	 * cancel cancels this context and all of its descendants, waking up
+	 * every operation blocked under them. Cancelling a cancelled context
+	 * does nothing.
+	 * */
+	void cancel() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (is_cancelled.exchange(true)) {
+			return;
+		}
+
+		while (listeners != nullptr) {
+			context_listener* listener = listeners;
+
+			listeners = listener->next;
+			if (listeners != nullptr) {
+				listeners->pprev = &listeners;
+			}
+
+			listener->next = nullptr;
+			listener->pprev = nullptr;
+
+			listener->on_cancel();
+		}
+	}
+
+	bool cancelled() const {
+		return is_cancelled.load();
+	}
+
+	bool expired() const {
+		return has_deadline && clock::now() >= expires;
+	}
+
+	/**
+	 * done returns whether operations under this context should stop,
+	 * because it was cancelled or its deadline has passed
+	 * */
+	bool done() const {
+		return cancelled() || expired();
+	}
+
+	/**
+	 * deadline returns the time point at which this context expires, or
+	 * clock::time_point::max() if it has no deadline
+	 * */
+	clock::time_point deadline() const {
+		return has_deadline ? expires : clock::time_point::max();
+	}
+
+	/**
+	 * check throws the exception corresponding to the state of the context
+	 * if it is done, and does nothing otherwise
+	 * */
+	void check() const {
+		if (cancelled()) {
+			throw _context_cancelled_exception;
+		}
+
+		if (expired()) {
+			throw _context_deadline_exceeded_exception;
+		}
+	}
+
+	/**
+	 * add registers a listener to be invoked when this context is
+	 * cancelled. If it already was, the listener is not registered and
+	 * false is returned.
+	 * */
+	bool add(context_listener* listener) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (is_cancelled.load()) {
+			return false;
+		}
+
+		listener->next = listeners;
+		listener->pprev = &listeners;
+
+		if (listeners != nullptr) {
+			listeners->pprev = &listener->next;
+		}
+
+		listeners = listener;
+		return true;
+	}
+
+	/**
+	 * remove unregisters a listener, if it is still registered. Once it
+	 * returns the listener will not be invoked, and can be destroyed.
+	 * */
+	void remove(context_listener* listener) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (listener->pprev == nullptr) {
+			return;
+		}
+
+		*listener->pprev = listener->next;
+		if (listener->next != nullptr) {
+			listener->next->pprev = listener->pprev;
+		}
+
+		listener->next = nullptr;
+		listener->pprev = nullptr;
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "chan.hh"
+
+TEST(context, cancel_unbuffered_write) {
+	chan::unbuffered_chan<int> c;
+	chan::context ctx;
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		ctx.cancel();
+	});
+
+	ASSERT_THROW(c.write(1, ctx), chan::context_cancelled_exception);
+	t.join();
+
+	// the cancelled value was taken back, and the channel is still usable
+	std::thread w([&](){
+		c << 2;
+	});
+
+	int x = 0;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(2, x);
+
+	w.join();
+}
+
+TEST(context, cancel_waiting_for_turn) {
+	chan::unbuffered_chan<int> c;
+	chan::context first;
+	chan::context second;
+
+	std::atomic<bool> second_cancelled;
+	second_cancelled.store(false);
+
+	std::thread a([&](){
+		c.write(1, first);
+	});
+
+	std::thread b([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		try {
+			c.write(2, second);
+		} catch (chan::context_cancelled_exception&) {
+			second_cancelled.store(true);
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	second.cancel();
+	b.join();
+
+	ASSERT_TRUE(second_cancelled.load());
+
+	// the writer that is not cancelled is still blocked, and delivers
+	int x = 0;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+
+	a.join();
+}
+
+TEST(context, cancel_only_wakes_own_waiters) {
+	chan::buffered_chan<int> c(4);
+	chan::context cancelled;
+	chan::context other;
+
+	std::atomic<int> errors;
+	errors.store(0);
+
+	std::thread readers[4];
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i] = std::thread([&](){
+			int x = 0;
+
+			try {
+				c.read(x, cancelled);
+			} catch (chan::context_cancelled_exception&) {
+				errors++;
+			}
+		});
+	}
+
+	int y = 0;
+	std::thread survivor([&](){
+		c.read(y, other);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	cancelled.cancel();
+
+	for (int i = 0 ; i < 4 ; i++) {
+		readers[i].join();
+	}
+
+	ASSERT_EQ(4, errors.load());
+
+	c << 42;
+	survivor.join();
+
+	ASSERT_EQ(42, y);
+}
+
+TEST(context, hierarchy) {
+	chan::context root;
+	chan::context request(root);
+	chan::context step(request);
+
+	chan::buffered_chan<int> a(1);
+	chan::unbuffered_chan<int> b;
+
+	std::atomic<int> errors;
+	errors.store(0);
+
+	std::thread t1([&](){
+		int x = 0;
+
+		try {
+			a.read(x, step);
+		} catch (chan::context_cancelled_exception&) {
+			errors++;
+		}
+	});
+
+	std::thread t2([&](){
+		try {
+			b.write(1, request);
+		} catch (chan::context_cancelled_exception&) {
+			errors++;
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	root.cancel();
+
+	t1.join();
+	t2.join();
+
+	ASSERT_EQ(2, errors.load());
+	ASSERT_TRUE(step.cancelled());
+
+	// children of a cancelled context start out cancelled
+	chan::context late(root);
+	ASSERT_TRUE(late.cancelled());
+}
+
+TEST(context, deadline) {
+	chan::context root;
+	chan::context parent(root, std::chrono::milliseconds(20));
+	chan::context child(parent, std::chrono::seconds(10));
+
+	// the child can't outlive the parent's deadline
+	ASSERT_EQ(parent.deadline(), child.deadline());
+
+	chan::buffered_chan<int> c(1);
+
+	auto start = std::chrono::steady_clock::now();
+
+	int x = 0;
+	ASSERT_THROW(c.read(x, child), chan::context_deadline_exceeded_exception);
+	ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+	ASSERT_FALSE(child.cancelled());
+	ASSERT_TRUE(child.done());
+}
+
+TEST(context, done_before_operation) {
+	chan::buffered_chan<int> c(1);
+	c << 1;
+
+	chan::context ctx;
+	ctx.cancel();
+
+	int x = 0;
+	ASSERT_THROW(c.read(x, ctx), chan::context_cancelled_exception);
+
+	// the value is still there
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+}
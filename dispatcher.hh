@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "chan.hh"
+
+namespace chan {
+
+/**
+ * dispatcher spreads writes over a set of buffered channels, typically one
+ * per worker, sending each value to a channel with a reader waiting on it,
+ * or else to the one with the most free space. A worker that stalls stops
+ * getting new values, instead of backing up like it would with round
+ * robin.
+ *
+ * Each write compares two channels picked at random, the power of two
+ * choices, so it stays O(1) in the number of channels while still nearly
+ * balancing them. If both are full, the other channels are tried, and
+ * a write only blocks when all of them are full.
+ *
+ * The dispatcher sets the on_writable hook of its channels, and clears it
+ * when destroyed. The constructor throws buffered_chan_hook_taken_exception
+ * if one of them has a hook already.
+ *
+ * example usage:
+ *
+ * ```
+ * std::vector<chan::buffered_chan<job>*> queues = ...;
+ * chan::dispatcher<job> d(queues);
+ *
+ * d << j;
+ *
+ * // once done
+ * d.close();
+ * ```
+ * */
+template <typename T>
+class dispatcher : public write_chan<T> {
+private:
+	std::vector<buffered_chan<T>*> targets;
+
+	// incremented whenever a target gets room, waiting writers recheck
+	// the targets when it changes
+	std::atomic<uint64_t> epoch;
+	std::atomic<int> waiting;
+
+	std::mutex mutex;
+	std::condition_variable space_available;
+
+	std::atomic<bool> is_closed;
+
+	void writable() {
+		epoch.fetch_add(1);
+
+		if (waiting.load() > 0) {
+			std::unique_lock<std::mutex> lock(mutex);
+			space_available.notify_all();
+		}
+	}
+
+	/**
+	 * next returns a random number from a per thread xorshift generator
+	 * */
+	static uint32_t next() {
+		static thread_local uint32_t state = 0;
+
+		if (state == 0) {
+			state = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state)) | 1;
+		}
+
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		return state;
+	}
+
+	/**
+	 * choose returns the index of the more ready target out of two random
+	 * ones
+	 * */
+	size_t choose() const {
+		size_t n = targets.size();
+
+		size_t a = next() % n;
+		if (n == 1) {
+			return a;
+		}
+
+		size_t b = (a + 1 + next() % (n - 1)) % n;
+
+		// a waiting reader is better than free space, a worker that is busy
+		// with a slow value has an empty buffer too
+		int ra = targets[a]->readers_waiting();
+		int rb = targets[b]->readers_waiting();
+
+		if (ra != rb) {
+			return rb > ra ? b : a;
+		}
+
+		return targets[b]->space() > targets[a]->space() ? b : a;
+	}
+
+	template <typename U>
+	bool try_send(size_t first, const U& val) {
+		if (targets[first]->try_write(val)) {
+			return true;
+		}
+
+		for (size_t i = 1; i < targets.size(); i++) {
+			if (targets[(first + i) % targets.size()]->try_write(val)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+public:
+	/**
+	 * @param   targets   const std::vector<buffered_chan<T>*>&   the channels to write to
+	 * */
+	explicit dispatcher(const std::vector<buffered_chan<T>*>& targets)
+	    : targets(targets), epoch(0), waiting(0), is_closed(false) {
+		if (targets.empty()) {
+			throw _buffered_chan_zero_size_exception;
+		}
+
+		for (size_t i = 0; i < targets.size(); i++) {
+			try {
+				targets[i]->on_writable([this]() { writable(); });
+			} catch (buffered_chan_hook_taken_exception&) {
+				for (size_t j = 0; j < i; j++) {
+					targets[j]->on_writable(nullptr);
+				}
+
+				throw;
+			}
+		}
+	}
+
+	~dispatcher() {
+		for (size_t i = 0; i < targets.size(); i++) {
+			targets[i]->on_writable(nullptr);
+		}
+	}
+
+	dispatcher(const dispatcher& other) = delete;
+	dispatcher& operator=(const dispatcher& other) = delete;
+
+	size_t size() const {
+		return targets.size();
+	}
+
+	/**
+	 * depths returns the number of values waiting in each target
+	 * */
+	std::vector<int> depths() const {
+		std::vector<int> result(targets.size());
+
+		for (size_t i = 0; i < targets.size(); i++) {
+			result[i] = targets[i]->size();
+		}
+
+		return result;
+	}
+
+	/**
+	 * close closes all the targets, and wakes up blocked writers
+	 * */
+	bool close() {
+		if (is_closed.exchange(true)) {
+			throw _channel_closed_exception;
+		}
+
+		for (size_t i = 0; i < targets.size(); i++) {
+			if (!targets[i]->isClosed()) {
+				targets[i]->close();
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		space_available.notify_all();
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return is_closed.load();
+	}
+
+	/**
+	 * write sends the value to the less loaded of two random targets,
+	 * falling back to any target with room, and blocks while all of them
+	 * are full
+	 *
+	 *
+	 * @param   val   const T&   the value to send
+	 * */
+	void write(const T& val) {
+		while (true) {
+			if (is_closed.load()) {
+				throw _closed_channel_write_exception;
+			}
+
+			uint64_t seen = epoch.load();
+
+			if (try_send(choose(), val)) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+
+			waiting.fetch_add(1);
+			while (epoch.load() == seen && !is_closed.load()) {
+				space_available.wait(lock);
+			}
+			waiting.fetch_sub(1);
+		}
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "dispatcher.hh"
+
+TEST(dispatcher, avoids_stalled_target) {
+	std::vector<std::unique_ptr<chan::buffered_chan<int>>> queues;
+	std::vector<chan::buffered_chan<int>*> targets;
+
+	for (int i = 0 ; i < 4 ; i++) {
+		queues.push_back(std::unique_ptr<chan::buffered_chan<int>>(new chan::buffered_chan<int>(8)));
+		targets.push_back(queues.back().get());
+	}
+
+	chan::dispatcher<int> d(targets);
+
+	// target 0 is never read, the others are drained
+	std::vector<std::thread> workers;
+	std::vector<int> counts(4, 0);
+	for (int i = 1 ; i < 4 ; i++) {
+		workers.push_back(std::thread([&, i](){
+			int x = 0;
+			while (targets[i]->read(x)) {
+				counts[i]++;
+			}
+		}));
+	}
+
+	for (int i = 0 ; i < 1000 ; i++) {
+		d << i;
+	}
+
+	ASSERT_EQ(8, d.depths()[0]);
+
+	d.close();
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	ASSERT_EQ(1000 - 8, counts[1] + counts[2] + counts[3]);
+}
+
+TEST(dispatcher, blocks_when_all_full) {
+	chan::buffered_chan<int> a(1), b(1);
+	chan::dispatcher<int> d(std::vector<chan::buffered_chan<int>*>{&a, &b});
+
+	d << 1;
+	d << 2;
+
+	std::vector<int> depths = d.depths();
+	ASSERT_EQ(1, depths[0]);
+	ASSERT_EQ(1, depths[1]);
+
+	std::atomic<bool> written(false);
+	std::thread writer([&](){
+		d << 3;
+		written = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_FALSE(written);
+
+	int x = 0;
+	b >> x;
+
+	writer.join();
+	ASSERT_TRUE(written);
+	ASSERT_EQ(1, b.size());
+}
+
+TEST(dispatcher, close_wakes_writers) {
+	chan::buffered_chan<int> a(1);
+	chan::dispatcher<int> d(std::vector<chan::buffered_chan<int>*>{&a});
+
+	d << 1;
+
+	std::atomic<bool> thrown(false);
+	std::thread writer([&](){
+		try {
+			d << 2;
+		} catch (chan::closed_channel_write_exception&) {
+			thrown = true;
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	d.close();
+	writer.join();
+
+	ASSERT_TRUE(thrown);
+	ASSERT_TRUE(a.isClosed());
+}
+
+TEST(dispatcher, shared_target) {
+	chan::buffered_chan<int> a(1), b(1);
+	chan::dispatcher<int> d(std::vector<chan::buffered_chan<int>*>{&a});
+
+	// b is not left with a hook of the dispatcher that failed
+	ASSERT_THROW(
+	    chan::dispatcher<int>(std::vector<chan::buffered_chan<int>*>{&b, &a}),
+	    chan::buffered_chan_hook_taken_exception);
+
+	chan::dispatcher<int> e(std::vector<chan::buffered_chan<int>*>{&b});
+
+	d << 1;
+	e << 2;
+
+	int x = 0;
+	ASSERT_TRUE(a.read(x));
+	ASSERT_EQ(1, x);
+	ASSERT_TRUE(b.read(x));
+	ASSERT_EQ(2, x);
+}
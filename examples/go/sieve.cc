@@ -1,41 +1,36 @@
-#include <memory>
 #include <thread>
 
-#include "../../chan.hh"
+#include "../../sender.hh"
 
-void generate(std::weak_ptr<chan::unbuffered_chan<int>> ch) {
+void generate(chan::sender<int> out) {
 	for (int i = 2 ; ; i++) {
-		ch.lock()->send(i);
+		out.send(i);
 	}
 }
 
-void filter(
-	std::weak_ptr<chan::unbuffered_chan<int>> in,
-	std::weak_ptr<chan::unbuffered_chan<int>> out,
-	int prime
-) {
-	for (int i = 0 ; ; i++) {
-		int x = 0;
-		in.lock()->recv(x);
-
+void filter(chan::receiver<int> in, chan::sender<int> out, int prime) {
+	int x = 0;
+	while (in.recv(x)) {
 		if (x % prime != 0) {
-			out.lock()->send(x);
+			out.send(x);
 		}
 	}
 }
 
 int main() {
-	auto ch = std::make_shared<chan::unbuffered_chan<int>>();
-	std::thread(generate, ch).detach();
+	auto ch = chan::make_chan<int>();
+	std::thread(generate, std::move(ch.first)).detach();
+
+	chan::receiver<int> in = std::move(ch.second);
 
 	for (int i = 0 ; i < 10 ; i++) {
 		int prime = 0;
-		ch->recv(prime);
+		in.recv(prime);
 		printf("%d\n", prime);
 
-		auto ch1 = std::make_shared<chan::unbuffered_chan<int>>();
-		std::thread(filter, ch, ch1, prime).detach();
+		auto ch1 = chan::make_chan<int>();
+		std::thread(filter, std::move(in), std::move(ch1.first), prime).detach();
 
-		ch = ch1;
+		in = std::move(ch1.second);
 	}
 }
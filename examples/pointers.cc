@@ -1,31 +1,29 @@
-#include <memory>
 #include <thread>
 
-#include "../chan.hh"
+#include "../sender.hh"
 
-void producer(std::weak_ptr<chan::unbuffered_chan<int>> ch) {
-	for (int i = 2 ; ; i++) {
+void producer(chan::sender<int> ch) {
+	for (int i = 2 ; i < 20 ; i++) {
 		printf("w %d\n", i);
-		ch.lock()->send(i);
+		ch.send(i);
 	}
+
+	// the channel is closed once the last sender is gone
 }
 
-void consumer(std::weak_ptr<chan::unbuffered_chan<int>> ch) {
-	for (int i = 0 ; ; i++) {
-		int x = 0;
-		ch.lock()->recv(x);
+void consumer(chan::receiver<int> ch) {
+	int x = 0;
+	while (ch.recv(x)) {
 		printf("r %d\n", x);
 	}
 }
 
 int main() {
-	auto ch = std::make_shared<chan::unbuffered_chan<int>>();
-
-	std::thread t1(producer, ch);
-	std::thread t2(consumer, ch);
+	auto ch = chan::make_chan<int>();
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::thread t1(producer, std::move(ch.first));
+	std::thread t2(consumer, std::move(ch.second));
 
-	t1.detach();
-	t2.detach();
+	t1.join();
+	t2.join();
 }
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "chan.hh"
+
+namespace chan {
+
+/**
+ * fair_consumer reads from several buffered channels, typically one per
+ * tenant, sharing the values read between them in proportion to their
+ * weights, so a tenant with a backlog cannot starve the others.
+ *
+ * Inputs are served with deficit round robin. When it is an input's turn
+ * it gets its weight added to its deficit, and may then give up to that
+ * many values before the turn passes on. An input that runs empty loses
+ * its deficit, so idle tenants don't build up credit.
+ *
+ * Readers that find every input empty sleep until a value is written to
+ * any of them, or one of them is closed, through the inputs' on_readable
+ * hooks, so there is no polling. A channel can therefore only be the input
+ * of one consumer at a time. Inputs can be added and removed while readers
+ * are running, an input that is closed and drained is removed
+ * automatically.
+ *
+ * Any number of threads can read, read returns false once the consumer is
+ * closed.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::fair_consumer<request> requests;
+ * requests.add(tenant_a, 1);
+ * requests.add(tenant_b, 3);
+ *
+ * request r;
+ * while (requests.read(r)) { ... }
+ * ```
+ * */
+template <typename T>
+class fair_consumer {
+private:
+	struct input {
+		buffered_chan<T>* c;
+		int weight;
+		int deficit;
+		uint64_t served;
+	};
+
+	// guards the inputs and the round robin position, it is held while
+	// reading from the inputs
+	std::mutex state_mutex;
+	std::vector<input> inputs;
+	size_t cursor;
+
+	// incremented whenever an input gets a value, sleeping readers look
+	// again when it changes
+	std::atomic<uint64_t> epoch;
+	std::atomic<int> waiting;
+
+	// only guards sleeping, the inputs' hooks take it with their own lock
+	// held, so the state mutex must never be taken while holding it
+	std::mutex wait_mutex;
+	std::condition_variable value_available;
+
+	std::atomic<bool> is_closed;
+
+	void readable() {
+		epoch.fetch_add(1);
+
+		if (waiting.load() > 0) {
+			std::unique_lock<std::mutex> wait_lock(wait_mutex);
+			value_available.notify_one();
+		}
+	}
+
+	size_t find(const buffered_chan<T>& c) const {
+		for (size_t i = 0; i < inputs.size(); i++) {
+			if (inputs[i].c == &c) {
+				return i;
+			}
+		}
+
+		return inputs.size();
+	}
+
+	void erase(size_t i) {
+		inputs[i].c->on_readable(nullptr);
+		inputs.erase(inputs.begin() + i);
+
+		if (cursor > i) {
+			cursor--;
+		}
+
+		if (cursor >= inputs.size()) {
+			cursor = 0;
+		}
+	}
+
+	/**
+	 * next passes the turn on to the next input
+	 * */
+	void next() {
+		cursor = (cursor + 1) % inputs.size();
+		inputs[cursor].deficit += inputs[cursor].weight;
+	}
+
+	/**
+	 * try_next takes the next value in deficit round robin order, it must
+	 * be called with the state mutex held
+	 * */
+	bool try_next(T& valref) {
+		// an input that runs empty ends its turn, so after one empty pass
+		// over all of them there is nothing to read
+		size_t empty = 0;
+
+		while (!inputs.empty() && empty < inputs.size()) {
+			input& in = inputs[cursor];
+
+			if (in.deficit <= 0) {
+				next();
+				continue;
+			}
+
+			if (in.c->try_read(valref)) {
+				in.deficit--;
+				in.served++;
+				return true;
+			}
+
+			if (in.c->isClosed() && !in.c->try_read(valref)) {
+				erase(cursor);
+				empty = 0;
+
+				if (!inputs.empty()) {
+					inputs[cursor].deficit += inputs[cursor].weight;
+				}
+
+				continue;
+			}
+
+			in.deficit = 0;
+			empty++;
+			next();
+		}
+
+		return false;
+	}
+
+public:
+	fair_consumer() : cursor(0), epoch(0), waiting(0), is_closed(false) {}
+
+	~fair_consumer() {
+		for (size_t i = 0; i < inputs.size(); i++) {
+			inputs[i].c->on_readable(nullptr);
+		}
+	}
+
+	fair_consumer(const fair_consumer& other) = delete;
+	fair_consumer& operator=(const fair_consumer& other) = delete;
+
+	/**
+	 * add starts reading from a channel. The channel must outlive the
+	 * consumer, or be removed first. It throws
+	 * buffered_chan_hook_taken_exception if the channel's on_readable hook
+	 * is in use, for example by another consumer.
+	 *
+	 *
+	 * @param   c        buffered_chan<T>&   the channel
+	 * @param   weight   int                 the share of the channel, relative to the others
+	 * */
+	void add(buffered_chan<T>& c, int weight = 1) {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		if (find(c) != inputs.size()) {
+			return;
+		}
+
+		c.on_readable([this]() { readable(); });
+
+		input in = {&c, std::max(weight, 1), 0, 0};
+		inputs.push_back(in);
+
+		// values written before the hook was set
+		readable();
+	}
+
+	/**
+	 * remove stops reading from a channel, values left in it stay there
+	 *
+	 *
+	 * @return   bool   false if the channel wasn't an input
+	 * */
+	bool remove(buffered_chan<T>& c) {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		size_t i = find(c);
+		if (i == inputs.size()) {
+			return false;
+		}
+
+		erase(i);
+		return true;
+	}
+
+	/**
+	 * served returns the number of values read from a channel since it was
+	 * added, or 0 if it isn't an input
+	 * */
+	uint64_t served(const buffered_chan<T>& c) {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		size_t i = find(c);
+		return i == inputs.size() ? 0 : inputs[i].served;
+	}
+
+	size_t size() {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+		return inputs.size();
+	}
+
+	/**
+	 * close makes all reads return false, the inputs stay open
+	 * */
+	bool close() {
+		if (is_closed.exchange(true)) {
+			throw _channel_closed_exception;
+		}
+
+		std::unique_lock<std::mutex> wait_lock(wait_mutex);
+		value_available.notify_all();
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return is_closed.load();
+	}
+
+	/**
+	 * read takes the next value in deficit round robin order, blocking
+	 * while all the inputs are empty
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value
+	 *
+	 * @return           bool  false once the consumer is closed
+	 * */
+	bool read(T& valref) {
+		while (!is_closed.load()) {
+			uint64_t seen = epoch.load();
+
+			{
+				std::unique_lock<std::mutex> state_lock(state_mutex);
+
+				if (try_next(valref)) {
+					return true;
+				}
+			}
+
+			std::unique_lock<std::mutex> wait_lock(wait_mutex);
+
+			waiting.fetch_add(1);
+			while (epoch.load() == seen && !is_closed.load()) {
+				value_available.wait(wait_lock);
+			}
+			waiting.fetch_sub(1);
+		}
+
+		valref = T();
+		return false;
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "fair_consumer.hh"
+
+TEST(fair_consumer, weighted_shares) {
+	chan::buffered_chan<int> noisy(1000), a(1000), b(1000);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(noisy, 1);
+	consumer.add(a, 1);
+	consumer.add(b, 2);
+
+	for (int i = 0 ; i < 1000 ; i++) {
+		noisy << 0;
+	}
+	for (int i = 0 ; i < 100 ; i++) {
+		a << 1;
+		b << 2;
+	}
+
+	// while everyone has a backlog the shares follow the weights
+	int counts[3] = {0, 0, 0};
+	int x = 0;
+	for (int i = 0 ; i < 200 ; i++) {
+		ASSERT_TRUE(consumer.read(x));
+		counts[x]++;
+	}
+
+	ASSERT_NEAR(50, counts[0], 2);
+	ASSERT_NEAR(50, counts[1], 2);
+	ASSERT_NEAR(100, counts[2], 2);
+
+	ASSERT_EQ(uint64_t(counts[0]), consumer.served(noisy));
+	ASSERT_EQ(uint64_t(counts[1]), consumer.served(a));
+	ASSERT_EQ(uint64_t(counts[2]), consumer.served(b));
+}
+
+TEST(fair_consumer, idle_tenant_gets_no_credit) {
+	chan::buffered_chan<int> a(100), b(100);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a, 1);
+	consumer.add(b, 1);
+
+	for (int i = 0 ; i < 50 ; i++) {
+		a << 0;
+	}
+
+	int x = 0;
+	for (int i = 0 ; i < 50 ; i++) {
+		ASSERT_TRUE(consumer.read(x));
+		ASSERT_EQ(0, x);
+	}
+
+	// b was idle all along, it only gets its share from now on
+	for (int i = 0 ; i < 10 ; i++) {
+		a << 0;
+		b << 1;
+	}
+
+	int counts[2] = {0, 0};
+	for (int i = 0 ; i < 10 ; i++) {
+		ASSERT_TRUE(consumer.read(x));
+		counts[x]++;
+	}
+
+	ASSERT_NEAR(5, counts[1], 1);
+}
+
+TEST(fair_consumer, blocks_until_written) {
+	chan::buffered_chan<int> a(4), b(4);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a);
+	consumer.add(b);
+
+	std::atomic<int> got(-1);
+	std::thread reader([&](){
+		int x = 0;
+		consumer.read(x);
+		got = x;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_EQ(-1, got.load());
+
+	b << 7;
+	reader.join();
+
+	ASSERT_EQ(7, got.load());
+}
+
+TEST(fair_consumer, add_and_remove) {
+	chan::buffered_chan<int> a(4), b(4);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a);
+
+	std::atomic<int> got(-1);
+	std::thread reader([&](){
+		int x = 0;
+		consumer.read(x);
+		got = x;
+	});
+
+	// values written before add are seen, and wake the blocked reader
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	b << 3;
+	consumer.add(b);
+
+	reader.join();
+	ASSERT_EQ(3, got.load());
+	ASSERT_EQ(2u, consumer.size());
+
+	ASSERT_TRUE(consumer.remove(a));
+	ASSERT_FALSE(consumer.remove(a));
+	ASSERT_EQ(0u, consumer.served(a));
+
+	a << 1;
+	b << 2;
+
+	int x = 0;
+	ASSERT_TRUE(consumer.read(x));
+	ASSERT_EQ(2, x);
+	ASSERT_EQ(1, a.size());
+}
+
+TEST(fair_consumer, drops_closed_inputs) {
+	chan::buffered_chan<int> a(4), b(4);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a);
+	consumer.add(b);
+
+	a << 1;
+	a.close();
+
+	int x = 0;
+	ASSERT_TRUE(consumer.read(x));
+	ASSERT_EQ(1, x);
+
+	// a is dropped the next time its turn comes
+	b << 2;
+	b << 3;
+	ASSERT_TRUE(consumer.read(x));
+	ASSERT_EQ(2, x);
+	ASSERT_TRUE(consumer.read(x));
+	ASSERT_EQ(3, x);
+	ASSERT_EQ(1u, consumer.size());
+}
+
+TEST(fair_consumer, close) {
+	chan::buffered_chan<int> a(4);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a);
+
+	std::atomic<bool> result(true);
+	std::thread reader([&](){
+		int x = 0;
+		result = consumer.read(x);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	consumer.close();
+	reader.join();
+
+	ASSERT_FALSE(result.load());
+	ASSERT_TRUE(consumer.isClosed());
+	ASSERT_THROW(consumer.close(), chan::channel_closed_exception);
+}
+
+TEST(fair_consumer, close_input_wakes_readers) {
+	chan::buffered_chan<int> a(4);
+	chan::fair_consumer<int> consumer;
+
+	consumer.add(a);
+
+	std::thread reader([&](){
+		int x = 0;
+		consumer.read(x);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	// the sleeping reader is woken by the close, and drops the input
+	a.close();
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (consumer.size() > 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	ASSERT_EQ(0u, consumer.size());
+
+	consumer.close();
+	reader.join();
+}
+
+TEST(fair_consumer, input_of_one_consumer) {
+	chan::buffered_chan<int> a(4);
+	chan::fair_consumer<int> first, second;
+
+	first.add(a);
+
+	// the second consumer would take the hook the first one sleeps on
+	ASSERT_THROW(second.add(a), chan::buffered_chan_hook_taken_exception);
+	ASSERT_EQ(0u, second.size());
+	ASSERT_FALSE(second.remove(a));
+
+	std::thread reader([&](){
+		int x = 0;
+		ASSERT_TRUE(first.read(x));
+		ASSERT_EQ(1, x);
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	a << 1;
+	reader.join();
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "chan.hh"
+
+namespace chan {
+
+struct file_stage_open_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot open the file of a file stage";
+	}
+} _file_stage_open_exception;
+
+/**
+ * file_chunk is a piece of a file, in one of the buffers of a file_source.
+ * It is trivially copyable, so it moves through channels without
+ * allocating, the bytes stay where they were read.
+ * */
+struct file_chunk {
+	char* data;
+	size_t size;
+
+	// the position of the chunk in the file it was read from
+	uint64_t offset;
+};
+
+/**
+ * file_source is a pipeline stage that reads a file into fixed size chunks,
+ * and writes them to a channel, for streaming large files without an
+ * allocation per read.
+ *
+ * The source allocates all its buffers up front. Once they are all in
+ * flight, it takes consumed chunks back from the recycled channel before
+ * reading more, so a steady pipeline doesn't allocate at all, and the
+ * number of buffers bounds both the memory used and how far the source
+ * runs ahead of its consumers. Consumers, usually a file_sink, hand every
+ * chunk back to recycled once they are done with it. The recycled channel
+ * needs room for all the buffers.
+ *
+ * Chunks are read with pread, the kernel is told the file is read
+ * sequentially, and asked to read ahead the chunk after the one being
+ * read, where posix_fadvise is available.
+ *
+ * At the end of the file, or on an error, the output is closed. The stage
+ * also stops if the output or the recycled channel is closed. The chunks
+ * point into the source's buffers, so the source must outlive them.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<chan::file_chunk> chunks(8), recycled(8);
+ *
+ * chan::file_source source("input.csv", chunks, recycled, 1 << 20, 8);
+ *
+ * chan::file_chunk c;
+ * while (chunks.read(c)) {
+ * 	parse(c.data, c.size);
+ * 	recycled << c;
+ * }
+ * ```
+ * */
+class file_source {
+private:
+	int fd;
+
+	write_chan<file_chunk>& out;
+	read_chan<file_chunk>& recycled;
+
+	size_t chunk_size;
+	int buffers;
+	char* slab;
+
+	int err;
+	uint64_t total;
+
+	std::thread thread;
+
+	void advise(uint64_t offset, size_t length, int advice) {
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), advice);
+#else
+		(void)offset;
+		(void)length;
+		(void)advice;
+#endif
+	}
+
+	/**
+	 * read_at fills buf from offset, retrying short reads, and returns the
+	 * number of bytes read, which is less than size only at the end of the
+	 * file, or -1 on an error
+	 * */
+	ssize_t read_at(char* buf, size_t size, uint64_t offset) {
+		size_t done = 0;
+
+		while (done < size) {
+			ssize_t n = pread(fd, buf + done, size - done, static_cast<off_t>(offset + done));
+
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				return -1;
+			}
+
+			if (n == 0) {
+				break;
+			}
+
+			done += n;
+		}
+
+		return static_cast<ssize_t>(done);
+	}
+
+	void run() {
+#ifdef POSIX_FADV_SEQUENTIAL
+		advise(0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+		int created = 0;
+		uint64_t offset = 0;
+
+		while (true) {
+			file_chunk c;
+
+			if (created < buffers) {
+				c.data = slab + created * chunk_size;
+				created++;
+			} else if (!recycled.read(c)) {
+				break;
+			}
+
+#ifdef POSIX_FADV_WILLNEED
+			advise(offset + chunk_size, chunk_size, POSIX_FADV_WILLNEED);
+#endif
+
+			ssize_t n = read_at(c.data, chunk_size, offset);
+			if (n < 0) {
+				err = errno;
+				break;
+			}
+
+			if (n == 0) {
+				break;
+			}
+
+			c.size = n;
+			c.offset = offset;
+
+			offset += n;
+			total += n;
+
+			try {
+				out.write(c);
+			} catch (closed_channel_write_exception&) {
+				return;
+			}
+
+			// a short read is the end of the file
+			if (static_cast<size_t>(n) < chunk_size) {
+				break;
+			}
+		}
+
+		try {
+			out.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+public:
+	/**
+	 * The file is opened by the constructor, which throws
+	 * file_stage_open_exception if it cannot be opened.
+	 *
+	 *
+	 * @param   path         const char*               the file to read
+	 * @param   out          write_chan<file_chunk>&   the channel chunks are written to
+	 * @param   recycled     read_chan<file_chunk>&    the channel consumed chunks come back on
+	 * @param   chunk_size   size_t                    the size of a chunk
+	 * @param   buffers      int                       the number of chunks in flight
+	 * */
+	file_source(
+	    const char* path,
+	    write_chan<file_chunk>& out,
+	    read_chan<file_chunk>& recycled,
+	    size_t chunk_size = 1 << 20,
+	    int buffers = 8)
+	    : fd(-1),
+	      out(out),
+	      recycled(recycled),
+	      chunk_size(chunk_size > 0 ? chunk_size : 1),
+	      buffers(buffers > 0 ? buffers : 1),
+	      slab(nullptr),
+	      err(0),
+	      total(0) {
+		fd = open(path, O_RDONLY);
+		if (fd == -1) {
+			throw _file_stage_open_exception;
+		}
+
+		// page aligned, as direct I/O and some devices want
+		void* mem = nullptr;
+		if (posix_memalign(&mem, static_cast<size_t>(sysconf(_SC_PAGESIZE)), this->chunk_size * this->buffers) != 0) {
+			::close(fd);
+			throw std::bad_alloc();
+		}
+
+		slab = static_cast<char*>(mem);
+
+		thread = std::thread(&file_source::run, this);
+	}
+
+	/**
+	 * The destructor waits for the stage to finish, and frees the buffers,
+	 * so the output has to be drained, or closed, before it
+	 * */
+	~file_source() {
+		join();
+
+		::close(fd);
+		free(slab);
+	}
+
+	file_source(const file_source& other) = delete;
+	file_source& operator=(const file_source& other) = delete;
+
+	void join() {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	/**
+	 * error returns the errno of the read that failed, or 0, once joined
+	 * */
+	int error() const {
+		return err;
+	}
+
+	/**
+	 * bytes returns the number of bytes read, once joined
+	 * */
+	uint64_t bytes() const {
+		return total;
+	}
+};
+
+/**
+ * file_sink is a pipeline stage that writes the chunks read from a channel
+ * to a file, in the order they are read, and then hands them back to their
+ * file_source through the recycled channel.
+ *
+ * The chunks that are already in the channel are gathered and written with
+ * a single writev, up to max_iov of them, so a sink that falls behind
+ * catches up with fewer system calls.
+ *
+ * When the input is closed and drained, or a write fails, the sink closes
+ * both the input and the recycled channel, which stops the source.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<chan::file_chunk> chunks(8), recycled(8);
+ *
+ * chan::file_source source("in.bin", chunks, recycled);
+ * chan::file_sink sink("out.bin", chunks, recycled);
+ * ```
+ * */
+class file_sink {
+private:
+	int fd;
+	bool owned;
+
+	buffered_chan<file_chunk>& in;
+	write_chan<file_chunk>& recycled;
+
+	int max_iov;
+
+	int err;
+	uint64_t total;
+
+	std::thread thread;
+
+	/**
+	 * write_all writes the chunks with writev, continuing after partial
+	 * writes, and returns false on an error
+	 * */
+	bool write_all(const std::vector<file_chunk>& batch, std::vector<iovec>& iov) {
+		for (size_t i = 0; i < batch.size(); i++) {
+			iov[i].iov_base = batch[i].data;
+			iov[i].iov_len = batch[i].size;
+		}
+
+		iovec* next = iov.data();
+		int count = static_cast<int>(batch.size());
+
+		while (count > 0) {
+			ssize_t n = writev(fd, next, count);
+
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				return false;
+			}
+
+			total += n;
+
+			size_t left = n;
+			while (count > 0 && left >= next->iov_len) {
+				left -= next->iov_len;
+				next++;
+				count--;
+			}
+
+			if (count > 0) {
+				next->iov_base = static_cast<char*>(next->iov_base) + left;
+				next->iov_len -= left;
+			}
+		}
+
+		return true;
+	}
+
+	void recycle(const std::vector<file_chunk>& batch) {
+		for (size_t i = 0; i < batch.size(); i++) {
+			try {
+				recycled.write(batch[i]);
+			} catch (closed_channel_write_exception&) {
+				return;
+			}
+		}
+	}
+
+	void run() {
+		std::vector<file_chunk> batch;
+		batch.reserve(max_iov);
+
+		std::vector<iovec> iov(max_iov);
+
+		file_chunk c;
+		while (in.read(c)) {
+			batch.push_back(c);
+
+			while (static_cast<int>(batch.size()) < max_iov && in.try_read(c)) {
+				batch.push_back(c);
+			}
+
+			if (!write_all(batch, iov)) {
+				err = errno;
+				break;
+			}
+
+			recycle(batch);
+			batch.clear();
+		}
+
+		try {
+			in.close();
+		} catch (channel_closed_exception&) {
+		}
+
+		try {
+			recycled.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+	void start() {
+		if (max_iov > IOV_MAX) {
+			max_iov = IOV_MAX;
+		}
+
+		thread = std::thread(&file_sink::run, this);
+	}
+
+public:
+	/**
+	 * The file is created, or truncated, by the constructor, which throws
+	 * file_stage_open_exception if it cannot be opened.
+	 *
+	 *
+	 * @param   path       const char*                  the file to write
+	 * @param   in         buffered_chan<file_chunk>&   the channel to read chunks from
+	 * @param   recycled   write_chan<file_chunk>&      the channel written chunks are handed back to
+	 * @param   max_iov    int                          the most chunks written at once
+	 * */
+	file_sink(const char* path, buffered_chan<file_chunk>& in, write_chan<file_chunk>& recycled, int max_iov = 16)
+	    : fd(-1), owned(true), in(in), recycled(recycled), max_iov(max_iov > 0 ? max_iov : 1), err(0), total(0) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) {
+			throw _file_stage_open_exception;
+		}
+
+		start();
+	}
+
+	/**
+	 * file_sink with a file descriptor writes to it, without closing it,
+	 * for pipes and standard output
+	 * */
+	file_sink(int fd, buffered_chan<file_chunk>& in, write_chan<file_chunk>& recycled, int max_iov = 16)
+	    : fd(fd), owned(false), in(in), recycled(recycled), max_iov(max_iov > 0 ? max_iov : 1), err(0), total(0) {
+		start();
+	}
+
+	/**
+	 * The destructor waits for the stage to finish, so the input has to be
+	 * closed before it
+	 * */
+	~file_sink() {
+		join();
+
+		if (owned) {
+			::close(fd);
+		}
+	}
+
+	file_sink(const file_sink& other) = delete;
+	file_sink& operator=(const file_sink& other) = delete;
+
+	void join() {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	/**
+	 * error returns the errno of the write that failed, or 0, once joined
+	 * */
+	int error() const {
+		return err;
+	}
+
+	/**
+	 * bytes returns the number of bytes written, once joined
+	 * */
+	uint64_t bytes() const {
+		return total;
+	}
+};
+
+}  // namespace chan
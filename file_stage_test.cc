@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "file_stage.hh"
+
+std::string temp_path(const char* name) {
+	return std::string("/tmp/file_stage_test_") + std::to_string(getpid()) + "_" + name;
+}
+
+std::string write_pattern(const char* name, size_t size) {
+	std::string path = temp_path(name);
+	std::ofstream f(path, std::ios::binary);
+
+	for (size_t i = 0; i < size; i++) {
+		f.put(static_cast<char>(i * 7 + i / 251));
+	}
+
+	return path;
+}
+
+std::string contents(const std::string& path) {
+	std::ifstream f(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+TEST(file_stage, copy) {
+	// not a multiple of the chunk size, and many more chunks than buffers
+	std::string in_path = write_pattern("in", 100000 + 123);
+	std::string out_path = temp_path("out");
+
+	chan::buffered_chan<chan::file_chunk> chunks(4), recycled(3);
+
+	{
+		chan::file_source source(in_path.c_str(), chunks, recycled, 4096, 3);
+		chan::file_sink sink(out_path.c_str(), chunks, recycled, 4);
+
+		sink.join();
+		source.join();
+
+		ASSERT_EQ(0, source.error());
+		ASSERT_EQ(0, sink.error());
+		ASSERT_EQ(100123u, source.bytes());
+		ASSERT_EQ(100123u, sink.bytes());
+	}
+
+	ASSERT_TRUE(contents(in_path) == contents(out_path));
+
+	unlink(in_path.c_str());
+	unlink(out_path.c_str());
+}
+
+TEST(file_stage, buffers_are_recycled) {
+	std::string path = write_pattern("recycled", 64 * 1024);
+
+	chan::buffered_chan<chan::file_chunk> chunks(2), recycled(2);
+	chan::file_source source(path.c_str(), chunks, recycled, 1024, 2);
+
+	std::set<char*> buffers;
+	uint64_t offset = 0;
+
+	chan::file_chunk c;
+	while (chunks.read(c)) {
+		ASSERT_EQ(offset, c.offset);
+		offset += c.size;
+
+		buffers.insert(c.data);
+		recycled << c;
+	}
+
+	ASSERT_EQ(64u * 1024, offset);
+	ASSERT_EQ(2u, buffers.size());
+
+	unlink(path.c_str());
+}
+
+TEST(file_stage, empty_file) {
+	std::string path = write_pattern("empty", 0);
+
+	chan::buffered_chan<chan::file_chunk> chunks(2), recycled(2);
+	chan::file_source source(path.c_str(), chunks, recycled, 1024, 2);
+
+	chan::file_chunk c;
+	ASSERT_FALSE(chunks.read(c));
+
+	unlink(path.c_str());
+}
+
+TEST(file_stage, open_fails) {
+	chan::buffered_chan<chan::file_chunk> chunks(2), recycled(2);
+
+	ASSERT_THROW(
+	    chan::file_source("/nonexistent/file", chunks, recycled),
+	    chan::file_stage_open_exception);
+	ASSERT_THROW(
+	    chan::file_sink("/nonexistent/file", chunks, recycled),
+	    chan::file_stage_open_exception);
+}
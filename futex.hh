@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#endif
+
+namespace chan {
+
+#ifdef __linux__
+
+inline long futex_call(std::atomic<uint32_t>* addr, int op, uint32_t val, const struct timespec* timeout, bool shared) {
+	if (!shared) {
+		op |= FUTEX_PRIVATE_FLAG;
+	}
+
+	return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, timeout, nullptr, 0);
+}
+
+/**
+ * futex_wait_for blocks the calling thread as long as *addr is equal to
+ * expected, until it is woken up by futex_wake or the timeout expires.
+ * Like a condition variable it can return spuriously, so callers must
+ * recheck their condition.
+ *
+ * shared must be true for words in memory that is mapped by more than
+ * one process.
+ *
+ *
+ * @param   addr       std::atomic<uint32_t>*     the word to wait on
+ * @param   expected   uint32_t                   the value to sleep on
+ * @param   timeout    std::chrono::nanoseconds   the maximum wait
+ * @param   shared     bool                       whether addr is process shared
+ *
+ * @return             bool                       false if the wait timed out
+ * */
+inline bool futex_wait_for(std::atomic<uint32_t>* addr, uint32_t expected, std::chrono::nanoseconds timeout, bool shared = false) {
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+	ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+
+	if (futex_call(addr, FUTEX_WAIT, expected, &ts, shared) == -1 && errno == ETIMEDOUT) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * futex_wait is futex_wait_for without a timeout
+ * */
+inline void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, bool shared = false) {
+	futex_call(addr, FUTEX_WAIT, expected, nullptr, shared);
+}
+
+/**
+ * futex_wake wakes up to count threads blocked in futex_wait on addr.
+ * The word must be modified before calling it.
+ * */
+inline void futex_wake(std::atomic<uint32_t>* addr, int count = INT_MAX, bool shared = false) {
+	futex_call(addr, FUTEX_WAKE, static_cast<uint32_t>(count), nullptr, shared);
+}
+
+#else
+
+/**
+ * Without futexes, waits are emulated with a fixed table of mutexes and
+ * condition variables hashed by address. Only process private words are
+ * supported.
+ * */
+struct futex_bucket {
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+inline futex_bucket& futex_bucket_of(std::atomic<uint32_t>* addr) {
+	static futex_bucket buckets[64];
+	return buckets[(std::hash<void*>()(addr) >> 4) % 64];
+}
+
+inline bool futex_wait_for(std::atomic<uint32_t>* addr, uint32_t expected, std::chrono::nanoseconds timeout, bool shared = false) {
+	(void)shared;
+
+	futex_bucket& bucket = futex_bucket_of(addr);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+
+	if (addr->load() != expected) {
+		return true;
+	}
+
+	return bucket.cv.wait_for(lock, timeout) == std::cv_status::no_timeout;
+}
+
+inline void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, bool shared = false) {
+	(void)shared;
+
+	futex_bucket& bucket = futex_bucket_of(addr);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+
+	if (addr->load() != expected) {
+		return;
+	}
+
+	bucket.cv.wait(lock);
+}
+
+inline void futex_wake(std::atomic<uint32_t>* addr, int count = INT_MAX, bool shared = false) {
+	(void)count;
+	(void)shared;
+
+	futex_bucket& bucket = futex_bucket_of(addr);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+	bucket.cv.notify_all();
+}
+
+#endif
+
+}  // namespace chan
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chan.hh"
+#include "futex.hh"
+
+namespace chan {
+
+struct ipc_chan_open_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot create or attach to the shared memory channel";
+	}
+} _ipc_chan_open_exception;
+
+struct ipc_chan_role_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "the role is already taken, or this end of the shared memory channel doesn't have it";
+	}
+} _ipc_chan_role_exception;
+
+/**
+ * ipc_role is the end of an ipc_chan a process holds, each is held by a
+ * single process
+ * */
+enum class ipc_role {
+	reader,
+	writer
+};
+
+/**
+ * ipc_chan_header is the control block at the start of the shared memory
+ * region, followed by the ring of elements. The reader and writer sides
+ * live on separate cache lines.
+ * */
+struct ipc_chan_header {
+	uint32_t magic;
+	uint32_t element_size;
+	uint32_t capacity;
+
+	alignas(64) std::atomic<uint32_t> head;
+	std::atomic<uint32_t> readers_waiting;
+	std::atomic<uint32_t> read_seq;
+	std::atomic<int32_t> reader_pid;
+
+	alignas(64) std::atomic<uint32_t> tail;
+	std::atomic<uint32_t> writers_waiting;
+	std::atomic<uint32_t> write_seq;
+	std::atomic<int32_t> writer_pid;
+
+	alignas(64) std::atomic<uint32_t> closed;
+	std::atomic<uint32_t> ready;
+};
+
+/**
+ * ipc_chan implements a buffered channel between processes, over a ring in
+ * POSIX shared memory. One process creates the channel with a name and a
+ * capacity, the other attaches to it by name.
+ *
+ * Values are copied in and out of the ring with memcpy, so T must be
+ * trivially copyable. Blocked readers and writers sleep on futexes in the
+ * shared mapping, and the fast path takes no locks and makes no system
+ * calls.
+ *
+ * A channel carries values from one writing process to one reading
+ * process, threads within each process are serialized. Each end claims its
+ * role when it is created or attached, and a second claimant of the same
+ * role is refused with ipc_chan_role_exception, so two processes never
+ * share a side of the ring. A role stays claimed for the life of the
+ * channel. If the process on the other end dies while this end is blocked,
+ * the channel is closed, whether or not it has written or read anything
+ * yet. An ipc_chan object should not be used across fork, attach a new one
+ * in the child instead.
+ *
+ * example usage:
+ *
+ * ```
+ * // producer
+ * chan::ipc_chan<int> c("/jobs", 1024, chan::ipc_role::writer);
+ * c << 1;
+ * c.close();
+ *
+ * // consumer
+ * chan::ipc_chan<int> c("/jobs", chan::ipc_role::reader);
+ * int x = 0;
+ * while (c.read(x)) { ... }
+ * ```
+ * */
+template <typename T>
+class ipc_chan : public read_chan<T>, public write_chan<T> {
+	static_assert(std::is_trivially_copyable<T>::value, "ipc_chan requires a trivially copyable type");
+
+private:
+	static const uint32_t ipc_chan_magic = 0x6368616e;
+	static const int spin_limit = 256;
+
+	std::string name;
+	bool owner;
+
+	ipc_chan_header* header;
+	char* ring;
+	size_t length;
+	uint32_t mask;
+
+	std::mutex read_mutex;
+	std::mutex write_mutex;
+
+	ipc_role role;
+
+	static std::chrono::nanoseconds peer_check_interval() {
+		return std::chrono::milliseconds(100);
+	}
+
+	static size_t ring_offset() {
+		return (sizeof(ipc_chan_header) + 63) / 64 * 64;
+	}
+
+	static std::string shm_name(const std::string& name) {
+		return name.size() > 0 && name[0] == '/' ? name : "/" + name;
+	}
+
+	/**
+	 * is_alive checks whether the process on the other end still exists.
+	 * A process that exited but wasn't reaped yet still accepts signals,
+	 * so on linux zombies are detected through procfs. A pid of 0 is an
+	 * end that hasn't attached yet.
+	 * */
+	static bool is_alive(int32_t pid) {
+		if (pid == 0) {
+			return true;
+		}
+
+		if (kill(pid, 0) == -1 && errno == ESRCH) {
+			return false;
+		}
+
+#ifdef __linux__
+		char path[32];
+		snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+
+		FILE* f = fopen(path, "r");
+		if (f == nullptr) {
+			return true;
+		}
+
+		char state = 0;
+		int matched = fscanf(f, "%*d (%*[^)]) %c", &state);
+		fclose(f);
+
+		if (matched == 1 && (state == 'Z' || state == 'X')) {
+			return false;
+		}
+#endif
+
+		return true;
+	}
+
+	T* slot(uint32_t index) {
+		return reinterpret_cast<T*>(ring) + (index & mask);
+	}
+
+	void map(int fd) {
+		void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p == MAP_FAILED) {
+			throw _ipc_chan_open_exception;
+		}
+
+		header = static_cast<ipc_chan_header*>(p);
+		ring = static_cast<char*>(p) + ring_offset();
+	}
+
+	/**
+	 * claim registers this process as the holder of the role, so that the
+	 * other end can detect that it died, and unmaps the channel and throws
+	 * ipc_chan_role_exception if another end holds it already
+	 * */
+	void claim() {
+		std::atomic<int32_t>& pid = role == ipc_role::reader ? header->reader_pid : header->writer_pid;
+
+		int32_t expected = 0;
+		if (!pid.compare_exchange_strong(expected, static_cast<int32_t>(getpid()))) {
+			munmap(header, length);
+
+			if (owner) {
+				shm_unlink(name.c_str());
+			}
+
+			throw _ipc_chan_role_exception;
+		}
+	}
+
+	void mark_closed() {
+		header->closed.store(1);
+
+		header->read_seq.fetch_add(1);
+		header->write_seq.fetch_add(1);
+		futex_wake(&header->read_seq, INT_MAX, true);
+		futex_wake(&header->write_seq, INT_MAX, true);
+	}
+
+public:
+	/**
+	 * This constructor creates a new channel, replacing any stale one with
+	 * the same name. The name is removed when the creating side is
+	 * destroyed, processes that are already attached are not affected.
+	 *
+	 * capacity is rounded up to a power of 2.
+	 *
+	 *
+	 * @param   name       const std::string&   the name of the channel
+	 * @param   capacity   int                  the number of values the ring holds
+	 * @param   role       ipc_role             the end this process holds
+	 * */
+	ipc_chan(const std::string& name, int capacity, ipc_role role)
+	    : name(shm_name(name)), owner(true), role(role) {
+		if (capacity <= 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+
+		uint32_t cap = 1;
+		while (cap < static_cast<uint32_t>(capacity)) {
+			cap <<= 1;
+		}
+
+		mask = cap - 1;
+		length = ring_offset() + cap * sizeof(T);
+
+		shm_unlink(this->name.c_str());
+		int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd == -1) {
+			throw _ipc_chan_open_exception;
+		}
+
+		if (ftruncate(fd, length) == -1) {
+			::close(fd);
+			shm_unlink(this->name.c_str());
+			throw _ipc_chan_open_exception;
+		}
+
+		map(fd);
+
+		new (header) ipc_chan_header();
+		header->magic = ipc_chan_magic;
+		header->element_size = sizeof(T);
+		header->capacity = cap;
+		header->head.store(0);
+		header->readers_waiting.store(0);
+		header->read_seq.store(0);
+		header->reader_pid.store(0);
+		header->tail.store(0);
+		header->writers_waiting.store(0);
+		header->write_seq.store(0);
+		header->writer_pid.store(0);
+		header->closed.store(0);
+
+		claim();
+		header->ready.store(1, std::memory_order_release);
+	}
+
+	/**
+	 * This constructor attaches to an existing channel by name. It throws
+	 * ipc_chan_open_exception if the channel doesn't exist or was created
+	 * for a different element size, and ipc_chan_role_exception if the
+	 * role is held already.
+	 *
+	 *
+	 * @param   name   const std::string&   the name of the channel
+	 * @param   role   ipc_role             the end this process holds
+	 * */
+	ipc_chan(const std::string& name, ipc_role role)
+	    : name(shm_name(name)), owner(false), role(role) {
+		int fd = shm_open(this->name.c_str(), O_RDWR, 0600);
+		if (fd == -1) {
+			throw _ipc_chan_open_exception;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < ring_offset()) {
+			::close(fd);
+			throw _ipc_chan_open_exception;
+		}
+
+		length = st.st_size;
+		map(fd);
+
+		if (header->ready.load(std::memory_order_acquire) != 1 ||
+		    header->magic != ipc_chan_magic ||
+		    header->element_size != sizeof(T) ||
+		    length < ring_offset() + header->capacity * sizeof(T)) {
+			munmap(header, length);
+			throw _ipc_chan_open_exception;
+		}
+
+		mask = header->capacity - 1;
+
+		claim();
+	}
+
+	~ipc_chan() {
+		munmap(header, length);
+
+		if (owner) {
+			shm_unlink(name.c_str());
+		}
+	}
+
+	ipc_chan(const ipc_chan& other) = delete;
+	ipc_chan& operator=(const ipc_chan& other) = delete;
+
+	/**
+	 * close closes the channel for both processes. Readers can still drain
+	 * values that were written before it.
+	 * */
+	bool close() {
+		if (header->closed.exchange(1) == 1) {
+			throw _channel_closed_exception;
+		}
+
+		mark_closed();
+		return true;
+	}
+
+	bool isClosed() const {
+		return header->closed.load() == 1;
+	}
+
+	/**
+	 * write copies a value into the ring, blocking while the ring is full.
+	 * It throws closed_channel_write_exception if the channel is closed,
+	 * or the reading process died while the ring was full, and
+	 * ipc_chan_role_exception on the reading end.
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 * */
+	void write(const T& val) {
+		if (role != ipc_role::writer) {
+			throw _ipc_chan_role_exception;
+		}
+
+		std::unique_lock<std::mutex> write_lock(write_mutex);
+
+		uint32_t tail = header->tail.load(std::memory_order_relaxed);
+		int spins = 0;
+
+		while (true) {
+			if (header->closed.load() == 1) {
+				throw _closed_channel_write_exception;
+			}
+
+			uint32_t seq = header->write_seq.load(std::memory_order_acquire);
+			if (tail - header->head.load(std::memory_order_acquire) <= mask) {
+				break;
+			}
+
+			// the other process is usually just about to make progress, so
+			// spin briefly before paying for a futex round trip
+			if (spins < spin_limit) {
+				spins++;
+				continue;
+			}
+
+			header->writers_waiting.fetch_add(1);
+
+			if (tail - header->head.load() > mask && header->closed.load() == 0) {
+				if (!futex_wait_for(&header->write_seq, seq, peer_check_interval(), true) &&
+				    !is_alive(header->reader_pid.load())) {
+					mark_closed();
+				}
+			}
+
+			header->writers_waiting.fetch_sub(1);
+		}
+
+		memcpy(slot(tail), &val, sizeof(T));
+		header->tail.store(tail + 1);
+
+		if (header->readers_waiting.load() > 0) {
+			header->read_seq.fetch_add(1);
+			futex_wake(&header->read_seq, 1, true);
+		}
+	}
+
+	/**
+	 * read copies the value at the front of the ring, blocking while it is
+	 * empty. Once the channel is closed, or the writing process died, the
+	 * remaining values are returned before read starts returning false.
+	 * It throws ipc_chan_role_exception on the writing end.
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value in the front
+	 *
+	 * @return           bool  the result of this mission
+	 * */
+	bool read(T& valref) {
+		if (role != ipc_role::reader) {
+			throw _ipc_chan_role_exception;
+		}
+
+		std::unique_lock<std::mutex> read_lock(read_mutex);
+
+		uint32_t head = header->head.load(std::memory_order_relaxed);
+		int spins = 0;
+
+		while (true) {
+			uint32_t seq = header->read_seq.load(std::memory_order_acquire);
+			if (header->tail.load(std::memory_order_acquire) != head) {
+				break;
+			}
+
+			if (header->closed.load() == 1) {
+				valref = T();
+				return false;
+			}
+
+			// the other process is usually just about to make progress, so
+			// spin briefly before paying for a futex round trip
+			if (spins < spin_limit) {
+				spins++;
+				continue;
+			}
+
+			header->readers_waiting.fetch_add(1);
+
+			if (header->tail.load() == head && header->closed.load() == 0) {
+				if (!futex_wait_for(&header->read_seq, seq, peer_check_interval(), true) &&
+				    !is_alive(header->writer_pid.load())) {
+					mark_closed();
+				}
+			}
+
+			header->readers_waiting.fetch_sub(1);
+		}
+
+		memcpy(&valref, slot(head), sizeof(T));
+		header->head.store(head + 1);
+
+		if (header->writers_waiting.load() > 0) {
+			header->write_seq.fetch_add(1);
+			futex_wake(&header->write_seq, 1, true);
+		}
+
+		return true;
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ipc_chan.hh"
+
+struct sample {
+	int id;
+	double value;
+};
+
+std::string channel_name(const char* test) {
+	return "/chan_ipc_test_" + std::string(test) + "_" + std::to_string(getpid());
+}
+
+TEST(ipc_chan, same_process) {
+	chan::ipc_chan<int> c(channel_name("same_process"), 3, chan::ipc_role::writer);
+	chan::ipc_chan<int> d(channel_name("same_process"), chan::ipc_role::reader);
+
+	c << 1 << 2 << 3 << 4;
+
+	int x = 0;
+	for (int i = 1; i <= 4; i++) {
+		d >> x;
+		ASSERT_EQ(i, x);
+	}
+
+	d.close();
+	ASSERT_EQ(true, c.isClosed());
+	ASSERT_THROW(c.write(5), chan::closed_channel_write_exception);
+	ASSERT_EQ(false, d.read(x));
+}
+
+TEST(ipc_chan, attach_missing) {
+	ASSERT_THROW(chan::ipc_chan<int>(channel_name("missing"), chan::ipc_role::reader), chan::ipc_chan_open_exception);
+}
+
+TEST(ipc_chan, attach_wrong_type) {
+	chan::ipc_chan<int> c(channel_name("wrong_type"), 4, chan::ipc_role::writer);
+	ASSERT_THROW(chan::ipc_chan<sample>(channel_name("wrong_type"), chan::ipc_role::reader), chan::ipc_chan_open_exception);
+}
+
+TEST(ipc_chan, roles) {
+	chan::ipc_chan<int> c(channel_name("roles"), 4, chan::ipc_role::writer);
+
+	// a second writer would race on the ring with the first
+	ASSERT_THROW(chan::ipc_chan<int>(channel_name("roles"), chan::ipc_role::writer), chan::ipc_chan_role_exception);
+
+	chan::ipc_chan<int> d(channel_name("roles"), chan::ipc_role::reader);
+	ASSERT_THROW(chan::ipc_chan<int>(channel_name("roles"), chan::ipc_role::reader), chan::ipc_chan_role_exception);
+
+	int x = 0;
+	ASSERT_THROW(c.read(x), chan::ipc_chan_role_exception);
+	ASSERT_THROW(d.write(1), chan::ipc_chan_role_exception);
+}
+
+TEST(ipc_chan, two_processes) {
+	std::string name = channel_name("two_processes");
+	chan::ipc_chan<sample> c(name, 16, chan::ipc_role::writer);
+
+	pid_t pid = fork();
+	ASSERT_NE(-1, pid);
+
+	if (pid == 0) {
+		chan::ipc_chan<sample> child(name, chan::ipc_role::reader);
+
+		sample s;
+		int expected = 0;
+		while (child.read(s)) {
+			if (s.id != expected || s.value != expected * 0.5) {
+				_exit(1);
+			}
+
+			expected++;
+		}
+
+		_exit(expected == 10000 ? 0 : 2);
+	}
+
+	for (int i = 0; i < 10000; i++) {
+		sample s = {i, i * 0.5};
+		c << s;
+	}
+
+	c.close();
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	ASSERT_EQ(true, WIFEXITED(status));
+	ASSERT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(ipc_chan, dead_reader) {
+	std::string name = channel_name("dead_reader");
+	chan::ipc_chan<int> c(name, 4, chan::ipc_role::writer);
+
+	pid_t pid = fork();
+	ASSERT_NE(-1, pid);
+
+	if (pid == 0) {
+		chan::ipc_chan<int> child(name, chan::ipc_role::reader);
+
+		int x = 0;
+		child >> x;
+		_exit(0);
+	}
+
+	int status = 0;
+
+	// the child reads one value and exits without closing, after which the
+	// ring fills up and the writer must notice that nobody is left
+	ASSERT_THROW({
+		for (int i = 0; i < 100; i++) {
+			c << i;
+		}
+	}, chan::closed_channel_write_exception);
+
+	waitpid(pid, &status, 0);
+	ASSERT_EQ(true, c.isClosed());
+}
+
+TEST(ipc_chan, dead_writer) {
+	std::string name = channel_name("dead_writer");
+	chan::ipc_chan<int> c(name, 4, chan::ipc_role::reader);
+
+	pid_t pid = fork();
+	ASSERT_NE(-1, pid);
+
+	if (pid == 0) {
+		chan::ipc_chan<int> child(name, chan::ipc_role::writer);
+		child << 1 << 2;
+		_exit(0);
+	}
+
+	int x = 0;
+	ASSERT_EQ(true, c.read(x));
+	ASSERT_EQ(1, x);
+	ASSERT_EQ(true, c.read(x));
+	ASSERT_EQ(2, x);
+
+	// the writer is gone and never closed the channel
+	ASSERT_EQ(false, c.read(x));
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+}
+
+TEST(ipc_chan, dead_writer_before_write) {
+	std::string name = channel_name("dead_writer_before_write");
+	chan::ipc_chan<int> c(name, 4, chan::ipc_role::reader);
+
+	pid_t pid = fork();
+	ASSERT_NE(-1, pid);
+
+	if (pid == 0) {
+		// attach and die without writing anything
+		chan::ipc_chan<int> child(name, chan::ipc_role::writer);
+		_exit(0);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	int x = 0;
+	ASSERT_EQ(false, c.read(x));
+	ASSERT_EQ(true, c.isClosed());
+}
@@ -0,0 +1,114 @@
+/**
+ * Compares the cost of filling and draining a large circular_queue, and of
+ * streaming through a large buffered_chan, with storage from
+ * std::allocator, huge_page_allocator and numa_allocator.
+ *
+ * The timings mostly reflect TLB misses and remote memory accesses. To see
+ * those directly, run this under
+ *
+ * perf stat -e dTLB-load-misses,dTLB-store-misses,node-load-misses
+ *
+ * On machines with more than one NUMA node the ring is also placed on the
+ * farthest node, to show the cost of remote memory.
+ * */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "../allocator.hh"
+#include "../chan.hh"
+
+// 64MB of ints
+const int QUEUE_SIZE = 16 * 1024 * 1024;
+const int ROUNDS = 4;
+
+const int CHAN_SIZE = 4 * 1024 * 1024;
+const int RUN_SIZE = 1000000;
+
+int numa_nodes() {
+	int nodes = 0;
+	while (access(("/sys/devices/system/node/node" + std::to_string(nodes)).c_str(), F_OK) == 0) {
+		nodes++;
+	}
+
+	return nodes == 0 ? 1 : nodes;
+}
+
+template <typename Allocator>
+void measure_queue(const char* name, const Allocator& alloc) {
+	chan::circular_queue<int, Allocator> queue(QUEUE_SIZE, alloc);
+
+	auto start = std::chrono::steady_clock::now();
+
+	long sum = 0;
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < QUEUE_SIZE; i++) {
+			queue.push(i);
+		}
+
+		for (int i = 0; i < QUEUE_SIZE; i++) {
+			sum += queue.front();
+			queue.pop();
+		}
+	}
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "circular_queue (%s): %d*%d push/pop time in ms: %llu (checksum %ld)\n",
+	    name, ROUNDS, QUEUE_SIZE, (unsigned long long)ms, sum);
+}
+
+template <typename Allocator>
+void measure_chan(const char* name, const Allocator& alloc) {
+	chan::buffered_chan<int, Allocator> c(CHAN_SIZE, alloc);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&](){
+		for (int i = 0; i < RUN_SIZE; i++) {
+			c << i;
+		}
+	});
+
+	int _ = 0;
+	for (int i = 0; i < RUN_SIZE; i++) {
+		c >> _;
+	}
+
+	producer.join();
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "buffered_chan (%s): %d send/recv time in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, RUN_SIZE, (unsigned long long)ms, double(RUN_SIZE) / ms);
+}
+
+int main() {
+	int local = chan::current_numa_node();
+	int remote = numa_nodes() - 1 == local ? 0 : numa_nodes() - 1;
+
+	measure_queue("std::allocator", std::allocator<int>());
+	measure_queue("huge_page_allocator", chan::huge_page_allocator<int>());
+	measure_queue("numa_allocator local", chan::numa_allocator<int>(local));
+	measure_queue("numa_allocator local huge", chan::numa_allocator<int>(local, true));
+	if (remote != local) {
+		measure_queue("numa_allocator remote", chan::numa_allocator<int>(remote));
+	}
+
+	measure_chan("std::allocator", std::allocator<int>());
+	measure_chan("huge_page_allocator", chan::huge_page_allocator<int>());
+	measure_chan("numa_allocator local", chan::numa_allocator<int>(local));
+	if (remote != local) {
+		measure_chan("numa_allocator remote", chan::numa_allocator<int>(remote));
+	}
+}
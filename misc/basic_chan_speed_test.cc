@@ -0,0 +1,51 @@
+/**
+ * Measures the throughput of one writer and one reader for the engines a
+ * basic_chan can pick, all with a capacity of 1024.
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "../chan.hh"
+
+const int RUN_SIZE = 2000000;
+const size_t CAPACITY = 1024;
+
+template <typename C>
+void measure(const char* name) {
+	C c;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread writer([&c]() {
+		for (int i = 0; i < RUN_SIZE; i++) {
+			c << i;
+		}
+
+		c.close();
+	});
+
+	int x = 0;
+	uint64_t sum = 0;
+	while (c.read(x)) {
+		sum += x;
+	}
+
+	writer.join();
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-22s %d msgs in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, RUN_SIZE, static_cast<unsigned long long>(ms), double(RUN_SIZE) / (ms > 0 ? ms : 1));
+}
+
+int main() {
+	measure<chan::basic_chan<int, CAPACITY>>("blocking mpmc");
+	measure<chan::basic_chan<int, CAPACITY, chan::multi, chan::multi, chan::spinning>>("spinning mpmc");
+	measure<chan::basic_chan<int, CAPACITY, chan::single, chan::single, chan::spinning>>("spinning spsc");
+}
@@ -0,0 +1,67 @@
+/**
+ * Measures the memory used by 1M idle channels, with a capacity of 16
+ * where buffered, by reading the resident set size from /proc. Each kind
+ * is measured in a child process, so memory freed by the previous one
+ * doesn't skew the result.
+ * */
+
+#include <cstdio>
+#include <deque>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../compact_chan.hh"
+
+const int CHANNELS = 1000000;
+const int CAPACITY = 16;
+
+long resident_bytes() {
+	long pages = 0, resident = 0;
+
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f == nullptr) {
+		return 0;
+	}
+
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+		resident = 0;
+	}
+
+	fclose(f);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+template <typename C, typename... Args>
+void measure(const char* name, Args... args) {
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid != 0) {
+		waitpid(pid, nullptr, 0);
+		return;
+	}
+
+	long before = resident_bytes();
+
+	std::deque<C> channels;
+	for (int i = 0; i < CHANNELS; i++) {
+		channels.emplace_back(args...);
+	}
+
+	long after = resident_bytes();
+
+	printf(
+	    "%-24s sizeof: %4zu, %d idle channels: %6.1f MB (%5.1f bytes per channel)\n",
+	    name, sizeof(C), CHANNELS, (after - before) / 1e6, double(after - before) / CHANNELS);
+
+	fflush(stdout);
+	_exit(0);
+}
+
+int main() {
+	measure<chan::unbuffered_chan<int>>("unbuffered_chan<int>");
+	measure<chan::buffered_chan<int>>("buffered_chan<int>(16)", CAPACITY);
+	measure<chan::compact_chan<int>>("compact_chan<int>(16)", CAPACITY);
+}
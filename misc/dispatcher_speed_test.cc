@@ -0,0 +1,98 @@
+/**
+ * Compares job latency when jobs are handed to per worker channels in round
+ * robin, and through a dispatcher. One of the workers is 25 times slower
+ * than the others, with round robin every 4th job queues up behind it.
+ *
+ * Service and arrival times are sleeps, so that the result doesn't depend
+ * on having a core per thread.
+ * */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../dispatcher.hh"
+
+const int WORKERS = 4;
+const int JOBS = 4000;
+const int CAPACITY = 16;
+
+typedef std::chrono::steady_clock clock_type;
+
+struct job {
+	clock_type::time_point enqueued;
+};
+
+void measure(const char* name, bool dispatch) {
+	std::vector<std::unique_ptr<chan::buffered_chan<job>>> queues;
+	std::vector<chan::buffered_chan<job>*> targets;
+
+	for (int i = 0; i < WORKERS; i++) {
+		queues.push_back(std::unique_ptr<chan::buffered_chan<job>>(new chan::buffered_chan<job>(CAPACITY)));
+		targets.push_back(queues.back().get());
+	}
+
+	std::vector<std::vector<double>> latencies(WORKERS);
+
+	std::unique_ptr<chan::dispatcher<job>> d;
+	if (dispatch) {
+		d.reset(new chan::dispatcher<job>(targets));
+	}
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < WORKERS; i++) {
+		workers.push_back(std::thread([&, i]() {
+			std::chrono::microseconds service(i == 0 ? 500 : 20);
+
+			job j;
+			while (targets[i]->read(j)) {
+				std::this_thread::sleep_for(service);
+
+				latencies[i].push_back(
+				    std::chrono::duration<double, std::micro>(clock_type::now() - j.enqueued).count());
+			}
+		}));
+	}
+
+	for (int n = 0; n < JOBS; n++) {
+		job j = {clock_type::now()};
+
+		if (dispatch) {
+			*d << j;
+		} else {
+			*targets[n % WORKERS] << j;
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(30));
+	}
+
+	for (int i = 0; i < WORKERS; i++) {
+		targets[i]->close();
+	}
+
+	for (auto& t : workers) {
+		t.join();
+	}
+
+	std::vector<double> all;
+	for (int i = 0; i < WORKERS; i++) {
+		all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+	}
+
+	std::sort(all.begin(), all.end());
+
+	printf(
+	    "%-12s p50: %8.0f us, p99: %8.0f us, max: %8.0f us\n",
+	    name,
+	    all[all.size() / 2],
+	    all[all.size() * 99 / 100],
+	    all.back());
+}
+
+int main() {
+	measure("round robin", false);
+	measure("dispatcher", true);
+}
@@ -0,0 +1,157 @@
+/**
+ * Compares copying a file through a pipeline against cat:
+ *
+ * - cat, run through the shell
+ * - a reader that reads each chunk with read(2) into a freshly allocated
+ * vector, and sends it through a buffered_chan to a writer
+ * - file_source and file_sink, recycling their buffers
+ *
+ * and counts the allocations each pipeline makes. The file is written to
+ * /tmp first, so all of them read it from the page cache.
+ * */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../file_stage.hh"
+
+const size_t FILE_SIZE = 256 << 20;
+const size_t CHUNK_SIZE = 1 << 20;
+const int BUFFERS = 8;
+
+std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations++;
+
+	void* p = malloc(size > 0 ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void report(const char* name, std::chrono::steady_clock::time_point start, uint64_t allocated) {
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf(
+	    "%-22s %zu MB in ms: %.0f (%.0f MB/s), %llu allocations\n",
+	    name, FILE_SIZE >> 20, s * 1000, (FILE_SIZE >> 20) / s,
+	    static_cast<unsigned long long>(allocated));
+}
+
+void measure_cat(const std::string& in, const std::string& out) {
+	std::string cmd = "cat " + in + " > " + out;
+
+	auto start = std::chrono::steady_clock::now();
+	if (system(cmd.c_str()) != 0) {
+		printf("cat failed\n");
+	}
+
+	report("cat", start, 0);
+}
+
+void measure_vectors(const std::string& in, const std::string& out) {
+	int in_fd = open(in.c_str(), O_RDONLY);
+	int out_fd = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	uint64_t before = allocations.load();
+	auto start = std::chrono::steady_clock::now();
+
+	chan::buffered_chan<std::vector<char>> chunks(BUFFERS);
+
+	std::thread writer([&]() {
+		std::vector<char> chunk;
+		while (chunks.read(chunk)) {
+			if (write(out_fd, chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())) {
+				printf("write failed\n");
+			}
+		}
+	});
+
+	while (true) {
+		std::vector<char> chunk(CHUNK_SIZE);
+
+		ssize_t n = read(in_fd, chunk.data(), chunk.size());
+		if (n <= 0) {
+			break;
+		}
+
+		chunk.resize(n);
+		chunks.write(std::move(chunk));
+	}
+
+	chunks.close();
+	writer.join();
+
+	report("read into vectors", start, allocations.load() - before);
+
+	close(in_fd);
+	close(out_fd);
+}
+
+void measure_stages(const std::string& in, const std::string& out) {
+	uint64_t before = allocations.load();
+	auto start = std::chrono::steady_clock::now();
+
+	{
+		chan::buffered_chan<chan::file_chunk> chunks(BUFFERS), recycled(BUFFERS);
+
+		chan::file_source source(in.c_str(), chunks, recycled, CHUNK_SIZE, BUFFERS);
+		chan::file_sink sink(out.c_str(), chunks, recycled);
+
+		sink.join();
+		source.join();
+
+		if (sink.bytes() != FILE_SIZE) {
+			printf("unexpected size\n");
+		}
+	}
+
+	report("file_source/file_sink", start, allocations.load() - before);
+}
+
+int main() {
+	std::string in = "/tmp/file_stage_speed_test_in_" + std::to_string(getpid());
+	std::string out = "/tmp/file_stage_speed_test_out_" + std::to_string(getpid());
+
+	{
+		std::vector<char> block(CHUNK_SIZE, 'x');
+
+		FILE* f = fopen(in.c_str(), "wb");
+		for (size_t i = 0; i < FILE_SIZE; i += CHUNK_SIZE) {
+			fwrite(block.data(), 1, block.size(), f);
+		}
+		fclose(f);
+	}
+
+	// the output is removed before each run, so truncating the previous
+	// one isn't timed
+	for (int round = 0; round < 2; round++) {
+		unlink(out.c_str());
+		measure_cat(in, out);
+
+		unlink(out.c_str());
+		measure_vectors(in, out);
+
+		unlink(out.c_str());
+		measure_stages(in, out);
+	}
+
+	unlink(in.c_str());
+	unlink(out.c_str());
+}
@@ -0,0 +1,95 @@
+/**
+ * Sends integers from a parent process to a forked child, once through an
+ * ipc_chan and once through a unix domain socket pair with a read and a
+ * write call per message.
+ * */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../ipc_chan.hh"
+
+const int RUN_SIZE = 1000000;
+const int CAPACITY = 1024;
+
+void report(const char* name, std::chrono::steady_clock::time_point start) {
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%s: %d send/recv time in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, RUN_SIZE, (unsigned long long)ms, double(RUN_SIZE) / ms);
+}
+
+void measure_ipc_chan() {
+	std::string name = "/chan_ipc_speed_test_" + std::to_string(getpid());
+	chan::ipc_chan<int> c(name, CAPACITY, chan::ipc_role::writer);
+
+	auto start = std::chrono::steady_clock::now();
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		chan::ipc_chan<int> child(name, chan::ipc_role::reader);
+
+		int _ = 0;
+		while (child.read(_)) {
+		}
+
+		_exit(0);
+	}
+
+	for (int i = 0; i < RUN_SIZE; i++) {
+		c << i;
+	}
+
+	c.close();
+	waitpid(pid, nullptr, 0);
+
+	report("ipc_chan", start);
+}
+
+void measure_socket() {
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+		perror("socketpair");
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		::close(fds[0]);
+
+		int _ = 0;
+		while (::read(fds[1], &_, sizeof(_)) == sizeof(_)) {
+		}
+
+		_exit(0);
+	}
+
+	::close(fds[1]);
+
+	for (int i = 0; i < RUN_SIZE; i++) {
+		if (::write(fds[0], &i, sizeof(i)) != sizeof(i)) {
+			perror("write");
+			break;
+		}
+	}
+
+	::close(fds[0]);
+	waitpid(pid, nullptr, 0);
+
+	report("unix socket", start);
+}
+
+int main() {
+	measure_ipc_chan();
+	measure_socket();
+}
@@ -0,0 +1,143 @@
+/**
+ * Compares recycling buffers through an object_pool against a
+ * buffered_chan of free pointers:
+ *
+ * - 1 to 4 threads each taking and returning a buffer in a loop
+ * - a producer taking buffers and sending them to a consumer that returns
+ * them, with fewer buffers than the channel between them holds, so the
+ * producer waits for buffers to come back
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../chan.hh"
+#include "../object_pool.hh"
+
+const int RUN_SIZE = 1000000;
+const int BUFFERS = 64;
+
+struct buffer {
+	char data[256];
+};
+
+void report(const char* name, int threads, std::chrono::steady_clock::time_point start) {
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-26s %d threads, %d*%d in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, threads, threads, RUN_SIZE, static_cast<unsigned long long>(ms),
+	    double(threads) * RUN_SIZE / (ms > 0 ? ms : 1));
+}
+
+template <typename F>
+void measure_loop(const char* name, int threads, F f) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&f]() {
+			for (int i = 0; i < RUN_SIZE; i++) {
+				f();
+			}
+		}));
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	report(name, threads, start);
+}
+
+void measure_pipeline_chan() {
+	std::vector<buffer> storage(BUFFERS / 4);
+	chan::buffered_chan<buffer*> free_buffers(BUFFERS), filled(BUFFERS);
+
+	for (auto& b : storage) {
+		free_buffers << &b;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread consumer([&]() {
+		buffer* b = nullptr;
+		while (filled.read(b)) {
+			free_buffers << b;
+		}
+	});
+
+	for (int i = 0; i < RUN_SIZE; i++) {
+		buffer* b = nullptr;
+		free_buffers >> b;
+		b->data[0] = static_cast<char>(i);
+		filled << b;
+	}
+
+	filled.close();
+	consumer.join();
+
+	report("pipeline buffered_chan", 2, start);
+}
+
+void measure_pipeline_pool() {
+	chan::object_pool<buffer> pool(BUFFERS / 4);
+	chan::buffered_chan<buffer*> filled(BUFFERS);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread consumer([&]() {
+		buffer* b = nullptr;
+		while (filled.read(b)) {
+			pool.put(b);
+		}
+	});
+
+	for (int i = 0; i < RUN_SIZE; i++) {
+		chan::pooled<buffer> b = pool.acquire();
+		b->data[0] = static_cast<char>(i);
+		filled << b.release();
+	}
+
+	filled.close();
+	consumer.join();
+
+	report("pipeline object_pool", 2, start);
+
+	chan::pool_stats stats = pool.stats();
+	printf(
+	    "  %llu waits, %llu ms waiting\n",
+	    static_cast<unsigned long long>(stats.waits),
+	    static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::milliseconds>(stats.wait_time).count()));
+}
+
+int main() {
+	for (int threads = 1; threads <= 4; threads <<= 1) {
+		std::vector<buffer> storage(BUFFERS);
+		chan::buffered_chan<buffer*> free_buffers(BUFFERS);
+		for (auto& b : storage) {
+			free_buffers << &b;
+		}
+
+		measure_loop("buffered_chan", threads, [&free_buffers]() {
+			buffer* b = nullptr;
+			free_buffers >> b;
+			b->data[0]++;
+			free_buffers << b;
+		});
+
+		chan::object_pool<buffer> pool(BUFFERS);
+		measure_loop("object_pool", threads, [&pool]() {
+			chan::pooled<buffer> b = pool.acquire();
+			b->data[0]++;
+		});
+	}
+
+	measure_pipeline_chan();
+	measure_pipeline_pool();
+}
@@ -0,0 +1,168 @@
+/**
+ * The same measurement as promise_speed_test_threads.cc, with
+ * oneshot_chan in place of std::promise, once with channels that are
+ * preallocated like the promises there, and once with channels acquired
+ * from a oneshot_pool for every value and recycled.
+ * */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "../oneshot_chan.hh"
+
+const int MAX_THREADS = 16;
+
+#ifdef __APPLE__
+const int RUN_SIZE = 50000;
+#else
+const int RUN_SIZE = 12500;
+#endif
+
+std::vector<chan::oneshot_chan<int>> oneshots[5]; // log2(16) + 1 = 5
+
+std::future<void> serverThreads[MAX_THREADS];
+std::future<void> clientThreads[MAX_THREADS];
+
+std::chrono::time_point<std::chrono::system_clock> startTimes[MAX_THREADS];
+std::chrono::time_point<std::chrono::system_clock> endTimes[MAX_THREADS];
+
+int _[MAX_THREADS];
+
+void server(chan::oneshot_chan<int>* c, int id) {
+	startTimes[id] = std::chrono::system_clock::now();
+	for (int i = 0; i < RUN_SIZE; i++) {
+		c[i].read(_[id]);
+	}
+}
+
+void client(chan::oneshot_chan<int>* c, int id) {
+	for (int i = 0; i < RUN_SIZE; i++) {
+		c[i].write(i);
+	}
+	endTimes[id] = std::chrono::system_clock::now();
+}
+
+chan::oneshot_pool<int> pool(MAX_THREADS * 1024);
+
+// requests are handed to the client in batches of channels acquired from
+// the pool, and the channels are recycled when the next batch replaces them
+const int BATCH = 1024;
+
+std::vector<chan::oneshot_ref<int>> batches[MAX_THREADS];
+std::atomic<int> published[MAX_THREADS];
+std::atomic<int> acked[MAX_THREADS];
+
+void pooled_server(int id) {
+	startTimes[id] = std::chrono::system_clock::now();
+	for (int b = 0; b * BATCH < RUN_SIZE; b++) {
+		int n = std::min(BATCH, RUN_SIZE - b * BATCH);
+
+		for (int j = 0; j < n; j++) {
+			batches[id][j] = pool.acquire();
+		}
+
+		published[id].store(b + 1);
+
+		for (int j = 0; j < n; j++) {
+			batches[id][j]->read(_[id]);
+		}
+
+		while (acked[id].load() != b + 1) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void pooled_client(int id) {
+	for (int b = 0; b * BATCH < RUN_SIZE; b++) {
+		int n = std::min(BATCH, RUN_SIZE - b * BATCH);
+
+		while (published[id].load() != b + 1) {
+			std::this_thread::yield();
+		}
+
+		for (int j = 0; j < n; j++) {
+			batches[id][j]->write(b * BATCH + j);
+		}
+
+		acked[id].store(b + 1);
+	}
+	endTimes[id] = std::chrono::system_clock::now();
+}
+
+void report(const char* name, int numThreads) {
+	auto smallestStart = startTimes[0];
+	for (int i = 1; i < numThreads; i++) {
+		if (startTimes[i] < smallestStart) {
+			smallestStart = startTimes[i];
+		}
+	}
+
+	auto largestEnd = endTimes[0];
+	for (int i = 1; i < numThreads; i++) {
+		if (endTimes[i] > largestEnd) {
+			largestEnd = endTimes[i];
+		}
+	}
+
+	// these runs are short, so they are timed in microseconds
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+	                  largestEnd - smallestStart)
+	                  .count();
+
+	printf(
+	    "%s: %d*%d send/recv time in ms: %.3f (%f nr_of_msg/msec)\n",
+	    name, numThreads, RUN_SIZE, us / 1000.0, double(numThreads * RUN_SIZE) * 1000 / us);
+}
+
+void measure(int numThreads) {
+	int pain = static_cast<int>(std::log2(numThreads));
+	oneshots[pain] = std::vector<chan::oneshot_chan<int>>(numThreads * RUN_SIZE);
+
+	for (int i = 0; i < numThreads; i++) {
+		chan::oneshot_chan<int>* c = oneshots[pain].data() + i * RUN_SIZE;
+		serverThreads[i] = std::async(std::launch::async, server, c, i);
+		clientThreads[i] = std::async(std::launch::async, client, c, i);
+	}
+
+	for (int i = 0; i < numThreads; i++) {
+		serverThreads[i].wait();
+		clientThreads[i].wait();
+	}
+
+	report("oneshot", numThreads);
+}
+
+void measure_pooled(int numThreads) {
+	for (int i = 0; i < numThreads; i++) {
+		batches[i].resize(BATCH);
+		published[i].store(0);
+		acked[i].store(0);
+	}
+
+	for (int i = 0; i < numThreads; i++) {
+		serverThreads[i] = std::async(std::launch::async, pooled_server, i);
+		clientThreads[i] = std::async(std::launch::async, pooled_client, i);
+	}
+
+	for (int i = 0; i < numThreads; i++) {
+		serverThreads[i].wait();
+		clientThreads[i].wait();
+	}
+
+	report("pooled oneshot", numThreads);
+}
+
+int main() {
+	for (int numThreads = 1; numThreads <= MAX_THREADS; numThreads <<= 1) {
+		measure(numThreads);
+	}
+
+	for (int numThreads = 1; numThreads <= MAX_THREADS; numThreads <<= 1) {
+		measure_pooled(numThreads);
+	}
+}
@@ -0,0 +1,155 @@
+/**
+ * Compares mapping a stream through a slow transform:
+ *
+ * - on a single thread
+ * - on workers reading from and writing to shared channels, which loses
+ * the order
+ * - with parallel_map_stage, which keeps it
+ *
+ * for a CPU bound transform, whose speedup is bounded by the number of
+ * cores, and for one that mostly waits, like a call to another service,
+ * both taking a varying time per value.
+ * */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../parallel_map.hh"
+
+const int RUN_SIZE = 20000;
+const int WORKERS = 8;
+const int WINDOW = 64;
+const int CHAN_SIZE = 64;
+
+uint64_t spin(const int& x) {
+	uint64_t h = static_cast<uint64_t>(x);
+
+	for (int i = 0; i < 2000 + (x % 5) * 2000; i++) {
+		h = h * 6364136223846793005ull + 1442695040888963407ull;
+	}
+
+	return h;
+}
+
+uint64_t wait(const int& x) {
+	std::this_thread::sleep_for(std::chrono::microseconds(50 + (x % 5) * 50));
+	return static_cast<uint64_t>(x);
+}
+
+void report(const char* name, const char* transform, std::chrono::steady_clock::time_point start, bool ordered) {
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-20s %-5s %d values in ms: %llu (%f nr_of_msg/msec)%s\n",
+	    name, transform, RUN_SIZE, static_cast<unsigned long long>(ms),
+	    double(RUN_SIZE) / (ms > 0 ? ms : 1), ordered ? "" : ", out of order");
+}
+
+void produce(chan::buffered_chan<int>& in) {
+	for (int i = 0; i < RUN_SIZE; i++) {
+		in << i;
+	}
+	in.close();
+}
+
+void measure_single(const char* transform, std::function<uint64_t(const int&)> f) {
+	chan::buffered_chan<int> in(CHAN_SIZE);
+	chan::buffered_chan<uint64_t> out(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer(produce, std::ref(in));
+	std::thread worker([&]() {
+		int x = 0;
+		while (in.read(x)) {
+			out << f(x);
+		}
+		out.close();
+	});
+
+	uint64_t y = 0;
+	while (out.read(y)) {
+	}
+
+	producer.join();
+	worker.join();
+
+	report("single thread", transform, start, true);
+}
+
+void measure_unordered(const char* transform, std::function<uint64_t(const int&)> f) {
+	chan::buffered_chan<int> in(CHAN_SIZE);
+	chan::buffered_chan<std::pair<int, uint64_t>> out(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer(produce, std::ref(in));
+
+	std::vector<std::thread> workers;
+	std::atomic<int> running(WORKERS);
+	for (int i = 0; i < WORKERS; i++) {
+		workers.push_back(std::thread([&]() {
+			int x = 0;
+			while (in.read(x)) {
+				out << std::make_pair(x, f(x));
+			}
+
+			if (--running == 0) {
+				out.close();
+			}
+		}));
+	}
+
+	bool ordered = true;
+	int expected = 0;
+
+	std::pair<int, uint64_t> y;
+	while (out.read(y)) {
+		ordered = ordered && y.first == expected++;
+	}
+
+	producer.join();
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	report("unordered workers", transform, start, ordered);
+}
+
+void measure_ordered(const char* transform, std::function<uint64_t(const int&)> f) {
+	chan::buffered_chan<int> in(CHAN_SIZE);
+	chan::buffered_chan<uint64_t> out(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer(produce, std::ref(in));
+	chan::parallel_map_stage<int, uint64_t> stage(in, out, f, WORKERS, WINDOW);
+
+	uint64_t y = 0;
+	while (out.read(y)) {
+	}
+
+	producer.join();
+
+	report("parallel_map_stage", transform, start, true);
+}
+
+int main() {
+	printf("%d workers, %u hardware threads\n", WORKERS, std::thread::hardware_concurrency());
+
+	measure_single("cpu", spin);
+	measure_unordered("cpu", spin);
+	measure_ordered("cpu", spin);
+
+	measure_single("wait", wait);
+	measure_unordered("wait", wait);
+	measure_ordered("wait", wait);
+}
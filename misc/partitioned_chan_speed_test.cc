@@ -0,0 +1,126 @@
+/**
+ * Measures the throughput of a partitioned_chan with 4 producers and one
+ * consumer per partition, against a single buffered_chan shared by the
+ * same number of consumers. Consumers do a little work per value, so
+ * that with enough cores throughput scales with the number of partitions.
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../partitioned_chan.hh"
+
+const int PRODUCERS = 4;
+const int RUN_SIZE = 100000;
+const int CAPACITY = 1024;
+
+struct event {
+	uint64_t account;
+	uint64_t amount;
+};
+
+uint64_t work(const event& e) {
+	uint64_t h = e.amount;
+	for (int i = 0; i < 200; i++) {
+		h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+	}
+
+	return h;
+}
+
+void report(const char* name, int consumers, std::chrono::steady_clock::time_point start) {
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-12s %2d consumers, %d*%d events in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, consumers, PRODUCERS, RUN_SIZE, static_cast<unsigned long long>(ms),
+	    double(PRODUCERS) * RUN_SIZE / (ms > 0 ? ms : 1));
+}
+
+void produce(chan::write_chan<event>& c) {
+	std::vector<std::thread> producers;
+	for (int p = 0; p < PRODUCERS; p++) {
+		producers.push_back(std::thread([&c, p]() {
+			for (int i = 0; i < RUN_SIZE; i++) {
+				event e = {static_cast<uint64_t>(p * RUN_SIZE + i) % 4096, static_cast<uint64_t>(i)};
+				c << e;
+			}
+		}));
+	}
+
+	for (auto& t : producers) {
+		t.join();
+	}
+
+	c.close();
+}
+
+void measure_partitioned(int partitions) {
+	chan::partitioned_chan<event, uint64_t> c(partitions, CAPACITY, [](const event& e) { return e.account; });
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < partitions; i++) {
+		consumers.push_back(std::thread([&c, i]() {
+			event e;
+			uint64_t sum = 0;
+			while (c.partition(i).read(e)) {
+				sum += work(e);
+			}
+
+			if (sum == 1) {
+				printf("unlikely\n");
+			}
+		}));
+	}
+
+	produce(c);
+
+	for (auto& t : consumers) {
+		t.join();
+	}
+
+	report("partitioned", partitions, start);
+}
+
+void measure_shared(int consumers_count) {
+	chan::buffered_chan<event> c(CAPACITY);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < consumers_count; i++) {
+		consumers.push_back(std::thread([&c]() {
+			event e;
+			uint64_t sum = 0;
+			while (c.read(e)) {
+				sum += work(e);
+			}
+
+			if (sum == 1) {
+				printf("unlikely\n");
+			}
+		}));
+	}
+
+	produce(c);
+
+	for (auto& t : consumers) {
+		t.join();
+	}
+
+	report("shared", consumers_count, start);
+}
+
+int main() {
+	for (int n = 1; n <= 16; n <<= 1) {
+		measure_shared(n);
+		measure_partitioned(n);
+	}
+}
@@ -0,0 +1,145 @@
+/**
+ * Compares moving 64 byte POD samples through a circular_queue, and a
+ * buffered_chan between two threads, one element at a time and in bulk
+ * with push_range/pop_range and write_range/read_range.
+ *
+ * Bulk transfers of trivially copyable values use memcpy, so they should
+ * run close to memory bandwidth.
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../chan.hh"
+
+struct sample {
+	uint64_t timestamp;
+	uint32_t source;
+	uint32_t flags;
+	double values[6];
+};
+
+const int QUEUE_SIZE = 64 * 1024;
+const int ROUNDS = 64;
+const int CHUNK = 256;
+
+const int CHAN_SIZE = 4096;
+const int RUN_SIZE = 2000000;
+
+void report(const char* name, std::chrono::steady_clock::time_point start, double elements) {
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf(
+	    "%-24s %.0f samples in ms: %.0f (%f GB/s)\n",
+	    name, elements, s * 1000, elements * sizeof(sample) / s / 1e9);
+}
+
+void measure_queue_single() {
+	chan::circular_queue<sample> queue(QUEUE_SIZE);
+	sample s = sample();
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t sum = 0;
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < QUEUE_SIZE; i++) {
+			s.timestamp = i;
+			queue.push(s);
+		}
+
+		for (int i = 0; i < QUEUE_SIZE; i++) {
+			sum += queue.front().timestamp;
+			queue.pop();
+		}
+	}
+
+	report("queue push/pop", start, double(ROUNDS) * QUEUE_SIZE);
+
+	if (sum == 0) {
+		printf("unexpected sum\n");
+	}
+}
+
+void measure_queue_range() {
+	chan::circular_queue<sample> queue(QUEUE_SIZE);
+	std::vector<sample> in(CHUNK), out(CHUNK);
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t sum = 0;
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < QUEUE_SIZE; i += CHUNK) {
+			in[0].timestamp = i;
+			queue.push_range(in.data(), CHUNK);
+		}
+
+		for (int i = 0; i < QUEUE_SIZE; i += CHUNK) {
+			queue.pop_range(out.data(), CHUNK);
+			sum += out[0].timestamp;
+		}
+	}
+
+	report("queue push/pop_range", start, double(ROUNDS) * QUEUE_SIZE);
+
+	if (sum == 0) {
+		printf("unexpected sum\n");
+	}
+}
+
+void measure_chan_single() {
+	chan::buffered_chan<sample> c(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&c]() {
+		sample s = sample();
+		for (int i = 0; i < RUN_SIZE; i++) {
+			s.timestamp = i;
+			c << s;
+		}
+
+		c.close();
+	});
+
+	sample s;
+	while (c.read(s)) {
+	}
+
+	producer.join();
+
+	report("chan write/read", start, RUN_SIZE);
+}
+
+void measure_chan_range() {
+	chan::buffered_chan<sample> c(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&c]() {
+		std::vector<sample> in(CHUNK);
+		for (int i = 0; i < RUN_SIZE; i += CHUNK) {
+			in[0].timestamp = i;
+			c.write_range(in.data(), CHUNK);
+		}
+
+		c.close();
+	});
+
+	std::vector<sample> out(CHUNK);
+	while (c.read_range(out.data(), CHUNK) > 0) {
+	}
+
+	producer.join();
+
+	report("chan write/read_range", start, RUN_SIZE);
+}
+
+int main() {
+	measure_queue_single();
+	measure_queue_range();
+	measure_chan_single();
+	measure_chan_range();
+}
@@ -0,0 +1,60 @@
+/**
+ * Compares bounding concurrency with a buffered_chan<int> used as a
+ * semaphore, against a token_chan, with 1 to 8 threads each acquiring and
+ * releasing in a loop.
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../token_chan.hh"
+
+const int RUN_SIZE = 1000000;
+const int TOKENS = 4;
+
+template <typename F>
+void measure(const char* name, int threads, F f) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&f]() {
+			for (int i = 0; i < RUN_SIZE; i++) {
+				f();
+			}
+		}));
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-14s %d threads, %d*%d acquire/release in ms: %llu (%f nr_of_msg/msec)\n",
+	    name, threads, threads, RUN_SIZE, static_cast<unsigned long long>(ms),
+	    double(threads) * RUN_SIZE / (ms > 0 ? ms : 1));
+}
+
+int main() {
+	for (int threads = 1; threads <= 8; threads <<= 1) {
+		chan::buffered_chan<int> sem(TOKENS);
+		measure("buffered_chan", threads, [&sem]() {
+			int x = 0;
+			sem.write(x);
+			sem.read(x);
+		});
+
+		chan::token_chan tokens(TOKENS);
+		measure("token_chan", threads, [&tokens]() {
+			tokens.acquire();
+			tokens.release();
+		});
+	}
+}
@@ -0,0 +1,62 @@
+/**
+ * Measures the throughput of buffered and unbuffered channels with 2
+ * writers and 2 readers. The Makefile builds it with and without
+ * -DCHAN_TRACE, to compare the overhead of tracing.
+ * */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../chan.hh"
+
+const int RUN_SIZE = 200000;
+
+#ifdef CHAN_TRACE
+const char* mode = "traced";
+#else
+const char* mode = "untraced";
+#endif
+
+template <typename C>
+void measure(const char* name, C& c, int run_size) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 2; i++) {
+		threads.push_back(std::thread([&c, run_size]() {
+			for (int j = 0; j < run_size; j++) {
+				c << j;
+			}
+		}));
+
+		threads.push_back(std::thread([&c, run_size]() {
+			int x = 0;
+			for (int j = 0; j < run_size; j++) {
+				c >> x;
+			}
+		}));
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	printf(
+	    "%-9s %-10s 2*%d msgs in ms: %llu (%f nr_of_msg/msec)\n",
+	    mode, name, run_size, static_cast<unsigned long long>(ms), 2.0 * run_size / (ms > 0 ? ms : 1));
+}
+
+int main() {
+	chan::buffered_chan<int> buffered(1024);
+	measure("buffered", buffered, RUN_SIZE * 10);
+
+	chan::unbuffered_chan<int> unbuffered;
+	measure("unbuffered", unbuffered, RUN_SIZE);
+}
@@ -0,0 +1,135 @@
+/**
+ * Compares filtering x % 3 == 0 out of a stream of ints the way
+ * examples/filter.cc does, a value per read and write, over unbuffered and
+ * buffered channels, against filter_stage with the scalar, SSE4.1 and
+ * AVX2 kernels.
+ *
+ * Every pipeline has a producer, the filter and a consumer, each on its
+ * own thread, and the producer and consumer of the batched pipelines move
+ * values in bulk with write_range and read_range.
+ *
+ * The speed tests are built without optimization, which hides most of the
+ * difference between the kernels, build with -O2 to compare them.
+ * */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../vector_stage.hh"
+
+const int RUN_SIZE = 20000000;
+const int UNBUFFERED_RUN_SIZE = 200000;
+const int CHAN_SIZE = 4096;
+const int CHUNK = 1024;
+
+void report(const char* name, int n, std::chrono::steady_clock::time_point start, long long sum) {
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf(
+	    "%-22s %d values in ms: %.0f (%f nr_of_msg/msec)\n",
+	    name, n, ms, n / (ms > 0 ? ms : 1));
+
+	long long expected = 0;
+	for (int i = 0; i < n; i += 3) {
+		expected += i;
+	}
+
+	if (sum != expected) {
+		printf("unexpected sum\n");
+	}
+}
+
+template <typename Chan>
+void measure_per_value(const char* name, int n, Chan& in, Chan& out) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&]() {
+		for (int i = 0; i < n; i++) {
+			in << i;
+		}
+		in.close();
+	});
+
+	std::thread filter([&]() {
+		int x = 0;
+		while (in.read(x)) {
+			if (x % 3 == 0) {
+				out << x;
+			}
+		}
+		out.close();
+	});
+
+	long long sum = 0;
+	int x = 0;
+	while (out.read(x)) {
+		sum += x;
+	}
+
+	producer.join();
+	filter.join();
+
+	report(name, n, start, sum);
+}
+
+void measure_stage(chan::simd::level l) {
+	if (chan::simd::use(l) != l) {
+		return;
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "filter_stage %s", chan::simd::name_of(l));
+
+	chan::buffered_chan<int> in(CHAN_SIZE), out(CHAN_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+
+	chan::filter_stage<int, chan::simd::multiple_of<int>> f(in, out, {3}, CHUNK);
+
+	std::thread producer([&]() {
+		std::vector<int> vals(CHUNK);
+
+		for (int i = 0; i < RUN_SIZE; i += CHUNK) {
+			int n = std::min(CHUNK, RUN_SIZE - i);
+
+			for (int j = 0; j < n; j++) {
+				vals[j] = i + j;
+			}
+			in.write_range(vals.data(), n);
+		}
+		in.close();
+	});
+
+	std::vector<int> vals(CHUNK);
+	long long sum = 0;
+	int n = 0;
+	while ((n = out.read_range(vals.data(), CHUNK)) > 0) {
+		for (int i = 0; i < n; i++) {
+			sum += vals[i];
+		}
+	}
+
+	producer.join();
+
+	report(name, RUN_SIZE, start, sum);
+}
+
+int main() {
+	{
+		chan::unbuffered_chan<int> in, out;
+		measure_per_value("per value unbuffered", UNBUFFERED_RUN_SIZE, in, out);
+	}
+
+	{
+		chan::buffered_chan<int> in(CHAN_SIZE), out(CHAN_SIZE);
+		measure_per_value("per value buffered", RUN_SIZE, in, out);
+	}
+
+	measure_stage(chan::simd::level::scalar);
+	measure_stage(chan::simd::level::sse41);
+	measure_stage(chan::simd::level::avx2);
+}
@@ -0,0 +1,88 @@
+/**
+ * Measures throughput and context switches per message through a
+ * buffered_chan with each wake_policy, with bursty producers and a pool of
+ * consumers.
+ *
+ * Context switches are counted with getrusage for the whole process, so
+ * they include both voluntary switches, from blocking on the channel, and
+ * involuntary ones.
+ * */
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../chan.hh"
+
+const int CHAN_SIZE = 1024;
+const int BURST = 256;
+const int RUN_SIZE = 200000;
+const int THREADS = 4;
+
+long context_switches() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+void measure(const char* name, chan::wake_policy policy) {
+	chan::buffered_chan<int> c(CHAN_SIZE, policy);
+
+	long switches = context_switches();
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> producers;
+	for (int i = 0; i < THREADS; i++) {
+		producers.push_back(std::thread([&c]() {
+			for (int sent = 0; sent < RUN_SIZE; sent += BURST) {
+				for (int j = 0; j < BURST; j++) {
+					c << j;
+				}
+
+				// pause between bursts, like a producer waiting on its input
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		}));
+	}
+
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < THREADS; i++) {
+		consumers.push_back(std::thread([&c]() {
+			int x = 0;
+			while (c.read(x)) {
+			}
+		}));
+	}
+
+	for (auto& t : producers) {
+		t.join();
+	}
+
+	c.close();
+
+	for (auto& t : consumers) {
+		t.join();
+	}
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+	                  std::chrono::steady_clock::now() - start)
+	                  .count();
+
+	double messages = double(THREADS) * RUN_SIZE;
+
+	printf(
+	    "%-28s %d*%d messages in ms: %llu (%f context switches/msg)\n",
+	    name, THREADS, RUN_SIZE, static_cast<unsigned long long>(ms),
+	    (context_switches() - switches) / messages);
+}
+
+int main() {
+	measure("every", chan::wake_policy::every());
+	measure("transition", chan::wake_policy::transition());
+	measure("batch(64, 100us)", chan::wake_policy::batch(64, std::chrono::microseconds(100)));
+	measure("window(200us)", chan::wake_policy::window(std::chrono::microseconds(200)));
+}
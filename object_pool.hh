@@ -0,0 +1,510 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include "futex.hh"
+
+namespace chan {
+
+template <typename T>
+class object_pool;
+
+/**
+ * pooled is a handle to an object taken from an object_pool, which returns
+ * it to the pool when destroyed. Handles can be moved but not copied. To
+ * send an object through a channel, release the handle and send the
+ * pointer, the receiver returns it with put, or wraps it again with adopt.
+ * */
+template <typename T>
+class pooled {
+private:
+	friend class object_pool<T>;
+
+	object_pool<T>* pool;
+	T* object;
+
+	pooled(object_pool<T>* pool, T* object) : pool(pool), object(object) {}
+
+public:
+	pooled() : pool(nullptr), object(nullptr) {}
+
+	pooled(pooled&& other) : pool(other.pool), object(other.object) {
+		other.object = nullptr;
+	}
+
+	pooled& operator=(pooled&& other) {
+		std::swap(pool, other.pool);
+		std::swap(object, other.object);
+		return *this;
+	}
+
+	~pooled() {
+		if (object != nullptr) {
+			pool->put(object);
+		}
+	}
+
+	pooled(const pooled& other) = delete;
+	pooled& operator=(const pooled& other) = delete;
+
+	/**
+	 * an empty handle is returned by acquires that time out
+	 * */
+	explicit operator bool() const {
+		return object != nullptr;
+	}
+
+	T& operator*() const {
+		return *object;
+	}
+
+	T* operator->() const {
+		return object;
+	}
+
+	T* get() const {
+		return object;
+	}
+
+	/**
+	 * release detaches the object from the handle, which no longer returns
+	 * it to the pool
+	 * */
+	T* release() {
+		T* result = object;
+		object = nullptr;
+		return result;
+	}
+};
+
+/**
+ * pool_stats counts how an object_pool was used. Only acquires that had
+ * to wait for an object to be returned are timed.
+ * */
+struct pool_stats {
+	uint64_t acquires;
+	uint64_t waits;
+	uint64_t timeouts;
+	std::chrono::nanoseconds wait_time;
+};
+
+/**
+ * object_pool holds a fixed number of objects, created up front, to be
+ * taken, used and returned, like buffers that go around a pipeline, with
+ * less overhead than a pair of channels of pointers.
+ *
+ * Every object is in storage of its own, aligned to a cache line, so
+ * objects used by different threads don't share lines.
+ *
+ * Returned objects go to a small cache, one of a number of stripes that
+ * threads are spread over, and from there to a lock free free list,
+ * a Treiber stack of indices with a tag against ABA. A thread that takes
+ * and returns objects mostly works with its own stripe, and so doesn't
+ * contend with the others. When both are empty, acquire takes objects from
+ * the other stripes, and only then, after yielding a few times, waits on
+ * a futex for an object to be returned. Running out of objects so slows
+ * the producers down instead of allocating more, stats reports how often
+ * that happened, and how long it took.
+ *
+ * The pool must outlive the objects taken from it.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::object_pool<std::vector<char>> buffers(64, 1 << 16);
+ * chan::buffered_chan<std::vector<char>*> filled(64);
+ *
+ * // producer
+ * chan::pooled<std::vector<char>> b = buffers.acquire();
+ * fill(*b);
+ * filled << b.release();
+ *
+ * // consumer
+ * std::vector<char>* p = nullptr;
+ * while (filled.read(p)) {
+ * 	consume(*p);
+ * 	buffers.put(p);
+ * }
+ * ```
+ * */
+template <typename T>
+class object_pool {
+private:
+	static const uint32_t nil = UINT32_MAX;
+	static const uint32_t cache_size = 8;
+	static const int spin_limit = 16;
+
+	struct alignas(64) slot {
+		T value;
+		std::atomic<uint32_t> next;
+
+		template <typename... Args>
+		explicit slot(Args&&... args) : value(std::forward<Args>(args)...), next(nil) {}
+	};
+
+	struct alignas(64) stripe {
+		std::atomic<bool> busy;
+		uint32_t count;
+		uint32_t items[cache_size];
+
+		std::atomic<uint64_t> acquires;
+
+		stripe() : busy(false), count(0), acquires(0) {}
+
+		bool try_lock() {
+			return !busy.load(std::memory_order_relaxed) && !busy.exchange(true, std::memory_order_acquire);
+		}
+
+		void lock() {
+			for (int spins = 0; !try_lock(); spins++) {
+				if (spins > 16) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		void unlock() {
+			busy.store(false, std::memory_order_release);
+		}
+	};
+
+	size_t count;
+	void* storage;
+	slot* slots;
+
+	uint32_t stripe_count;
+	void* stripe_storage;
+	stripe* stripes;
+
+	// the index of the first free slot in the low half, and a tag that
+	// changes with every update in the high half
+	std::atomic<uint64_t> head;
+
+	// bumped when an object is returned while acquires are waiting
+	std::atomic<uint32_t> returned;
+	std::atomic<int> waiting;
+
+	std::atomic<uint64_t> waits;
+	std::atomic<uint64_t> timeouts;
+	std::atomic<uint64_t> wait_ns;
+
+	static uint32_t thread_index() {
+		static std::atomic<uint32_t> next_thread(0);
+		static thread_local uint32_t index = next_thread.fetch_add(1);
+
+		return index;
+	}
+
+	stripe& local() {
+		return stripes[thread_index() & (stripe_count - 1)];
+	}
+
+	uint32_t index_of(T* object) const {
+		return static_cast<uint32_t>((reinterpret_cast<char*>(object) - reinterpret_cast<char*>(slots)) / sizeof(slot));
+	}
+
+	/**
+	 * aligned rounds p up to a cache line, operator new only guarantees
+	 * the alignment of fundamental types
+	 * */
+	static void* aligned(void* p) {
+		return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(p) + 63) & ~static_cast<uintptr_t>(63));
+	}
+
+	uint32_t pop() {
+		uint64_t h = head.load(std::memory_order_acquire);
+
+		while (true) {
+			uint32_t index = static_cast<uint32_t>(h);
+			if (index == nil) {
+				return nil;
+			}
+
+			uint64_t next = slots[index].next.load(std::memory_order_relaxed);
+			uint64_t fresh = (((h >> 32) + 1) << 32) | next;
+
+			if (head.compare_exchange_weak(h, fresh, std::memory_order_acquire)) {
+				return index;
+			}
+		}
+	}
+
+	void push(uint32_t index) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		uint64_t fresh;
+
+		do {
+			slots[index].next.store(static_cast<uint32_t>(h), std::memory_order_relaxed);
+			fresh = (((h >> 32) + 1) << 32) | index;
+		} while (!head.compare_exchange_weak(h, fresh, std::memory_order_release));
+	}
+
+	/**
+	 * take finds a free object, in the thread's stripe, then in the free
+	 * list, then in the other stripes
+	 * */
+	uint32_t take() {
+		stripe& s = local();
+		uint32_t index = nil;
+
+		if (s.try_lock()) {
+			if (s.count > 0) {
+				index = s.items[--s.count];
+			}
+			s.unlock();
+
+			if (index != nil) {
+				return index;
+			}
+		}
+
+		index = pop();
+		if (index != nil) {
+			return index;
+		}
+
+		for (uint32_t i = 0; i < stripe_count && index == nil; i++) {
+			stripe& other = stripes[i];
+
+			other.lock();
+			if (other.count > 0) {
+				index = other.items[--other.count];
+			}
+			other.unlock();
+		}
+
+		return index;
+	}
+
+	void record_wait(std::chrono::steady_clock::time_point start) {
+		wait_ns.fetch_add(
+		    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+		    std::memory_order_relaxed);
+	}
+
+	/**
+	 * wait_for_object waits until an object is free, or the deadline passes
+	 * */
+	uint32_t wait_for_object(const std::chrono::steady_clock::time_point* deadline) {
+		auto start = std::chrono::steady_clock::now();
+		waits.fetch_add(1, std::memory_order_relaxed);
+
+		// objects usually come back soon, give their owners a chance to
+		// return one before registering as a waiter, which makes every put
+		// wake someone up
+		uint32_t index = nil;
+		for (int spins = 0; spins < spin_limit; spins++) {
+			std::this_thread::yield();
+
+			index = take();
+			if (index != nil) {
+				record_wait(start);
+				return index;
+			}
+
+			if (deadline != nullptr && std::chrono::steady_clock::now() >= *deadline) {
+				break;
+			}
+		}
+
+		waiting.fetch_add(1);
+
+		while (true) {
+			uint32_t r = returned.load();
+
+			index = take();
+			if (index != nil) {
+				break;
+			}
+
+			if (deadline == nullptr) {
+				futex_wait(&returned, r);
+				continue;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			if (now >= *deadline || !futex_wait_for(&returned, r, *deadline - now)) {
+				index = take();
+				if (index == nil) {
+					timeouts.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				break;
+			}
+		}
+
+		waiting.fetch_sub(1);
+
+		record_wait(start);
+		return index;
+	}
+
+	pooled<T> acquire_until(const std::chrono::steady_clock::time_point* deadline, bool wait) {
+		local().acquires.fetch_add(1, std::memory_order_relaxed);
+
+		uint32_t index = take();
+		if (index == nil && wait) {
+			index = wait_for_object(deadline);
+		}
+
+		if (index == nil) {
+			return pooled<T>();
+		}
+
+		return pooled<T>(this, &slots[index].value);
+	}
+
+public:
+	/**
+	 * @param   n      size_t    the number of objects
+	 * @param   args   Args...   the arguments every object is constructed with
+	 * */
+	template <typename... Args>
+	explicit object_pool(size_t n, const Args&... args)
+	    : count(n), stripe_count(1), head(nil), returned(0), waiting(0), waits(0), timeouts(0), wait_ns(0) {
+		unsigned threads = std::thread::hardware_concurrency();
+		while (stripe_count < threads && stripe_count < 64) {
+			stripe_count <<= 1;
+		}
+
+		storage = ::operator new(n * sizeof(slot) + 64);
+		slots = static_cast<slot*>(aligned(storage));
+
+		size_t constructed = 0;
+		try {
+			for (; constructed < n; constructed++) {
+				new (&slots[constructed]) slot(args...);
+			}
+		} catch (...) {
+			for (size_t i = 0; i < constructed; i++) {
+				slots[i].~slot();
+			}
+
+			::operator delete(storage);
+			throw;
+		}
+
+		stripe_storage = ::operator new(stripe_count * sizeof(stripe) + 64);
+		stripes = static_cast<stripe*>(aligned(stripe_storage));
+
+		for (uint32_t i = 0; i < stripe_count; i++) {
+			new (&stripes[i]) stripe();
+		}
+
+		for (size_t i = n; i > 0; i--) {
+			push(static_cast<uint32_t>(i - 1));
+		}
+	}
+
+	/**
+	 * The destructor destroys all the objects, they must all have been
+	 * returned
+	 * */
+	~object_pool() {
+		for (size_t i = 0; i < count; i++) {
+			slots[i].~slot();
+		}
+
+		for (uint32_t i = 0; i < stripe_count; i++) {
+			stripes[i].~stripe();
+		}
+
+		::operator delete(storage);
+		::operator delete(stripe_storage);
+	}
+
+	object_pool(const object_pool& other) = delete;
+	object_pool& operator=(const object_pool& other) = delete;
+
+	size_t size() const {
+		return count;
+	}
+
+	/**
+	 * acquire takes an object, blocking while all of them are in use
+	 * */
+	pooled<T> acquire() {
+		return acquire_until(nullptr, true);
+	}
+
+	/**
+	 * acquire_for takes an object, waiting at most timeout for one to be
+	 * returned
+	 *
+	 *
+	 * @return   pooled<T>   the object, or an empty handle on timeout
+	 * */
+	pooled<T> acquire_for(std::chrono::nanoseconds timeout) {
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		return acquire_until(&deadline, true);
+	}
+
+	/**
+	 * try_acquire takes an object if one is free, without blocking
+	 * */
+	pooled<T> try_acquire() {
+		return acquire_until(nullptr, false);
+	}
+
+	/**
+	 * adopt wraps an object released from a handle into a new handle
+	 * */
+	pooled<T> adopt(T* object) {
+		return pooled<T>(this, object);
+	}
+
+	/**
+	 * put returns an object released from a handle. The object keeps its
+	 * state, whoever takes it next resets it as needed.
+	 * */
+	void put(T* object) {
+		uint32_t index = index_of(object);
+
+		// waiting acquires look in the free list first
+		bool cached = false;
+
+		if (waiting.load() == 0) {
+			stripe& s = local();
+
+			if (s.try_lock()) {
+				if (s.count < cache_size) {
+					s.items[s.count++] = index;
+					cached = true;
+				}
+				s.unlock();
+			}
+		}
+
+		if (!cached) {
+			push(index);
+		}
+
+		if (waiting.load() > 0) {
+			returned.fetch_add(1);
+			futex_wake(&returned, 1);
+		}
+	}
+
+	pool_stats stats() const {
+		pool_stats result;
+
+		result.acquires = 0;
+		for (uint32_t i = 0; i < stripe_count; i++) {
+			result.acquires += stripes[i].acquires.load(std::memory_order_relaxed);
+		}
+
+		result.waits = waits.load(std::memory_order_relaxed);
+		result.timeouts = timeouts.load(std::memory_order_relaxed);
+		result.wait_time = std::chrono::nanoseconds(wait_ns.load(std::memory_order_relaxed));
+
+		return result;
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chan.hh"
+#include "object_pool.hh"
+
+TEST(object_pool, acquire_and_return) {
+	chan::object_pool<std::string> pool(3, "initial");
+
+	std::set<std::string*> seen;
+	{
+		chan::pooled<std::string> a = pool.acquire();
+		chan::pooled<std::string> b = pool.acquire();
+		chan::pooled<std::string> c = pool.acquire();
+
+		ASSERT_EQ("initial", *a);
+		ASSERT_EQ(7u, b->size());
+
+		for (std::string* p : {a.get(), b.get(), c.get()}) {
+			ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(p) % 64);
+			seen.insert(p);
+		}
+
+		ASSERT_FALSE(pool.try_acquire());
+		*a = "changed";
+	}
+
+	ASSERT_EQ(3u, seen.size());
+
+	// objects keep their state
+	std::vector<chan::pooled<std::string>> all;
+	for (int i = 0; i < 3; i++) {
+		all.push_back(pool.acquire());
+		ASSERT_EQ(1u, seen.count(all.back().get()));
+	}
+
+	int changed = 0;
+	for (auto& p : all) {
+		changed += *p == "changed";
+	}
+	ASSERT_EQ(1, changed);
+}
+
+TEST(object_pool, release_and_put) {
+	chan::object_pool<int> pool(1);
+	chan::buffered_chan<int*> filled(1);
+
+	chan::pooled<int> p = pool.acquire();
+	*p = 42;
+	filled << p.release();
+	ASSERT_FALSE(p);
+
+	ASSERT_FALSE(pool.try_acquire());
+
+	int* raw = nullptr;
+	filled >> raw;
+	ASSERT_EQ(42, *raw);
+	pool.put(raw);
+
+	chan::pooled<int> again = pool.try_acquire();
+	ASSERT_TRUE(again);
+
+	chan::pooled<int> adopted = pool.adopt(again.release());
+	ASSERT_EQ(42, *adopted);
+}
+
+TEST(object_pool, timeout) {
+	chan::object_pool<int> pool(1);
+	chan::pooled<int> held = pool.acquire();
+
+	auto start = std::chrono::steady_clock::now();
+	chan::pooled<int> p = pool.acquire_for(std::chrono::milliseconds(20));
+
+	ASSERT_FALSE(p);
+	ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+	chan::pool_stats stats = pool.stats();
+	ASSERT_EQ(2u, stats.acquires);
+	ASSERT_EQ(1u, stats.waits);
+	ASSERT_EQ(1u, stats.timeouts);
+	ASSERT_GE(stats.wait_time, std::chrono::milliseconds(20));
+}
+
+TEST(object_pool, blocks_until_returned) {
+	chan::object_pool<int> pool(1);
+	chan::pooled<int> held = pool.acquire();
+
+	std::atomic<bool> acquired(false);
+	std::thread waiter([&](){
+		chan::pooled<int> p = pool.acquire();
+		acquired = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_FALSE(acquired.load());
+
+	held = chan::pooled<int>();
+	waiter.join();
+
+	ASSERT_TRUE(acquired.load());
+	ASSERT_EQ(1u, pool.stats().waits);
+	ASSERT_EQ(0u, pool.stats().timeouts);
+}
+
+TEST(object_pool, bounded_under_contention) {
+	const int threads = 4;
+	const int rounds = 20000;
+
+	chan::object_pool<int> pool(3, 0);
+	std::atomic<int> in_use(0);
+	std::atomic<int> most(0);
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&](){
+			for (int i = 0; i < rounds; i++) {
+				chan::pooled<int> p = pool.acquire();
+
+				int now = ++in_use;
+				int seen = most.load();
+				while (now > seen && !most.compare_exchange_weak(seen, now)) {
+				}
+
+				(*p)++;
+				in_use--;
+			}
+		}));
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	ASSERT_LE(most.load(), 3);
+
+	// every object is back, with the count of its uses
+	std::vector<chan::pooled<int>> all;
+	int uses = 0;
+	for (int i = 0; i < 3; i++) {
+		all.push_back(pool.try_acquire());
+		ASSERT_TRUE(all.back());
+		uses += *all.back();
+	}
+
+	ASSERT_EQ(threads * rounds, uses);
+}
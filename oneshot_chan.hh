@@ -0,0 +1,429 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "chan.hh"
+#include "futex.hh"
+
+namespace chan {
+
+struct oneshot_chan_used_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot write more than one value to a oneshot channel";
+	}
+} _oneshot_chan_used_exception;
+
+/**
+ * oneshot_chan carries exactly one value from one writer to one reader,
+ * like a std::promise and std::future pair, for request/reply.
+ *
+ * The value is stored inline and the whole synchronization is a single
+ * atomic state word. The reader spins briefly and then parks on a futex,
+ * and the writer only makes a system call if the reader is parked. There
+ * is no allocation, mutex or condition variable per value, and channels
+ * can be recycled through a oneshot_pool.
+ *
+ * After the value is read, further reads return false, as do reads of a
+ * channel closed without a value.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::oneshot_chan<int> reply;
+ *
+ * std::thread t([&](){ reply << 42; });
+ *
+ * int x = 0;
+ * reply >> x;
+ * ```
+ * */
+template <typename T>
+class oneshot_chan : public read_chan<T>, public write_chan<T> {
+private:
+	template <typename U>
+	friend class oneshot_pool;
+
+	static const int spin_limit = 128;
+
+	enum : uint32_t {
+		// a writer has claimed the channel
+		writing = 1,
+		// the value is available
+		value = 2,
+		closed = 4,
+		// the reader is parked on the futex
+		waiting = 8,
+		// the value was read
+		taken = 16,
+		// the reader's context was cancelled, only changes the word so the
+		// reader's futex wait returns
+		kicked = 32,
+	};
+
+	std::atomic<uint32_t> state;
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+	T* slot() {
+		return reinterpret_cast<T*>(&storage);
+	}
+
+	/**
+	 * settled checks if a read doesn't need to wait any more, because the
+	 * value is there, or the channel was closed without one being written
+	 * */
+	static bool settled(uint32_t s) {
+		return (s & value) != 0 || ((s & closed) != 0 && (s & writing) == 0);
+	}
+
+	/**
+	 * kicker wakes up the reader when its context is cancelled
+	 * */
+	struct kicker : public context_listener {
+		oneshot_chan* c;
+
+		explicit kicker(oneshot_chan* c) : c(c) {}
+
+		void on_cancel() {
+			c->state.fetch_or(kicked);
+			futex_wake(&c->state);
+		}
+	};
+
+	/**
+	 * publish sets a bit that settles the channel, waking the reader if it
+	 * is parked, and returns the previous state
+	 * */
+	uint32_t publish(uint32_t bit) {
+		uint32_t old = state.fetch_or(bit);
+
+		if ((old & waiting) != 0) {
+			futex_wake(&state);
+		}
+
+		return old;
+	}
+
+	bool consume(T& valref, uint32_t s) {
+		if ((s & value) == 0 || (s & taken) != 0) {
+			valref = T();
+			return false;
+		}
+
+		valref = std::move(*slot());
+		state.fetch_or(taken);
+
+		return true;
+	}
+
+	bool read_with(T& valref, context* ctx) {
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		uint32_t s = state.load(std::memory_order_acquire);
+
+		for (int spins = 0; !settled(s) && spins < spin_limit; spins++) {
+			s = state.load(std::memory_order_acquire);
+		}
+
+		if (settled(s)) {
+			return consume(valref, s);
+		}
+
+		kicker k(this);
+		if (ctx != nullptr && !ctx->add(&k)) {
+			ctx->check();
+		}
+
+		context::clock::time_point deadline = ctx != nullptr ? ctx->deadline() : context::clock::time_point::max();
+
+		while (!settled(s = state.fetch_or(waiting) | waiting)) {
+			if (ctx != nullptr && ctx->done()) {
+				break;
+			}
+
+			if (deadline == context::clock::time_point::max()) {
+				futex_wait(&state, s);
+			} else {
+				context::clock::time_point now = context::clock::now();
+				if (now < deadline) {
+					futex_wait_for(&state, s, deadline - now);
+				}
+			}
+		}
+
+		if (ctx != nullptr) {
+			ctx->remove(&k);
+
+			if (!settled(s)) {
+				ctx->check();
+				throw _context_cancelled_exception;
+			}
+		}
+
+		return consume(valref, s);
+	}
+
+	void reset() {
+		if ((state.load() & value) != 0) {
+			slot()->~T();
+		}
+
+		state.store(0);
+	}
+
+public:
+	oneshot_chan() : state(0) {}
+
+	~oneshot_chan() {
+		if ((state.load() & value) != 0) {
+			slot()->~T();
+		}
+	}
+
+	oneshot_chan(const oneshot_chan& other) = delete;
+	oneshot_chan& operator=(const oneshot_chan& other) = delete;
+
+	/**
+	 * close closes the channel, a reader waiting for a value that was never
+	 * written gets false
+	 * */
+	bool close() {
+		if ((publish(closed) & closed) != 0) {
+			throw _channel_closed_exception;
+		}
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return (state.load() & closed) != 0;
+	}
+
+	/**
+	 * ready checks if a read would return without waiting
+	 * */
+	bool ready() const {
+		return settled(state.load(std::memory_order_acquire));
+	}
+
+	/**
+	 * write stores the value and wakes up the reader. It throws
+	 * oneshot_chan_used_exception if a value was already written, and
+	 * closed_channel_write_exception if the channel was closed.
+	 *
+	 *
+	 * @param   val   const T&   the value to send
+	 * */
+	void write(const T& val) {
+		uint32_t old = state.fetch_or(writing);
+
+		if ((old & writing) != 0) {
+			throw _oneshot_chan_used_exception;
+		}
+
+		if ((old & closed) != 0) {
+			// a reader that saw the claim waits for the value, so it must be
+			// woken up once the claim is dropped
+			if ((state.fetch_and(~static_cast<uint32_t>(writing)) & waiting) != 0) {
+				futex_wake(&state);
+			}
+
+			throw _closed_channel_write_exception;
+		}
+
+		new (slot()) T(val);
+		publish(value);
+	}
+
+	/**
+	 * read waits for the value and moves it out
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value
+	 *
+	 * @return           bool  true if the value was read, false if the
+	 *                         channel was closed without one, or it was
+	 *                         already read
+	 * */
+	bool read(T& valref) {
+		return read_with(valref, nullptr);
+	}
+
+	bool read(T& valref, context& ctx) {
+		return read_with(valref, &ctx);
+	}
+
+	/**
+	 * try_read reads the value if it is available, without waiting
+	 * */
+	bool try_read(T& valref) {
+		uint32_t s = state.load(std::memory_order_acquire);
+
+		if (!settled(s)) {
+			return false;
+		}
+
+		return consume(valref, s);
+	}
+};
+
+template <typename T>
+class oneshot_pool;
+
+/**
+ * oneshot_ref is a reference counted handle to a oneshot_chan from a
+ * oneshot_pool, typically one is held by the requester and one by the
+ * replier. When the last handle goes away the channel is reset and
+ * returned to the pool.
+ * */
+template <typename T>
+class oneshot_ref {
+private:
+	template <typename U>
+	friend class oneshot_pool;
+
+	struct node {
+		oneshot_chan<T> c;
+		std::atomic<int> refs;
+		oneshot_pool<T>* pool;
+	};
+
+	node* n;
+
+	explicit oneshot_ref(node* n) : n(n) {}
+
+	void release() {
+		if (n != nullptr && n->refs.fetch_sub(1) == 1) {
+			n->pool->recycle(n);
+		}
+
+		n = nullptr;
+	}
+
+public:
+	oneshot_ref() : n(nullptr) {}
+
+	oneshot_ref(const oneshot_ref& other) : n(other.n) {
+		if (n != nullptr) {
+			n->refs.fetch_add(1);
+		}
+	}
+
+	oneshot_ref(oneshot_ref&& other) : n(other.n) {
+		other.n = nullptr;
+	}
+
+	oneshot_ref& operator=(oneshot_ref other) {
+		std::swap(n, other.n);
+		return *this;
+	}
+
+	~oneshot_ref() { release(); }
+
+	oneshot_chan<T>& operator*() const { return n->c; }
+	oneshot_chan<T>* operator->() const { return &n->c; }
+
+	explicit operator bool() const { return n != nullptr; }
+};
+
+/**
+ * oneshot_pool recycles oneshot channels, so that request/reply doesn't
+ * allocate once the pool has warmed up. Channels are handed out as
+ * oneshot_refs. The pool must outlive every handle.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::oneshot_pool<int> pool;
+ *
+ * chan::oneshot_ref<int> reply = pool.acquire();
+ * requests << request{..., reply};
+ *
+ * int x = 0;
+ * reply->read(x);
+ * ```
+ * */
+template <typename T>
+class oneshot_pool {
+private:
+	template <typename U>
+	friend class oneshot_ref;
+
+	typedef typename oneshot_ref<T>::node node;
+
+	std::mutex mutex;
+	std::vector<node*> free_nodes;
+	size_t max_free;
+
+	void recycle(node* n) {
+		n->c.reset();
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (free_nodes.size() < max_free) {
+			free_nodes.push_back(n);
+			return;
+		}
+
+		lock.unlock();
+		delete n;
+	}
+
+public:
+	/**
+	 * @param   max_free   size_t   the maximum number of idle channels kept
+	 * */
+	explicit oneshot_pool(size_t max_free = 1024) : max_free(max_free) {}
+
+	~oneshot_pool() {
+		for (size_t i = 0; i < free_nodes.size(); i++) {
+			delete free_nodes[i];
+		}
+	}
+
+	oneshot_pool(const oneshot_pool& other) = delete;
+	oneshot_pool& operator=(const oneshot_pool& other) = delete;
+
+	/**
+	 * acquire returns a fresh channel
+	 * */
+	oneshot_ref<T> acquire() {
+		node* n = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (!free_nodes.empty()) {
+				n = free_nodes.back();
+				free_nodes.pop_back();
+			}
+		}
+
+		if (n == nullptr) {
+			n = new node();
+			n->pool = this;
+		}
+
+		n->refs.store(1);
+		return oneshot_ref<T>(n);
+	}
+
+	/**
+	 * idle returns the number of channels waiting to be reused
+	 * */
+	size_t idle() {
+		std::unique_lock<std::mutex> lock(mutex);
+		return free_nodes.size();
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "oneshot_chan.hh"
+
+TEST(oneshot_chan, send_recv) {
+	chan::oneshot_chan<std::string> c;
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		c << "reply";
+	});
+
+	std::string x;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ("reply", x);
+
+	// there is only one value
+	ASSERT_FALSE(c.read(x));
+	ASSERT_THROW(c.write("again"), chan::oneshot_chan_used_exception);
+
+	t.join();
+}
+
+TEST(oneshot_chan, close_without_value) {
+	chan::oneshot_chan<int> c;
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		c.close();
+	});
+
+	int x = 0;
+	ASSERT_FALSE(c.read(x));
+	ASSERT_THROW(c.write(1), chan::closed_channel_write_exception);
+
+	t.join();
+}
+
+TEST(oneshot_chan, try_read) {
+	chan::oneshot_chan<int> c;
+
+	int x = 0;
+	ASSERT_FALSE(c.ready());
+	ASSERT_FALSE(c.try_read(x));
+
+	c << 7;
+
+	ASSERT_TRUE(c.ready());
+	ASSERT_TRUE(c.try_read(x));
+	ASSERT_EQ(7, x);
+}
+
+TEST(oneshot_chan, context) {
+	chan::oneshot_chan<int> c;
+	chan::context ctx;
+
+	std::thread t([&](){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		ctx.cancel();
+	});
+
+	int x = 0;
+	ASSERT_THROW(c.read(x, ctx), chan::context_cancelled_exception);
+
+	t.join();
+
+	chan::context root;
+	chan::context deadline(root, std::chrono::milliseconds(10));
+	ASSERT_THROW(c.read(x, deadline), chan::context_deadline_exceeded_exception);
+
+	// the reply can still arrive afterwards
+	c << 1;
+	ASSERT_TRUE(c.read(x));
+	ASSERT_EQ(1, x);
+}
+
+TEST(oneshot_chan, pool) {
+	chan::oneshot_pool<std::shared_ptr<int>> pool(4);
+
+	std::shared_ptr<int> value = std::make_shared<int>(1);
+
+	for (int i = 0 ; i < 100 ; i++) {
+		chan::oneshot_ref<std::shared_ptr<int>> reply = pool.acquire();
+		chan::oneshot_ref<std::shared_ptr<int>> replier = reply;
+
+		std::thread t([replier, &value](){
+			replier->write(value);
+		});
+
+		std::shared_ptr<int> x;
+		ASSERT_TRUE(reply->read(x));
+		ASSERT_EQ(1, *x);
+
+		t.join();
+	}
+
+	// the channel was recycled, and the values it held were destroyed
+	ASSERT_EQ(1u, pool.idle());
+	ASSERT_EQ(1, value.use_count());
+
+	// unread values are destroyed when the channel is recycled
+	{
+		chan::oneshot_ref<std::shared_ptr<int>> reply = pool.acquire();
+		reply->write(value);
+		ASSERT_EQ(2, value.use_count());
+	}
+
+	ASSERT_EQ(1, value.use_count());
+}
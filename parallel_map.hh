@@ -0,0 +1,224 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "chan.hh"
+
+namespace chan {
+
+/**
+ * parallel_map_stage is a pipeline stage that applies f to the values read
+ * from a channel on a number of worker threads, and writes the results to
+ * another channel in the order the values were read, for transforms too
+ * slow for one thread whose consumers need the original order.
+ *
+ * Each value gets a sequence number when it is read. Results that finish
+ * early wait in a reorder window until the ones before them are written,
+ * and the worker that finishes the oldest outstanding value writes it, and
+ * every result after it that is ready. The window holds a fixed number of
+ * values, workers only read when the oldest value not yet written is
+ * within window of the next one, so a slow value stalls the reading
+ * instead of letting the window grow, and a slow consumer slows down the
+ * workers.
+ *
+ * When the input is closed and drained, and every result is written, the
+ * output is closed. If the output is closed, the stage stops, after the
+ * values the workers are busy with. f must not throw.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<image> in(64);
+ * chan::buffered_chan<thumbnail> out(64);
+ *
+ * chan::parallel_map_stage<image, thumbnail> resize(in, out, make_thumbnail, 8, 64);
+ * ```
+ * */
+template <typename In, typename Out>
+class parallel_map_stage {
+private:
+	read_chan<In>& in;
+	write_chan<Out>& out;
+
+	std::function<Out(const In&)> f;
+
+	// held while reading, so values are numbered in the order they are read
+	std::mutex read_mutex;
+
+	// guards everything below
+	std::mutex state_mutex;
+	std::condition_variable window_available;
+
+	uint64_t next_seq;
+	uint64_t next_write;
+
+	// results by sequence number modulo the window size
+	std::vector<Out> results;
+	std::vector<bool> ready;
+
+	bool writing;
+	bool stopped;
+	int running;
+
+	std::vector<std::thread> workers;
+
+	/**
+	 * read takes the next value once the window has room for it, and
+	 * returns false at the end of the input, or if the stage stopped
+	 * */
+	bool read(In& val, uint64_t& seq) {
+		std::unique_lock<std::mutex> read_lock(read_mutex);
+
+		{
+			std::unique_lock<std::mutex> state_lock(state_mutex);
+
+			while (!stopped && next_seq - next_write >= results.size()) {
+				window_available.wait(state_lock);
+			}
+
+			if (stopped) {
+				return false;
+			}
+		}
+
+		// only the reader advances next_seq, so the room stays
+		if (!in.read(val)) {
+			return false;
+		}
+
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+		seq = next_seq++;
+
+		return true;
+	}
+
+	/**
+	 * finish stores a result, and if it is the oldest outstanding one,
+	 * writes it and all the ready results after it. Only one worker writes
+	 * at a time, the others leave their results to it.
+	 * */
+	void finish(uint64_t seq, Out&& result) {
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		size_t pos = seq % results.size();
+		results[pos] = std::move(result);
+		ready[pos] = true;
+
+		if (writing || seq != next_write) {
+			return;
+		}
+
+		writing = true;
+
+		while (!stopped && ready[next_write % results.size()]) {
+			pos = next_write % results.size();
+
+			Out val = std::move(results[pos]);
+			ready[pos] = false;
+
+			// the slot is free as soon as the value is taken, but the window
+			// only moves once it is written, to bound what is in flight
+			state_lock.unlock();
+
+			bool written = true;
+			try {
+				out.write(std::move(val));
+			} catch (closed_channel_write_exception&) {
+				written = false;
+			}
+
+			state_lock.lock();
+
+			if (!written) {
+				stopped = true;
+			}
+
+			next_write++;
+			window_available.notify_all();
+		}
+
+		writing = false;
+	}
+
+	void run() {
+		In val;
+		uint64_t seq = 0;
+
+		while (read(val, seq)) {
+			finish(seq, f(val));
+		}
+
+		std::unique_lock<std::mutex> state_lock(state_mutex);
+
+		if (--running > 0) {
+			return;
+		}
+
+		state_lock.unlock();
+
+		try {
+			out.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+public:
+	/**
+	 * @param   in        read_chan<In>&                  the channel to read from
+	 * @param   out       write_chan<Out>&                the channel results are written to
+	 * @param   f         std::function<Out(const In&)>   the transform
+	 * @param   threads   int                             the number of workers
+	 * @param   window    int                             the most values between the oldest not yet written and the newest read
+	 * */
+	parallel_map_stage(
+	    read_chan<In>& in,
+	    write_chan<Out>& out,
+	    std::function<Out(const In&)> f,
+	    int threads,
+	    int window)
+	    : in(in),
+	      out(out),
+	      f(std::move(f)),
+	      next_seq(0),
+	      next_write(0),
+	      results(window > 0 ? window : 1),
+	      ready(window > 0 ? window : 1, false),
+	      writing(false),
+	      stopped(false),
+	      running(threads > 0 ? threads : 1) {
+		// running drops as workers finish, they may do so before all start
+		int count = running;
+
+		for (int i = 0; i < count; i++) {
+			workers.push_back(std::thread(&parallel_map_stage::run, this));
+		}
+	}
+
+	/**
+	 * The destructor waits for the stage to finish, so the input has to be
+	 * closed, or the output has to be closed and written to, before it
+	 * */
+	~parallel_map_stage() { join(); }
+
+	parallel_map_stage(const parallel_map_stage& other) = delete;
+	parallel_map_stage& operator=(const parallel_map_stage& other) = delete;
+
+	/**
+	 * join waits until the input is drained and the output closed
+	 * */
+	void join() {
+		for (auto& w : workers) {
+			if (w.joinable()) {
+				w.join();
+			}
+		}
+	}
+};
+
+}  // namespace chan
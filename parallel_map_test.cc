@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "parallel_map.hh"
+
+TEST(parallel_map_stage, keeps_order) {
+	const int n = 2000;
+
+	chan::buffered_chan<int> in(16);
+	chan::buffered_chan<std::string> out(16);
+
+	// later values often finish first
+	chan::parallel_map_stage<int, std::string> stage(in, out, [](const int& x) {
+		if (x % 7 == 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		return std::to_string(x);
+	}, 4, 32);
+
+	std::thread producer([&](){
+		for (int i = 0; i < n; i++) {
+			in << i;
+		}
+		in.close();
+	});
+
+	std::string s;
+	int count = 0;
+	while (out.read(s)) {
+		ASSERT_EQ(std::to_string(count), s);
+		count++;
+	}
+
+	producer.join();
+	ASSERT_EQ(n, count);
+}
+
+TEST(parallel_map_stage, window_bounds_read_ahead) {
+	const int n = 500;
+	const int window = 8;
+	const int capacity = 4;
+
+	chan::buffered_chan<int> in(n);
+	chan::buffered_chan<int> out(capacity);
+
+	for (int i = 0; i < n; i++) {
+		in << i;
+	}
+	in.close();
+
+	std::atomic<int> consumed(0);
+	std::atomic<int> most_ahead(0);
+
+	chan::parallel_map_stage<int, int> stage(in, out, [&](const int& x) {
+		int ahead = x - consumed.load();
+		int seen = most_ahead.load();
+		while (ahead > seen && !most_ahead.compare_exchange_weak(seen, ahead)) {
+		}
+
+		return x;
+	}, 4, window);
+
+	// a slow consumer, so the window fills up
+	int x = 0;
+	while (out.read(x)) {
+		ASSERT_EQ(consumed.load(), x);
+		consumed++;
+
+		if (x % 50 == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+
+	ASSERT_EQ(n, consumed.load());
+
+	// read ahead of the consumer by at most the window, what the output
+	// holds, and the value being written
+	ASSERT_LE(most_ahead.load(), window + capacity + 1);
+}
+
+TEST(parallel_map_stage, empty_input) {
+	chan::buffered_chan<int> in(4), out(4);
+	in.close();
+
+	chan::parallel_map_stage<int, int> stage(in, out, [](const int& x) { return x; }, 3, 4);
+
+	int x = 0;
+	ASSERT_FALSE(out.read(x));
+}
+
+TEST(parallel_map_stage, output_closed) {
+	chan::buffered_chan<int> in(100), out(1);
+
+	for (int i = 0; i < 100; i++) {
+		in << i;
+	}
+
+	chan::parallel_map_stage<int, int> stage(in, out, [](const int& x) { return x; }, 2, 4);
+
+	int x = 0;
+	out >> x;
+	ASSERT_EQ(0, x);
+	out.close();
+
+	in.close();
+	stage.join();
+}
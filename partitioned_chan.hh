@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "chan.hh"
+
+namespace chan {
+
+struct partitioned_chan_no_key_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot route a value without a key, pass key_of to the partitioned channel or write with a key";
+	}
+} _partitioned_chan_no_key_exception;
+
+/**
+ * partitioned_chan routes values by key to one of a fixed number of
+ * buffered partitions, each meant to be drained by its own consumer.
+ *
+ * Values with the same key always go to the same partition, so they are
+ * consumed in the order they were written, while different keys are
+ * consumed in parallel. Partitions have separate locks, so writers and
+ * readers of different partitions never contend.
+ *
+ * The key of a value is taken from the key_of function given to the
+ * constructor, or passed explicitly to write. A channel without key_of
+ * only takes values with explicit keys. depths reports how many
+ * values each partition holds, which shows hot keys.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::partitioned_chan<event, uint64_t> c(8, 1024, [](const event& e){ return e.account; });
+ *
+ * for (int i = 0; i < c.partitions(); i++) {
+ * 	consumers.push_back(std::thread([&c, i](){
+ * 		event e;
+ * 		while (c.partition(i).read(e)) { ... }
+ * 	}));
+ * }
+ *
+ * c << e;
+ * ```
+ * */
+template <typename T, typename Key, typename Hash = std::hash<Key>>
+class partitioned_chan : public write_chan<T> {
+private:
+	std::vector<std::unique_ptr<buffered_chan<T>>> parts;
+
+	std::function<Key(const T&)> key_of;
+	Hash hash;
+
+	Key key(const T& val) const {
+		if (!key_of) {
+			throw _partitioned_chan_no_key_exception;
+		}
+
+		return key_of(val);
+	}
+
+public:
+	/**
+	 * @param   partitions   int                           the number of partitions
+	 * @param   capacity     int                           the capacity of each partition
+	 * @param   key_of       std::function<Key(const T&)>  extracts the key of a value, or nullptr for explicit keys only
+	 * */
+	partitioned_chan(int partitions, int capacity, std::function<Key(const T&)> key_of = nullptr, const Hash& hash = Hash())
+	    : key_of(key_of), hash(hash) {
+		if (partitions <= 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+
+		for (int i = 0; i < partitions; i++) {
+			parts.push_back(std::unique_ptr<buffered_chan<T>>(new buffered_chan<T>(capacity)));
+		}
+	}
+
+	partitioned_chan(const partitioned_chan& other) = delete;
+	partitioned_chan& operator=(const partitioned_chan& other) = delete;
+
+	int partitions() const {
+		return static_cast<int>(parts.size());
+	}
+
+	/**
+	 * partition_of returns the index of the partition values with key are
+	 * routed to. The hash is mixed first, so that hashes that are identity
+	 * functions, like std::hash for integers, still spread well.
+	 * */
+	int partition_of(const Key& key) const {
+		uint64_t h = static_cast<uint64_t>(hash(key));
+
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+
+		return static_cast<int>(h % parts.size());
+	}
+
+	/**
+	 * partition returns the channel of partition i, to be read by its
+	 * consumer
+	 * */
+	read_chan<T>& partition(int i) {
+		return *parts[i];
+	}
+
+	/**
+	 * depths returns the number of values waiting in each partition
+	 * */
+	std::vector<int> depths() const {
+		std::vector<int> result(parts.size());
+
+		for (size_t i = 0; i < parts.size(); i++) {
+			result[i] = parts[i]->size();
+		}
+
+		return result;
+	}
+
+	/**
+	 * close closes every partition
+	 * */
+	bool close() {
+		for (size_t i = 0; i < parts.size(); i++) {
+			parts[i]->close();
+		}
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return parts[0]->isClosed();
+	}
+
+	/**
+	 * write routes a value by the key given by key_of, and throws
+	 * partitioned_chan_no_key_exception if the channel has none
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 * */
+	void write(const T& val) {
+		parts[partition_of(key(val))]->write(val);
+	}
+
+	void write(T&& val) {
+		int i = partition_of(key(val));
+		parts[i]->write(std::move(val));
+	}
+
+	/**
+	 * write routes a value by an explicit key, blocking while its partition
+	 * is full
+	 *
+	 *
+	 * @param   key   const Key&   the key of the value
+	 * @param   val   const T&     the value to add
+	 * */
+	void write(const Key& key, const T& val) {
+		parts[partition_of(key)]->write(val);
+	}
+};
+
+}  // namespace chan
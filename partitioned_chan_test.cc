@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "partitioned_chan.hh"
+
+struct event {
+	int account;
+	int seq;
+};
+
+TEST(partitioned_chan, per_key_order) {
+	const int accounts = 32;
+	const int events = 2000;
+
+	chan::partitioned_chan<event, int> c(4, 16, [](const event& e){ return e.account; });
+
+	std::vector<std::vector<int>> last(c.partitions(), std::vector<int>(accounts, -1));
+	std::vector<int> counts(c.partitions(), 0);
+
+	std::vector<std::thread> consumers;
+	for (int i = 0 ; i < c.partitions() ; i++) {
+		consumers.push_back(std::thread([&, i](){
+			event e;
+			while (c.partition(i).read(e)) {
+				// every key lives in a single partition, in order
+				ASSERT_EQ(i, c.partition_of(e.account));
+				ASSERT_EQ(last[i][e.account] + 1, e.seq);
+
+				last[i][e.account] = e.seq;
+				counts[i]++;
+			}
+		}));
+	}
+
+	for (int s = 0 ; s < events ; s++) {
+		for (int a = 0 ; a < accounts ; a++) {
+			event e = {a, s};
+			c << e;
+		}
+	}
+
+	c.close();
+
+	int total = 0;
+	for (int i = 0 ; i < c.partitions() ; i++) {
+		consumers[i].join();
+		total += counts[i];
+	}
+
+	ASSERT_EQ(accounts * events, total);
+}
+
+TEST(partitioned_chan, depths) {
+	chan::partitioned_chan<int, int> c(4, 100);
+
+	// explicit keys, all values on one key
+	for (int i = 0 ; i < 10 ; i++) {
+		c.write(7, i);
+	}
+
+	std::vector<int> depths = c.depths();
+	ASSERT_EQ(4u, depths.size());
+
+	int hot = c.partition_of(7);
+	for (int i = 0 ; i < 4 ; i++) {
+		ASSERT_EQ(i == hot ? 10 : 0, depths[i]);
+	}
+
+	int x = 0;
+	ASSERT_TRUE(c.partition(hot).read(x));
+	ASSERT_EQ(0, x);
+	ASSERT_EQ(9, c.depths()[hot]);
+}
+
+TEST(partitioned_chan, no_key_of) {
+	chan::partitioned_chan<int, int> c(4, 100);
+
+	// without key_of, values need an explicit key
+	ASSERT_THROW(c.write(1), chan::partitioned_chan_no_key_exception);
+	ASSERT_THROW(c << 1, chan::partitioned_chan_no_key_exception);
+
+	c.write(1, 1);
+	ASSERT_EQ(1, c.depths()[c.partition_of(1)]);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "chan.hh"
+
+namespace chan {
+
+struct pollable_chan_eventfd_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot create the eventfd for a pollable channel";
+	}
+} _pollable_chan_eventfd_exception;
+
+/**
+ * eventfd_readiness mirrors the readiness of a channel in two eventfds,
+ * which are written to or drained only when the state flips.
+ *
+ * Whether an eventfd is signalled is remembered instead of asked for, so
+ * nothing else may read from or write to them.
+ * */
+class eventfd_readiness : public readiness {
+private:
+	int read_efd;
+	int write_efd;
+
+	bool read_signalled;
+	bool write_signalled;
+
+	static void signal(int fd, bool on) {
+		uint64_t val = 1;
+
+		if (on) {
+			ssize_t n = ::write(fd, &val, sizeof(val));
+			(void)n;
+		} else {
+			ssize_t n = ::read(fd, &val, sizeof(val));
+			(void)n;
+		}
+	}
+
+public:
+	eventfd_readiness() : read_signalled(false), write_signalled(false) {
+		read_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		write_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		if (read_efd == -1 || write_efd == -1) {
+			if (read_efd != -1) {
+				::close(read_efd);
+			}
+
+			if (write_efd != -1) {
+				::close(write_efd);
+			}
+
+			throw _pollable_chan_eventfd_exception;
+		}
+	}
+
+	~eventfd_readiness() {
+		::close(read_efd);
+		::close(write_efd);
+	}
+
+	eventfd_readiness(const eventfd_readiness& other) = delete;
+	eventfd_readiness& operator=(const eventfd_readiness& other) = delete;
+
+	void update(bool readable, bool writable) {
+		if (readable != read_signalled) {
+			signal(read_efd, readable);
+			read_signalled = readable;
+		}
+
+		if (writable != write_signalled) {
+			signal(write_efd, writable);
+			write_signalled = writable;
+		}
+	}
+
+	int read_fd() const { return read_efd; }
+	int write_fd() const { return write_efd; }
+};
+
+/**
+ * pollable_chan is a buffered_chan that can be waited on from an epoll,
+ * poll or select loop, without a helper thread.
+ *
+ * It exposes two eventfds. read_fd is readable while the channel has data
+ * or is closed, write_fd is readable while the channel has free space or is
+ * closed. Both are level triggered, and are only touched when the state
+ * of the channel flips, so a burst of writes into an empty channel costs a
+ * single write(2).
+ *
+ * The file descriptors are only for waiting, they must never be read
+ * from or written to. The channel keeps track of their state itself, so a
+ * descriptor that was read from stops polling readable while the channel
+ * still has data, and an event loop waiting on it hangs. Drain the channel
+ * with try_read, or fill it with try_write, instead.
+ *
+ * Everything else is buffered_chan, including wake policies, the range
+ * operations and allocators.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::pollable_chan<int> c(64);
+ *
+ * struct epoll_event ev;
+ * ev.events = EPOLLIN;
+ * ev.data.fd = c.read_fd();
+ * epoll_ctl(epfd, EPOLL_CTL_ADD, c.read_fd(), &ev);
+ *
+ * // when epoll_wait reports c.read_fd()
+ * int x = 0;
+ * while (c.try_read(x)) { ... }
+ * ```
+ * */
+template <typename T, typename Allocator = std::allocator<T>>
+class pollable_chan : public buffered_chan<T, Allocator> {
+private:
+	eventfd_readiness fds;
+
+public:
+	explicit pollable_chan(int capacity, const Allocator& alloc = Allocator())
+	    : pollable_chan(capacity, wake_policy(), alloc) {}
+
+	pollable_chan(int capacity, wake_policy policy, const Allocator& alloc = Allocator())
+	    : buffered_chan<T, Allocator>(capacity, policy, alloc) {
+		this->watch(&fds);
+	}
+
+	~pollable_chan() {
+		this->watch(nullptr);
+	}
+
+	/**
+	 * read_fd returns a file descriptor that polls readable while the
+	 * channel has data, or has been closed
+	 * */
+	int read_fd() const { return fds.read_fd(); }
+
+	/**
+	 * write_fd returns a file descriptor that polls readable while the
+	 * channel has free space, or has been closed
+	 * */
+	int write_fd() const { return fds.write_fd(); }
+};
+
+}  // namespace chan
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "pollable_chan.hh"
+
+bool is_readable(int fd) {
+	struct pollfd p;
+	p.fd = fd;
+	p.events = POLLIN;
+	p.revents = 0;
+
+	return poll(&p, 1, 0) == 1;
+}
+
+TEST(pollable_chan, readiness) {
+	chan::pollable_chan<int> c(2);
+
+	ASSERT_EQ(false, is_readable(c.read_fd()));
+	ASSERT_EQ(true, is_readable(c.write_fd()));
+
+	ASSERT_EQ(true, c.try_write(1));
+	ASSERT_EQ(true, is_readable(c.read_fd()));
+	ASSERT_EQ(true, is_readable(c.write_fd()));
+
+	ASSERT_EQ(true, c.try_write(2));
+	ASSERT_EQ(false, c.try_write(3));
+	ASSERT_EQ(true, is_readable(c.read_fd()));
+	ASSERT_EQ(false, is_readable(c.write_fd()));
+
+	int x = 0;
+	ASSERT_EQ(true, c.try_read(x));
+	ASSERT_EQ(1, x);
+	ASSERT_EQ(true, is_readable(c.write_fd()));
+
+	ASSERT_EQ(true, c.try_read(x));
+	ASSERT_EQ(2, x);
+	ASSERT_EQ(false, c.try_read(x));
+	ASSERT_EQ(false, is_readable(c.read_fd()));
+
+	c.close();
+	ASSERT_EQ(true, is_readable(c.read_fd()));
+	ASSERT_EQ(true, is_readable(c.write_fd()));
+}
+
+TEST(pollable_chan, coalescing) {
+	chan::pollable_chan<int> c(16);
+
+	// an edge triggered epoll reports every write(2) to the eventfd, even
+	// while it is already readable, without reading it
+	int epfd = epoll_create1(0);
+	ASSERT_NE(-1, epfd);
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.fd = c.read_fd();
+	ASSERT_EQ(0, epoll_ctl(epfd, EPOLL_CTL_ADD, c.read_fd(), &ev));
+
+	struct epoll_event events[1];
+	ASSERT_EQ(0, epoll_wait(epfd, events, 1, 0));
+
+	c << 0;
+	ASSERT_EQ(1, epoll_wait(epfd, events, 1, 0));
+
+	// the rest of the burst doesn't flip the channel, so it doesn't touch
+	// the eventfd
+	for (int i = 1; i < 10; i++) {
+		c << i;
+		ASSERT_EQ(0, epoll_wait(epfd, events, 1, 0));
+	}
+
+	ASSERT_EQ(true, is_readable(c.read_fd()));
+
+	::close(epfd);
+}
+
+TEST(pollable_chan, range_and_policy) {
+	chan::pollable_chan<int> c(8, chan::wake_policy::transition());
+
+	int vals[5] = {1, 2, 3, 4, 5};
+	c.write_range(vals, 5);
+	ASSERT_EQ(true, is_readable(c.read_fd()));
+
+	int out[8];
+	ASSERT_EQ(5, c.read_range(out, 8));
+	ASSERT_EQ(5, out[4]);
+	ASSERT_EQ(false, is_readable(c.read_fd()));
+}
+
+TEST(pollable_chan, epoll_with_sockets) {
+	chan::pollable_chan<int> c(4);
+
+	int fds[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+	int epfd = epoll_create1(0);
+	ASSERT_NE(-1, epfd);
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = c.read_fd();
+	ASSERT_EQ(0, epoll_ctl(epfd, EPOLL_CTL_ADD, c.read_fd(), &ev));
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fds[0];
+	ASSERT_EQ(0, epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+
+	std::thread producer([&](){
+		for (int i = 0; i < 100; i++) {
+			c << i;
+
+			char b = 'a' + (i % 26);
+			ASSERT_EQ(1, ::write(fds[1], &b, 1));
+		}
+
+		c.close();
+	});
+
+	int expected = 0;
+	int bytes = 0;
+	bool closed = false;
+
+	while (!closed || bytes < 100) {
+		struct epoll_event events[2];
+		int n = epoll_wait(epfd, events, 2, 1000);
+		ASSERT_GT(n, 0);
+
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == c.read_fd()) {
+				int x = 0;
+				while (c.try_read(x)) {
+					ASSERT_EQ(expected, x);
+					expected++;
+				}
+
+				if (c.isClosed() && !c.try_read(x)) {
+					closed = true;
+					ASSERT_EQ(0, epoll_ctl(epfd, EPOLL_CTL_DEL, c.read_fd(), nullptr));
+				}
+			} else {
+				char buf[64];
+				ssize_t r = ::read(fds[0], buf, sizeof(buf));
+				ASSERT_GT(r, 0);
+				bytes += r;
+			}
+		}
+	}
+
+	producer.join();
+
+	ASSERT_EQ(100, expected);
+	ASSERT_EQ(100, bytes);
+
+	::close(epfd);
+	::close(fds[0]);
+	::close(fds[1]);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "chan.hh"
+
+namespace chan {
+
+/**
+ * ring_chan is a bounded channel that never blocks writers. When the
+ * buffer is full, a write evicts the oldest value to make room for the new
+ * one, and the eviction is counted in dropped.
+ *
+ * It suits telemetry and sampling, where falling behind should cost old
+ * data rather than stall the producer. Readers block while it is empty,
+ * like buffered_chan.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::ring_chan<sample> c(1024);
+ *
+ * // producer
+ * c << s;
+ *
+ * // monitoring
+ * if (c.dropped() > threshold) { ... }
+ * ```
+ * */
+template <typename T, typename Allocator = std::allocator<T>>
+class ring_chan : public chan<T> {
+private:
+	int capacity;
+	circular_queue<T, Allocator> data;
+
+	uint64_t dropped_count;
+
+	bool read_with(T& valref, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		while (data.empty()) {
+			if (this->is_closed) {
+				valref = T();
+				return false;
+			}
+
+			this->read_wait_count++;
+			bool woken = this->wait_on(this->read_available, data_lock, ctx);
+			this->read_wait_count--;
+
+			if (!woken && data.empty()) {
+				this->raise(ctx);
+			}
+		}
+
+		valref = data.front();
+		data.pop();
+
+		return true;
+	}
+
+public:
+	ring_chan(int capacity, const Allocator& alloc = Allocator())
+	    : capacity(capacity), data(capacity, alloc), dropped_count(0) {
+		if (capacity == 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+	}
+
+	ring_chan(const ring_chan& other) = delete;
+	ring_chan& operator=(const ring_chan& other) = delete;
+	ring_chan(ring_chan&& other) = delete;
+	ring_chan& operator=(ring_chan&& other) = delete;
+
+	/**
+	 * dropped returns the number of values evicted by writes so far
+	 * */
+	uint64_t dropped() const {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return dropped_count;
+	}
+
+	/**
+	 * write adds a value, evicting the oldest one if the buffer is full. It
+	 * never blocks on readers.
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 * */
+	void write(const T& val) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (this->is_closed) {
+			throw _closed_channel_write_exception;
+		}
+
+		if (data.size() == capacity) {
+			data.pop();
+			dropped_count++;
+		}
+
+		data.push(val);
+
+		if (this->read_wait_count > 0) {
+			this->read_available.notify_one();
+		}
+	}
+
+	/**
+	 * read removes the oldest value, blocking while the buffer is empty
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value in the front
+	 *
+	 * @return           bool  the result of this mission
+	 * */
+	bool read(T& valref) {
+		return read_with(valref, nullptr);
+	}
+
+	bool read(T& valref, context& ctx) {
+		return read_with(valref, &ctx);
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "ring_chan.hh"
+
+TEST(ring_chan, overwrites_oldest) {
+	chan::ring_chan<int> c(3);
+
+	for (int i = 1 ; i <= 10 ; i++) {
+		c << i;
+	}
+
+	ASSERT_EQ(7u, c.dropped());
+
+	int x = 0;
+	for (int i = 8 ; i <= 10 ; i++) {
+		ASSERT_TRUE(c.read(x));
+		ASSERT_EQ(i, x);
+	}
+
+	c.close();
+	ASSERT_FALSE(c.read(x));
+}
+
+TEST(ring_chan, slow_reader) {
+	chan::ring_chan<int> c(16);
+
+	// the writer never blocks, however slow the reader is
+	std::thread t([&](){
+		for (int i = 0 ; i < 100000 ; i++) {
+			c << i;
+		}
+
+		c.close();
+	});
+
+	int x = 0;
+	int last = -1;
+	int count = 0;
+
+	while (c.read(x)) {
+		ASSERT_GT(x, last);
+		last = x;
+		count++;
+	}
+
+	ASSERT_EQ(99999, last);
+	ASSERT_EQ(100000u, count + c.dropped());
+
+	t.join();
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include "chan.hh"
+
+namespace chan {
+
+template <typename T>
+class sender;
+
+template <typename T>
+class receiver;
+
+/**
+ * chan_block is the shared state behind a sender and receiver pair. It
+ * holds the channel along with two intrusive counts, of senders and of
+ * all handles, so the handles don't need a separate control block like
+ * std::shared_ptr.
+ * */
+template <typename T>
+struct chan_block {
+	std::atomic<int> senders;
+	std::atomic<int> handles;
+
+	write_chan<T>* writer;
+	read_chan<T>* reader;
+
+	chan_block() : senders(0), handles(0), writer(nullptr), reader(nullptr) {}
+	virtual ~chan_block() {}
+
+	void release() {
+		if (handles.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			delete this;
+		}
+	}
+
+	void release_sender() {
+		if (senders.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			try {
+				writer->close();
+			} catch (channel_closed_exception&) {
+			}
+		}
+
+		release();
+	}
+};
+
+template <typename T, typename C>
+struct chan_block_of : public chan_block<T> {
+	C c;
+
+	template <typename... Args>
+	explicit chan_block_of(Args&&... args) : c(std::forward<Args>(args)...) {
+		this->writer = &c;
+		this->reader = &c;
+	}
+};
+
+/**
+ * sender is the writing end of a channel made with make_chan. Copies of a
+ * sender share the channel, which is closed when the last of them is
+ * destroyed, so receivers see the end of the stream once all producers
+ * are gone. Writes go straight to the channel, handles are only counted
+ * when they are copied or destroyed.
+ * */
+template <typename T>
+class sender : public write_chan<T> {
+private:
+	template <typename U, typename C, typename... Args>
+	friend std::pair<sender<U>, receiver<U>> make_chan_of(Args&&... args);
+
+	chan_block<T>* block;
+
+	explicit sender(chan_block<T>* block) : block(block) {
+		block->senders.fetch_add(1, std::memory_order_relaxed);
+		block->handles.fetch_add(1, std::memory_order_relaxed);
+	}
+
+public:
+	sender() : block(nullptr) {}
+
+	sender(const sender& other) : block(other.block) {
+		if (block != nullptr) {
+			block->senders.fetch_add(1, std::memory_order_relaxed);
+			block->handles.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	sender(sender&& other) : block(other.block) {
+		other.block = nullptr;
+	}
+
+	sender& operator=(sender other) {
+		std::swap(block, other.block);
+		return *this;
+	}
+
+	~sender() {
+		if (block != nullptr) {
+			block->release_sender();
+		}
+	}
+
+	explicit operator bool() const {
+		return block != nullptr;
+	}
+
+	/**
+	 * close closes the channel for all senders, without waiting for the
+	 * others to be destroyed
+	 * */
+	bool close() {
+		return block->writer->close();
+	}
+
+	bool isClosed() const {
+		return block->writer->isClosed();
+	}
+
+	void write(const T& val) {
+		block->writer->write(val);
+	}
+
+	void write(const T& val, context& ctx) {
+		block->writer->write(val, ctx);
+	}
+
+	void write(T&& val) {
+		block->writer->write(std::move(val));
+	}
+};
+
+/**
+ * receiver is the reading end of a channel made with make_chan. The
+ * channel is freed when the last sender and receiver are destroyed.
+ * */
+template <typename T>
+class receiver : public read_chan<T> {
+private:
+	template <typename U, typename C, typename... Args>
+	friend std::pair<sender<U>, receiver<U>> make_chan_of(Args&&... args);
+
+	chan_block<T>* block;
+
+	explicit receiver(chan_block<T>* block) : block(block) {
+		block->handles.fetch_add(1, std::memory_order_relaxed);
+	}
+
+public:
+	receiver() : block(nullptr) {}
+
+	receiver(const receiver& other) : block(other.block) {
+		if (block != nullptr) {
+			block->handles.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	receiver(receiver&& other) : block(other.block) {
+		other.block = nullptr;
+	}
+
+	receiver& operator=(receiver other) {
+		std::swap(block, other.block);
+		return *this;
+	}
+
+	~receiver() {
+		if (block != nullptr) {
+			block->release();
+		}
+	}
+
+	explicit operator bool() const {
+		return block != nullptr;
+	}
+
+	/**
+	 * close closes the channel, after which senders fail to write
+	 * */
+	bool close() {
+		return block->reader->close();
+	}
+
+	bool isClosed() const {
+		return block->reader->isClosed();
+	}
+
+	bool read(T& valref) {
+		return block->reader->read(valref);
+	}
+
+	bool read(T& valref, context& ctx) {
+		return block->reader->read(valref, ctx);
+	}
+};
+
+/**
+ * make_chan_of creates a channel of type C, constructed from args, and
+ * returns a sender and a receiver for it
+ *
+ * example usage:
+ *
+ * ```
+ * auto ch = chan::make_chan_of<int, chan::spill_chan<int>>(4096, "/var/spool/ints");
+ * ```
+ * */
+template <typename T, typename C, typename... Args>
+std::pair<sender<T>, receiver<T>> make_chan_of(Args&&... args) {
+	chan_block<T>* block = new chan_block_of<T, C>(std::forward<Args>(args)...);
+	return std::pair<sender<T>, receiver<T>>(sender<T>(block), receiver<T>(block));
+}
+
+/**
+ * make_chan creates an unbuffered channel, and returns a sender and a
+ * receiver for it
+ *
+ * example usage:
+ *
+ * ```
+ * auto ch = chan::make_chan<int>();
+ *
+ * std::thread([](chan::sender<int> out){
+ * 	for (int i = 0; i < 10; i++) {
+ * 		out << i;
+ * 	}
+ * }, std::move(ch.first)).detach();
+ *
+ * int x = 0;
+ * while (ch.second.read(x)) { ... }
+ * ```
+ * */
+template <typename T>
+std::pair<sender<T>, receiver<T>> make_chan() {
+	return make_chan_of<T, unbuffered_chan<T>>();
+}
+
+/**
+ * make_chan with a capacity creates a buffered channel
+ * */
+template <typename T>
+std::pair<sender<T>, receiver<T>> make_chan(int capacity) {
+	return make_chan_of<T, buffered_chan<T>>(capacity);
+}
+
+}  // namespace chan
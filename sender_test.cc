@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "sender.hh"
+
+TEST(sender, closes_on_last_sender) {
+	auto ch = chan::make_chan<int>(4);
+
+	chan::receiver<int> in = ch.second;
+
+	std::vector<std::thread> producers;
+	for (int p = 0 ; p < 3 ; p++) {
+		producers.push_back(std::thread([](chan::sender<int> out){
+			for (int i = 0 ; i < 100 ; i++) {
+				out << i;
+			}
+		}, ch.first));
+	}
+
+	// only the producers hold senders now
+	ch.first = chan::sender<int>();
+
+	int x = 0, count = 0;
+	while (in.read(x)) {
+		count++;
+	}
+
+	for (auto& t : producers) {
+		t.join();
+	}
+
+	ASSERT_EQ(300, count);
+	ASSERT_TRUE(in.isClosed());
+}
+
+TEST(sender, unbuffered) {
+	auto ch = chan::make_chan<int>();
+
+	std::thread producer([](chan::sender<int> out){
+		for (int i = 0 ; i < 10 ; i++) {
+			out << i;
+		}
+	}, std::move(ch.first));
+
+	ASSERT_FALSE(ch.first);
+
+	int x = 0, sum = 0;
+	while (ch.second.read(x)) {
+		sum += x;
+	}
+
+	producer.join();
+
+	ASSERT_EQ(45, sum);
+}
+
+TEST(sender, receiver_outlives_senders) {
+	chan::receiver<int> in;
+
+	{
+		auto ch = chan::make_chan<int>(2);
+		ch.first << 7;
+		in = std::move(ch.second);
+	}
+
+	int x = 0;
+	ASSERT_TRUE(in.read(x));
+	ASSERT_EQ(7, x);
+	ASSERT_FALSE(in.read(x));
+}
+
+TEST(sender, explicit_close) {
+	auto ch = chan::make_chan_of<int, chan::buffered_chan<int>>(2);
+	chan::sender<int> other = ch.first;
+
+	ch.first.close();
+
+	ASSERT_TRUE(other.isClosed());
+	ASSERT_THROW(other << 1, chan::closed_channel_write_exception);
+}
@@ -0,0 +1,704 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHAN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace chan {
+
+/**
+ * simd holds the batch kernels behind the stages in vector_stage.hh. Each
+ * kernel works on a contiguous array of values:
+ *
+ * - filter copies the values that pass a predicate to out, in order
+ * - map stores op(x) for each value to out
+ * - reduce folds the values with op
+ *
+ * Any predicate or op works with the scalar kernels. The ones defined here
+ * also have SSE4.1 and AVX2 kernels for int32_t and float, on x86. The
+ * kernels are compiled for each instruction set with target attributes,
+ * and one is picked when they are called, from what the processor
+ * supports, so the program itself needs no -mavx2.
+ *
+ * Filtering compacts the values that pass in a register, with a shuffle
+ * looked up from the comparison mask, and stores the whole register at
+ * the output position, which then advances by the number that passed.
+ * Since out never gets ahead of in, the stores stay within the first n
+ * slots of out.
+ * */
+namespace simd {
+
+enum class level {
+	scalar,
+	sse41,
+	avx2,
+};
+
+/**
+ * detect returns the best level the processor supports
+ * */
+inline level detect() {
+#ifdef CHAN_SIMD_X86
+	if (__builtin_cpu_supports("avx2")) {
+		return level::avx2;
+	}
+
+	if (__builtin_cpu_supports("sse4.1")) {
+		return level::sse41;
+	}
+#endif
+
+	return level::scalar;
+}
+
+inline std::atomic<level>& current() {
+	static std::atomic<level> l(detect());
+	return l;
+}
+
+/**
+ * active returns the level the kernels use
+ * */
+inline level active() {
+	return current().load(std::memory_order_relaxed);
+}
+
+/**
+ * use makes the kernels use a lower level than detected, for tests and
+ * benchmarks, and returns the level actually set
+ * */
+inline level use(level l) {
+	level best = detect();
+	if (static_cast<int>(l) > static_cast<int>(best)) {
+		l = best;
+	}
+
+	current().store(l);
+	return l;
+}
+
+inline const char* name_of(level l) {
+	switch (l) {
+		case level::avx2:
+			return "avx2";
+		case level::sse41:
+			return "sse4.1";
+		default:
+			return "scalar";
+	}
+}
+
+/**
+ * greater passes values above a bound
+ * */
+template <typename T>
+struct greater {
+	T bound;
+
+	bool operator()(T x) const {
+		return x > bound;
+	}
+};
+
+/**
+ * less passes values below a bound
+ * */
+template <typename T>
+struct less {
+	T bound;
+
+	bool operator()(T x) const {
+		return x < bound;
+	}
+};
+
+/**
+ * multiple_of passes integers divisible by a non zero divisor. Every value
+ * is a multiple of -1, which is not left to x % -1, as that overflows for
+ * the smallest value.
+ * */
+template <typename T>
+struct multiple_of {
+	static_assert(std::is_integral<T>::value, "multiple_of needs an integer type");
+
+	T divisor;
+
+	bool operator()(T x) const {
+		if (std::is_signed<T>::value && divisor == static_cast<T>(-1)) {
+			return true;
+		}
+
+		return x % divisor == 0;
+	}
+};
+
+/**
+ * affine maps x to x * scale + offset
+ * */
+template <typename T>
+struct affine {
+	T scale;
+	T offset;
+
+	T operator()(T x) const {
+		return x * scale + offset;
+	}
+};
+
+/**
+ * sum, minimum and maximum are reductions, with the identity they start
+ * from. Sums of floats are added in a different order by the vector
+ * kernels, so they may round differently.
+ * */
+template <typename T>
+struct sum {
+	static T identity() {
+		return T();
+	}
+
+	T operator()(T a, T b) const {
+		return a + b;
+	}
+};
+
+template <typename T>
+struct minimum {
+	static T identity() {
+		return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+	}
+
+	T operator()(T a, T b) const {
+		return b < a ? b : a;
+	}
+};
+
+template <typename T>
+struct maximum {
+	static T identity() {
+		return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+	}
+
+	T operator()(T a, T b) const {
+		return a < b ? b : a;
+	}
+};
+
+template <typename T, typename Pred>
+int filter_scalar(const T* in, int n, T* out, const Pred& pred) {
+	int k = 0;
+
+	for (int i = 0; i < n; i++) {
+		if (pred(in[i])) {
+			out[k++] = in[i];
+		}
+	}
+
+	return k;
+}
+
+template <typename T, typename Op>
+void map_scalar(const T* in, int n, T* out, const Op& op) {
+	for (int i = 0; i < n; i++) {
+		out[i] = op(in[i]);
+	}
+}
+
+template <typename T, typename Op>
+T reduce_scalar(const T* in, int n, T acc, const Op& op) {
+	for (int i = 0; i < n; i++) {
+		acc = op(acc, in[i]);
+	}
+
+	return acc;
+}
+
+/**
+ * lanes describes how a predicate or op works on vectors of T. It has no
+ * kernels unless specialized. Predicates name a state, which is made from
+ * the predicate once per call, for constants the comparison needs.
+ * */
+template <typename T, typename Op>
+struct lanes {
+	static const bool vectorized = false;
+};
+
+#ifdef CHAN_SIMD_X86
+
+/**
+ * compact_tables holds the shuffles that move the lanes selected by a
+ * comparison mask to the front of a vector, for 4 and 8 lanes of 32 bits
+ * */
+struct compact_tables {
+	uint8_t sse[16][16];
+	int32_t avx2[256][8];
+
+	compact_tables() {
+		for (int m = 0; m < 16; m++) {
+			int k = 0;
+			for (int lane = 0; lane < 4; lane++) {
+				if (m & (1 << lane)) {
+					for (int byte = 0; byte < 4; byte++) {
+						sse[m][k * 4 + byte] = static_cast<uint8_t>(lane * 4 + byte);
+					}
+					k++;
+				}
+			}
+
+			for (; k < 4; k++) {
+				for (int byte = 0; byte < 4; byte++) {
+					sse[m][k * 4 + byte] = 0x80;
+				}
+			}
+		}
+
+		for (int m = 0; m < 256; m++) {
+			int k = 0;
+			for (int lane = 0; lane < 8; lane++) {
+				if (m & (1 << lane)) {
+					avx2[m][k++] = lane;
+				}
+			}
+
+			for (; k < 8; k++) {
+				avx2[m][k] = 0;
+			}
+		}
+	}
+};
+
+inline const compact_tables& tables() {
+	static compact_tables t;
+	return t;
+}
+
+/**
+ * divisibility holds the constants of the test for divisibility by d
+ * without division, after Granlund and Montgomery: with d = d0 * 2^k and
+ * d0 odd, |x| is a multiple of d if rotating |x| * inverse(d0) right by k
+ * gives at most (2^32 - 1) / d.
+ * */
+struct divisibility {
+	uint32_t inverse;
+	uint32_t limit;
+	int shift;
+
+	explicit divisibility(const multiple_of<int32_t>& p) {
+		uint32_t d = p.divisor < 0 ? 0u - static_cast<uint32_t>(p.divisor) : static_cast<uint32_t>(p.divisor);
+
+		shift = 0;
+		while (d != 0 && (d & 1) == 0) {
+			d >>= 1;
+			shift++;
+		}
+
+		// Newton's iteration doubles the correct low bits of the inverse
+		inverse = d;
+		for (int i = 0; i < 4; i++) {
+			inverse *= 2 - d * inverse;
+		}
+
+		limit = d == 0 ? 0 : UINT32_MAX / (d << shift);
+	}
+};
+
+#define CHAN_SIMD_SSE41 __attribute__((target("sse4.1")))
+#define CHAN_SIMD_AVX2 __attribute__((target("avx2")))
+
+template <>
+struct lanes<int32_t, greater<int32_t>> {
+	static const bool vectorized = true;
+
+	typedef greater<int32_t> state;
+
+	CHAN_SIMD_SSE41 static int sse41(__m128i x, const greater<int32_t>& p) {
+		return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(x, _mm_set1_epi32(p.bound))));
+	}
+
+	CHAN_SIMD_AVX2 static int avx2(__m256i x, const greater<int32_t>& p) {
+		return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, _mm256_set1_epi32(p.bound))));
+	}
+};
+
+template <>
+struct lanes<int32_t, less<int32_t>> {
+	static const bool vectorized = true;
+
+	typedef less<int32_t> state;
+
+	CHAN_SIMD_SSE41 static int sse41(__m128i x, const less<int32_t>& p) {
+		return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(p.bound), x)));
+	}
+
+	CHAN_SIMD_AVX2 static int avx2(__m256i x, const less<int32_t>& p) {
+		return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(p.bound), x)));
+	}
+};
+
+template <>
+struct lanes<int32_t, multiple_of<int32_t>> {
+	static const bool vectorized = true;
+
+	typedef divisibility state;
+
+	CHAN_SIMD_SSE41 static int sse41(__m128i x, const divisibility& d) {
+		__m128i y = _mm_mullo_epi32(_mm_abs_epi32(x), _mm_set1_epi32(static_cast<int32_t>(d.inverse)));
+		y = _mm_or_si128(_mm_srl_epi32(y, _mm_cvtsi32_si128(d.shift)), _mm_sll_epi32(y, _mm_cvtsi32_si128(32 - d.shift)));
+
+		__m128i pass = _mm_cmpeq_epi32(_mm_min_epu32(y, _mm_set1_epi32(static_cast<int32_t>(d.limit))), y);
+		return _mm_movemask_ps(_mm_castsi128_ps(pass));
+	}
+
+	CHAN_SIMD_AVX2 static int avx2(__m256i x, const divisibility& d) {
+		__m256i y = _mm256_mullo_epi32(_mm256_abs_epi32(x), _mm256_set1_epi32(static_cast<int32_t>(d.inverse)));
+		y = _mm256_or_si256(_mm256_srl_epi32(y, _mm_cvtsi32_si128(d.shift)), _mm256_sll_epi32(y, _mm_cvtsi32_si128(32 - d.shift)));
+
+		__m256i pass = _mm256_cmpeq_epi32(_mm256_min_epu32(y, _mm256_set1_epi32(static_cast<int32_t>(d.limit))), y);
+		return _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+	}
+};
+
+template <>
+struct lanes<float, greater<float>> {
+	static const bool vectorized = true;
+
+	typedef greater<float> state;
+
+	CHAN_SIMD_SSE41 static int sse41(__m128i x, const greater<float>& p) {
+		return _mm_movemask_ps(_mm_cmpgt_ps(_mm_castsi128_ps(x), _mm_set1_ps(p.bound)));
+	}
+
+	CHAN_SIMD_AVX2 static int avx2(__m256i x, const greater<float>& p) {
+		return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_castsi256_ps(x), _mm256_set1_ps(p.bound), _CMP_GT_OQ));
+	}
+};
+
+template <>
+struct lanes<float, less<float>> {
+	static const bool vectorized = true;
+
+	typedef less<float> state;
+
+	CHAN_SIMD_SSE41 static int sse41(__m128i x, const less<float>& p) {
+		return _mm_movemask_ps(_mm_cmplt_ps(_mm_castsi128_ps(x), _mm_set1_ps(p.bound)));
+	}
+
+	CHAN_SIMD_AVX2 static int avx2(__m256i x, const less<float>& p) {
+		return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_castsi256_ps(x), _mm256_set1_ps(p.bound), _CMP_LT_OQ));
+	}
+};
+
+template <>
+struct lanes<int32_t, affine<int32_t>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i x, const affine<int32_t>& op) {
+		return _mm_add_epi32(_mm_mullo_epi32(x, _mm_set1_epi32(op.scale)), _mm_set1_epi32(op.offset));
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i x, const affine<int32_t>& op) {
+		return _mm256_add_epi32(_mm256_mullo_epi32(x, _mm256_set1_epi32(op.scale)), _mm256_set1_epi32(op.offset));
+	}
+};
+
+template <>
+struct lanes<float, affine<float>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i x, const affine<float>& op) {
+		__m128 y = _mm_add_ps(_mm_mul_ps(_mm_castsi128_ps(x), _mm_set1_ps(op.scale)), _mm_set1_ps(op.offset));
+		return _mm_castps_si128(y);
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i x, const affine<float>& op) {
+		__m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_castsi256_ps(x), _mm256_set1_ps(op.scale)), _mm256_set1_ps(op.offset));
+		return _mm256_castps_si256(y);
+	}
+};
+
+template <>
+struct lanes<int32_t, sum<int32_t>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const sum<int32_t>&) {
+		return _mm_add_epi32(a, b);
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const sum<int32_t>&) {
+		return _mm256_add_epi32(a, b);
+	}
+};
+
+template <>
+struct lanes<int32_t, minimum<int32_t>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const minimum<int32_t>&) {
+		return _mm_min_epi32(a, b);
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const minimum<int32_t>&) {
+		return _mm256_min_epi32(a, b);
+	}
+};
+
+template <>
+struct lanes<int32_t, maximum<int32_t>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const maximum<int32_t>&) {
+		return _mm_max_epi32(a, b);
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const maximum<int32_t>&) {
+		return _mm256_max_epi32(a, b);
+	}
+};
+
+template <>
+struct lanes<float, sum<float>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const sum<float>&) {
+		return _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const sum<float>&) {
+		return _mm256_castps_si256(_mm256_add_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+	}
+};
+
+template <>
+struct lanes<float, minimum<float>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const minimum<float>&) {
+		return _mm_castps_si128(_mm_min_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(a)));
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const minimum<float>&) {
+		return _mm256_castps_si256(_mm256_min_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a)));
+	}
+};
+
+template <>
+struct lanes<float, maximum<float>> {
+	static const bool vectorized = true;
+
+	CHAN_SIMD_SSE41 static __m128i sse41(__m128i a, __m128i b, const maximum<float>&) {
+		return _mm_castps_si128(_mm_max_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(a)));
+	}
+
+	CHAN_SIMD_AVX2 static __m256i avx2(__m256i a, __m256i b, const maximum<float>&) {
+		return _mm256_castps_si256(_mm256_max_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a)));
+	}
+};
+
+template <typename T, typename Pred>
+CHAN_SIMD_SSE41 int filter_sse41(const T* in, int n, T* out, const Pred& pred) {
+	const compact_tables& t = tables();
+	typename lanes<T, Pred>::state s(pred);
+	int i = 0, k = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		int mask = lanes<T, Pred>::sse41(x, s);
+
+		__m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.sse[mask]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + k), _mm_shuffle_epi8(x, shuffle));
+
+		k += __builtin_popcount(mask);
+	}
+
+	return k + filter_scalar(in + i, n - i, out + k, pred);
+}
+
+template <typename T, typename Pred>
+CHAN_SIMD_AVX2 int filter_avx2(const T* in, int n, T* out, const Pred& pred) {
+	const compact_tables& t = tables();
+	typename lanes<T, Pred>::state s(pred);
+	int i = 0, k = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		int mask = lanes<T, Pred>::avx2(x, s);
+
+		__m256i shuffle = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t.avx2[mask]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), _mm256_permutevar8x32_epi32(x, shuffle));
+
+		k += __builtin_popcount(mask);
+	}
+
+	return k + filter_scalar(in + i, n - i, out + k, pred);
+}
+
+template <typename T, typename Op>
+CHAN_SIMD_SSE41 void map_sse41(const T* in, int n, T* out, const Op& op) {
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), lanes<T, Op>::sse41(x, op));
+	}
+
+	map_scalar(in + i, n - i, out + i, op);
+}
+
+template <typename T, typename Op>
+CHAN_SIMD_AVX2 void map_avx2(const T* in, int n, T* out, const Op& op) {
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), lanes<T, Op>::avx2(x, op));
+	}
+
+	map_scalar(in + i, n - i, out + i, op);
+}
+
+template <typename T, typename Op>
+CHAN_SIMD_SSE41 T reduce_sse41(const T* in, int n, T acc, const Op& op) {
+	if (n < 8) {
+		return reduce_scalar(in, n, acc, op);
+	}
+
+	T identity[4] = {Op::identity(), Op::identity(), Op::identity(), Op::identity()};
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(identity));
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		v = lanes<T, Op>::sse41(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), op);
+	}
+
+	T parts[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(parts), v);
+
+	acc = reduce_scalar(parts, 4, acc, op);
+	return reduce_scalar(in + i, n - i, acc, op);
+}
+
+template <typename T, typename Op>
+CHAN_SIMD_AVX2 T reduce_avx2(const T* in, int n, T acc, const Op& op) {
+	if (n < 16) {
+		return reduce_scalar(in, n, acc, op);
+	}
+
+	T identity[8];
+	for (int j = 0; j < 8; j++) {
+		identity[j] = Op::identity();
+	}
+
+	__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(identity));
+
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		v = lanes<T, Op>::avx2(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), op);
+	}
+
+	T parts[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(parts), v);
+
+	acc = reduce_scalar(parts, 8, acc, op);
+	return reduce_scalar(in + i, n - i, acc, op);
+}
+
+#undef CHAN_SIMD_SSE41
+#undef CHAN_SIMD_AVX2
+
+template <typename T, typename Pred>
+int filter_with(const T* in, int n, T* out, const Pred& pred, std::true_type) {
+	switch (active()) {
+		case level::avx2:
+			return filter_avx2(in, n, out, pred);
+		case level::sse41:
+			return filter_sse41(in, n, out, pred);
+		default:
+			return filter_scalar(in, n, out, pred);
+	}
+}
+
+template <typename T, typename Op>
+void map_with(const T* in, int n, T* out, const Op& op, std::true_type) {
+	switch (active()) {
+		case level::avx2:
+			map_avx2(in, n, out, op);
+			break;
+		case level::sse41:
+			map_sse41(in, n, out, op);
+			break;
+		default:
+			map_scalar(in, n, out, op);
+			break;
+	}
+}
+
+template <typename T, typename Op>
+T reduce_with(const T* in, int n, T acc, const Op& op, std::true_type) {
+	switch (active()) {
+		case level::avx2:
+			return reduce_avx2(in, n, acc, op);
+		case level::sse41:
+			return reduce_sse41(in, n, acc, op);
+		default:
+			return reduce_scalar(in, n, acc, op);
+	}
+}
+
+#endif
+
+template <typename T, typename Pred>
+int filter_with(const T* in, int n, T* out, const Pred& pred, std::false_type) {
+	return filter_scalar(in, n, out, pred);
+}
+
+template <typename T, typename Op>
+void map_with(const T* in, int n, T* out, const Op& op, std::false_type) {
+	map_scalar(in, n, out, op);
+}
+
+template <typename T, typename Op>
+T reduce_with(const T* in, int n, T acc, const Op& op, std::false_type) {
+	return reduce_scalar(in, n, acc, op);
+}
+
+/**
+ * filter copies the values of in that pass pred to out, in order. out may
+ * be in itself, and is written only within its first n slots.
+ *
+ *
+ * @param   in     const T*   the values
+ * @param   n      int        the number of values
+ * @param   out    T*         where the values that pass are stored
+ * @param   pred   Pred       bool(T)
+ *
+ * @return         int        the number of values that passed
+ * */
+template <typename T, typename Pred>
+int filter(const T* in, int n, T* out, const Pred& pred) {
+	return filter_with(in, n, out, pred, std::integral_constant<bool, lanes<T, Pred>::vectorized>());
+}
+
+/**
+ * map stores op(x) for each of the n values of in to out, which may be in
+ * itself
+ * */
+template <typename T, typename Op>
+void map(const T* in, int n, T* out, const Op& op) {
+	map_with(in, n, out, op, std::integral_constant<bool, lanes<T, Op>::vectorized>());
+}
+
+/**
+ * reduce folds the n values of in into acc with op
+ * */
+template <typename T, typename Op>
+T reduce(const T* in, int n, T acc, const Op& op) {
+	return reduce_with(in, n, acc, op, std::integral_constant<bool, lanes<T, Op>::vectorized>());
+}
+
+}  // namespace simd
+}  // namespace chan
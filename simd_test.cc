@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "simd.hh"
+
+using chan::simd::level;
+
+std::vector<level> levels() {
+	std::vector<level> result;
+
+	for (level l : {level::scalar, level::sse41, level::avx2}) {
+		if (static_cast<int>(l) <= static_cast<int>(chan::simd::detect())) {
+			result.push_back(l);
+		}
+	}
+
+	return result;
+}
+
+template <typename T, typename Pred>
+void check_filter(const std::vector<T>& vals, Pred pred) {
+	for (level l : levels()) {
+		chan::simd::use(l);
+
+		// every length, to cover the scalar tails
+		for (int n = 0; n <= static_cast<int>(vals.size()); n += 7) {
+			std::vector<T> expected(n), out(n);
+			int want = chan::simd::filter_scalar(vals.data(), n, expected.data(), pred);
+			int got = chan::simd::filter(vals.data(), n, out.data(), pred);
+
+			ASSERT_EQ(want, got) << chan::simd::name_of(l) << " n=" << n;
+			for (int i = 0; i < got; i++) {
+				ASSERT_EQ(expected[i], out[i]) << chan::simd::name_of(l) << " n=" << n << " i=" << i;
+			}
+		}
+	}
+
+	chan::simd::use(chan::simd::detect());
+}
+
+std::vector<int32_t> random_ints(int n) {
+	std::mt19937 rng(7);
+	std::vector<int32_t> vals;
+
+	vals.push_back(0);
+	vals.push_back(INT_MIN);
+	vals.push_back(INT_MAX);
+	vals.push_back(-1);
+
+	while (static_cast<int>(vals.size()) < n) {
+		vals.push_back(static_cast<int32_t>(rng()) >> (rng() % 32));
+	}
+
+	return vals;
+}
+
+TEST(simd, filter_int) {
+	std::vector<int32_t> vals = random_ints(300);
+
+	check_filter(vals, chan::simd::greater<int32_t>{10});
+	check_filter(vals, chan::simd::less<int32_t>{-10});
+
+	for (int32_t d : {1, 2, 3, 6, 7, 12, 64, 1000, -1, -5, INT_MAX}) {
+		check_filter(vals, chan::simd::multiple_of<int32_t>{d});
+	}
+}
+
+TEST(simd, filter_multiple_of_minus_one) {
+	std::vector<int32_t> vals(3, INT_MIN), out(3);
+
+	// fewer values than lanes, so only the scalar tail runs
+	for (level l : levels()) {
+		chan::simd::use(l);
+
+		ASSERT_EQ(3, chan::simd::filter(vals.data(), 3, out.data(), chan::simd::multiple_of<int32_t>{-1}));
+		ASSERT_EQ(INT_MIN, out[2]);
+	}
+
+	chan::simd::use(chan::simd::detect());
+}
+
+TEST(simd, filter_float) {
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> dist(-100, 100);
+
+	std::vector<float> vals(300);
+	for (float& v : vals) {
+		v = dist(rng);
+	}
+
+	check_filter(vals, chan::simd::greater<float>{0.5f});
+	check_filter(vals, chan::simd::less<float>{-20});
+}
+
+TEST(simd, filter_in_place) {
+	for (level l : levels()) {
+		chan::simd::use(l);
+
+		std::vector<int32_t> vals(100);
+		for (int i = 0; i < 100; i++) {
+			vals[i] = i;
+		}
+
+		int n = chan::simd::filter(vals.data(), 100, vals.data(), chan::simd::multiple_of<int32_t>{3});
+
+		ASSERT_EQ(34, n);
+		for (int i = 0; i < n; i++) {
+			ASSERT_EQ(i * 3, vals[i]);
+		}
+	}
+
+	chan::simd::use(chan::simd::detect());
+}
+
+TEST(simd, map_and_reduce) {
+	std::vector<int32_t> vals = random_ints(301);
+
+	for (level l : levels()) {
+		chan::simd::use(l);
+
+		std::vector<int32_t> out(vals.size());
+		chan::simd::affine<int32_t> op = {3, -2};
+		chan::simd::map(vals.data(), static_cast<int>(vals.size()), out.data(), op);
+
+		for (size_t i = 0; i < vals.size(); i++) {
+			ASSERT_EQ(static_cast<int32_t>(static_cast<uint32_t>(vals[i]) * 3u - 2u), out[i]);
+		}
+
+		std::vector<int32_t> small(vals.size());
+		for (size_t i = 0; i < vals.size(); i++) {
+			small[i] = vals[i] % 1000;
+		}
+
+		int n = static_cast<int>(small.size());
+		ASSERT_EQ(chan::simd::reduce_scalar(small.data(), n, 0, chan::simd::sum<int32_t>()),
+		          chan::simd::reduce(small.data(), n, 0, chan::simd::sum<int32_t>()));
+		ASSERT_EQ(INT_MIN, chan::simd::reduce(vals.data(), n, chan::simd::minimum<int32_t>::identity(), chan::simd::minimum<int32_t>()));
+		ASSERT_EQ(INT_MAX, chan::simd::reduce(vals.data(), n, chan::simd::maximum<int32_t>::identity(), chan::simd::maximum<int32_t>()));
+
+		std::vector<float> floats(37);
+		for (int i = 0; i < 37; i++) {
+			floats[i] = static_cast<float>(i - 10);
+		}
+
+		ASSERT_EQ(37 * 8, chan::simd::reduce(floats.data(), 37, 0.0f, chan::simd::sum<float>()));
+		ASSERT_EQ(-10, chan::simd::reduce(floats.data(), 37, chan::simd::minimum<float>::identity(), chan::simd::minimum<float>()));
+	}
+
+	chan::simd::use(chan::simd::detect());
+}
+
+TEST(simd, generic_predicate) {
+	std::vector<double> vals = {1.5, -2, 3, 4.25, 0};
+	std::vector<double> out(vals.size());
+
+	int n = chan::simd::filter(vals.data(), 5, out.data(), [](double x) { return x > 1; });
+
+	ASSERT_EQ(3, n);
+	ASSERT_EQ(4.25, out[2]);
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chan.hh"
+
+namespace chan {
+
+struct spill_chan_io_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot create, map or remove a spill segment";
+	}
+} _spill_chan_io_exception;
+
+/**
+ * spill_segment_header is stored at the start of every segment file.
+ * written and consumed count elements, and are updated after the element
+ * itself, so a reopened segment never exposes a partially copied value.
+ * */
+struct spill_segment_header {
+	uint32_t magic;
+	uint32_t element_size;
+	uint64_t capacity;
+	uint64_t written;
+	uint64_t consumed;
+};
+
+/**
+ * spill_chan is a buffered channel that never blocks writers. Values are
+ * kept in an in memory ring, and once the ring is full they are appended
+ * to a log of memory mapped segment files in a directory, until readers
+ * have drained the log again.
+ *
+ * Values are always read in FIFO order, the ring first and then the
+ * segments in the order they were written. Only the segment being written
+ * and the segment being read are mapped, so memory use is bounded by the
+ * ring and two segments regardless of the backlog, and both ends of the
+ * log are accessed sequentially. Segments are deleted as soon as they are
+ * consumed.
+ *
+ * Values are copied to disk with memcpy, so T must be trivially copyable.
+ *
+ * If recover is true, segments left in the directory by a previous
+ * instance, for example one that crashed, are read back before any new
+ * values. Values that were still in the in memory ring are lost. Without
+ * recover, stale segments are removed.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::spill_chan<sample> c(4096, "/var/spool/samples", true);
+ *
+ * c << s;
+ *
+ * sample x;
+ * while (c.read(x)) { ... }
+ * ```
+ * */
+template <typename T>
+class spill_chan : public chan<T> {
+	static_assert(std::is_trivially_copyable<T>::value, "spill_chan requires a trivially copyable type");
+
+private:
+	static const uint32_t spill_chan_magic = 0x7370696c;
+	static const size_t data_offset = 64;
+
+	struct segment {
+		uint64_t id;
+		spill_segment_header* header;
+		size_t length;
+	};
+
+	int capacity;
+	circular_queue<T> ring;
+
+	std::string dir;
+	size_t segment_bytes;
+
+	// front is the segment being read, back is the segment being written,
+	// only they are mapped
+	std::deque<segment> segments;
+	uint64_t next_id;
+
+	// the number of values in segments that haven't been read yet
+	uint64_t spilled_count;
+
+	std::string path_of(uint64_t id) const {
+		char name[32];
+		snprintf(name, sizeof(name), "seg-%016llx.log", static_cast<unsigned long long>(id));
+		return dir + "/" + name;
+	}
+
+	static T* values_of(segment& seg) {
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(seg.header) + data_offset);
+	}
+
+	void map(segment& seg, bool create) {
+		std::string path = path_of(seg.id);
+
+		int fd = open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+		if (fd == -1) {
+			throw _spill_chan_io_exception;
+		}
+
+		if (create && ftruncate(fd, seg.length) == -1) {
+			::close(fd);
+			unlink(path.c_str());
+			throw _spill_chan_io_exception;
+		}
+
+		void* p = mmap(nullptr, seg.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p == MAP_FAILED) {
+			throw _spill_chan_io_exception;
+		}
+
+#ifdef MADV_SEQUENTIAL
+		madvise(p, seg.length, MADV_SEQUENTIAL);
+#endif
+
+		seg.header = static_cast<spill_segment_header*>(p);
+	}
+
+	void unmap(segment& seg) {
+		if (seg.header != nullptr) {
+			munmap(seg.header, seg.length);
+			seg.header = nullptr;
+		}
+	}
+
+	/**
+	 * append copies a value to the end of the log, starting a new segment
+	 * when the last one is full
+	 * */
+	void append(const T& val) {
+		if (segments.empty() || segments.back().header->written == segments.back().header->capacity) {
+			if (segments.size() > 1) {
+				unmap(segments.back());
+			}
+
+			segment seg;
+			seg.id = next_id;
+			seg.header = nullptr;
+			seg.length = segment_bytes;
+
+			map(seg, true);
+			next_id++;
+
+			seg.header->magic = spill_chan_magic;
+			seg.header->element_size = sizeof(T);
+			seg.header->capacity = (segment_bytes - data_offset) / sizeof(T);
+			seg.header->written = 0;
+			seg.header->consumed = 0;
+
+			segments.push_back(seg);
+		}
+
+		segment& seg = segments.back();
+
+		memcpy(values_of(seg) + seg.header->written, &val, sizeof(T));
+		std::atomic_thread_fence(std::memory_order_release);
+		seg.header->written++;
+
+		spilled_count++;
+	}
+
+	/**
+	 * take copies the oldest value out of the log, deleting the segment it
+	 * came from once it is drained
+	 * */
+	void take(T& valref) {
+		segment& seg = segments.front();
+
+		if (seg.header == nullptr) {
+			map(seg, false);
+		}
+
+		memcpy(&valref, values_of(seg) + seg.header->consumed, sizeof(T));
+		seg.header->consumed++;
+
+		spilled_count--;
+
+		if (seg.header->consumed == seg.header->written &&
+		    (seg.header->written == seg.header->capacity || segments.size() == 1)) {
+			unmap(seg);
+			unlink(path_of(seg.id).c_str());
+			segments.pop_front();
+		}
+	}
+
+	/**
+	 * list returns the ids of the segment files in the directory, in order
+	 * */
+	std::vector<uint64_t> list() const {
+		std::vector<uint64_t> ids;
+
+		DIR* d = opendir(dir.c_str());
+		if (d == nullptr) {
+			throw _spill_chan_io_exception;
+		}
+
+		struct dirent* entry;
+		while ((entry = readdir(d)) != nullptr) {
+			unsigned long long id = 0;
+			char suffix[8] = {0};
+
+			if (sscanf(entry->d_name, "seg-%16llx.%7s", &id, suffix) == 2 && strcmp(suffix, "log") == 0) {
+				ids.push_back(id);
+			}
+		}
+
+		closedir(d);
+
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	/**
+	 * open_segments adopts the segments in the directory, skipping invalid
+	 * ones, or removes them all when they are not wanted
+	 * */
+	void open_segments(bool adopt) {
+		std::vector<uint64_t> ids = list();
+
+		for (size_t i = 0; i < ids.size(); i++) {
+			segment seg;
+			seg.id = ids[i];
+			seg.header = nullptr;
+
+			struct stat st;
+			std::string path = path_of(seg.id);
+
+			if (!adopt || stat(path.c_str(), &st) == -1 || static_cast<size_t>(st.st_size) < data_offset) {
+				unlink(path.c_str());
+				continue;
+			}
+
+			seg.length = st.st_size;
+			map(seg, false);
+
+			spill_segment_header* h = seg.header;
+			if (h->magic != spill_chan_magic ||
+			    h->element_size != sizeof(T) ||
+			    data_offset + h->capacity * sizeof(T) > seg.length ||
+			    h->written > h->capacity ||
+			    h->consumed > h->written ||
+			    h->consumed == h->written) {
+				unmap(seg);
+				unlink(path.c_str());
+				continue;
+			}
+
+			spilled_count += h->written - h->consumed;
+			next_id = seg.id + 1;
+
+			unmap(seg);
+			segments.push_back(seg);
+		}
+
+		// keep appending to the last segment if it has room left
+		if (!segments.empty()) {
+			map(segments.back(), false);
+		}
+	}
+
+	bool read_with(T& valref, context* ctx) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (ctx != nullptr) {
+			ctx->check();
+		}
+
+		while (ring.empty() && spilled_count == 0) {
+			if (this->is_closed) {
+				valref = T();
+				return false;
+			}
+
+			this->read_wait_count++;
+			bool woken = this->wait_on(this->read_available, data_lock, ctx);
+			this->read_wait_count--;
+
+			if (!woken && ring.empty() && spilled_count == 0) {
+				this->raise(ctx);
+			}
+		}
+
+		// values in the ring are always older than the ones on disk
+		if (!ring.empty()) {
+			valref = ring.front();
+			ring.pop();
+		} else {
+			take(valref);
+		}
+
+		return true;
+	}
+
+public:
+	/**
+	 * @param   capacity        int                  the number of values kept in memory
+	 * @param   dir             const std::string&   an existing directory for the segment files
+	 * @param   recover         bool                 whether to read back segments left in dir
+	 * @param   segment_bytes   size_t               the size of each segment file
+	 * */
+	spill_chan(int capacity, const std::string& dir, bool recover = false, size_t segment_bytes = 64 * 1024 * 1024)
+	    : capacity(capacity),
+	      ring(capacity),
+	      dir(dir),
+	      segment_bytes(std::max(segment_bytes, data_offset + sizeof(T))),
+	      next_id(0),
+	      spilled_count(0) {
+		if (capacity == 0) {
+			throw _buffered_chan_zero_size_exception;
+		}
+
+		open_segments(recover);
+	}
+
+	/**
+	 * The destructor unmaps the segments, leaving any that weren't drained
+	 * on disk for recovery
+	 * */
+	~spill_chan() {
+		for (size_t i = 0; i < segments.size(); i++) {
+			unmap(segments[i]);
+		}
+	}
+
+	spill_chan(const spill_chan& other) = delete;
+	spill_chan& operator=(const spill_chan& other) = delete;
+
+	/**
+	 * spilled returns the number of values on disk that haven't been read
+	 * */
+	uint64_t spilled() const {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+		return spilled_count;
+	}
+
+	/**
+	 * write adds a value to the ring, or to the end of the log if the ring
+	 * is full or the log isn't drained yet. It never blocks, and throws
+	 * spill_chan_io_exception if a segment cannot be created.
+	 *
+	 *
+	 * @param   val   const T&   the value to add
+	 * */
+	void write(const T& val) {
+		std::unique_lock<std::mutex> data_lock(this->data_mutex);
+
+		if (this->is_closed) {
+			throw _closed_channel_write_exception;
+		}
+
+		if (spilled_count == 0 && !ring.full()) {
+			ring.push(val);
+		} else {
+			append(val);
+		}
+
+		if (this->read_wait_count > 0) {
+			this->read_available.notify_one();
+		}
+	}
+
+	/**
+	 * read removes the oldest value, from the ring or the log, blocking
+	 * while both are empty
+	 *
+	 *
+	 * @param   valref   T&    the reference that is assigned the value in the front
+	 *
+	 * @return           bool  the result of this mission
+	 * */
+	bool read(T& valref) {
+		return read_with(valref, nullptr);
+	}
+
+	bool read(T& valref, context& ctx) {
+		return read_with(valref, &ctx);
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "spill_chan.hh"
+
+struct record {
+	int id;
+	double value;
+};
+
+std::string make_dir() {
+	char dir[] = "/tmp/spill_chan_test.XXXXXX";
+	return mkdtemp(dir);
+}
+
+int count_files(const std::string& dir) {
+	int n = 0;
+
+	DIR* d = opendir(dir.c_str());
+	struct dirent* entry;
+	while ((entry = readdir(d)) != nullptr) {
+		if (entry->d_name[0] != '.') {
+			n++;
+		}
+	}
+
+	closedir(d);
+	return n;
+}
+
+TEST(spill_chan, fifo_across_ring_and_disk) {
+	std::string dir = make_dir();
+
+	{
+		// each segment holds 4 records
+		chan::spill_chan<record> c(8, dir, false, 64 + 4 * sizeof(record));
+
+		for (int i = 0 ; i < 100 ; i++) {
+			record r = {i, i * 0.5};
+			c << r;
+		}
+
+		ASSERT_EQ(92u, c.spilled());
+		ASSERT_EQ(23, count_files(dir));
+
+		// reading interleaved with writing keeps the order
+		for (int i = 0 ; i < 50 ; i++) {
+			record r;
+			ASSERT_TRUE(c.read(r));
+			ASSERT_EQ(i, r.id);
+		}
+
+		for (int i = 100 ; i < 110 ; i++) {
+			record r = {i, i * 0.5};
+			c << r;
+		}
+
+		c.close();
+
+		record r;
+		for (int i = 50 ; i < 110 ; i++) {
+			ASSERT_TRUE(c.read(r));
+			ASSERT_EQ(i, r.id);
+			ASSERT_EQ(i * 0.5, r.value);
+		}
+
+		ASSERT_FALSE(c.read(r));
+
+		// consumed segments are deleted
+		ASSERT_EQ(0u, c.spilled());
+		ASSERT_EQ(0, count_files(dir));
+	}
+
+	rmdir(dir.c_str());
+}
+
+TEST(spill_chan, blocking_reader) {
+	std::string dir = make_dir();
+
+	{
+		chan::spill_chan<int> c(4, dir, false, 4096);
+
+		std::thread t([&](){
+			for (int i = 0 ; i < 10000 ; i++) {
+				c << i;
+			}
+
+			c.close();
+		});
+
+		int x = 0;
+		int expected = 0;
+		while (c.read(x)) {
+			ASSERT_EQ(expected, x);
+			expected++;
+		}
+
+		ASSERT_EQ(10000, expected);
+
+		t.join();
+	}
+
+	rmdir(dir.c_str());
+}
+
+TEST(spill_chan, recovery) {
+	std::string dir = make_dir();
+
+	{
+		chan::spill_chan<int> c(2, dir, false, 64 + 8 * sizeof(int));
+
+		for (int i = 0 ; i < 30 ; i++) {
+			c << i;
+		}
+
+		int x = 0;
+		for (int i = 0 ; i < 5 ; i++) {
+			c >> x;
+		}
+
+		// the ring held 0 and 1, the spilled values start at 2, and 3 of
+		// them were consumed
+	}
+
+	{
+		chan::spill_chan<int> c(2, dir, true, 64 + 8 * sizeof(int));
+
+		ASSERT_EQ(25u, c.spilled());
+
+		c << 30;
+		c.close();
+
+		int x = 0;
+		for (int i = 5 ; i <= 30 ; i++) {
+			ASSERT_TRUE(c.read(x));
+			ASSERT_EQ(i, x);
+		}
+
+		ASSERT_FALSE(c.read(x));
+	}
+
+	{
+		// without recovery, stale segments are removed
+		chan::spill_chan<int> c(2, dir, false, 64 + 8 * sizeof(int));
+
+		for (int i = 0 ; i < 10 ; i++) {
+			c << i;
+		}
+	}
+
+	{
+		chan::spill_chan<int> c(2, dir);
+		ASSERT_EQ(0u, c.spilled());
+		ASSERT_EQ(0, count_files(dir));
+	}
+
+	rmdir(dir.c_str());
+}
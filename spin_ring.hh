@@ -0,0 +1,293 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace chan {
+
+/**
+ * dynamic_capacity is the capacity parameter of rings and channels whose
+ * capacity is given to the constructor instead of fixed at compile time
+ * */
+const size_t dynamic_capacity = static_cast<size_t>(-1);
+
+/**
+ * ring_size rounds a capacity up to a power of two, so positions can be
+ * mapped to slots with a mask
+ * */
+constexpr size_t ring_size(size_t n, size_t size = 1) {
+	return size >= n ? size : ring_size(n, size * 2);
+}
+
+/**
+ * ring_slots holds the slots of a ring. With a capacity fixed at compile
+ * time they are stored inline, so the ring needs no allocation and the
+ * mask is a constant.
+ * */
+template <typename E, size_t Capacity, typename Allocator>
+class ring_slots {
+private:
+	static const size_t count = ring_size(Capacity);
+
+	E slots[count];
+
+public:
+	explicit ring_slots(size_t = Capacity, const Allocator& = Allocator()) : slots() {}
+
+	size_t size() const {
+		return count;
+	}
+
+	E& operator[](size_t pos) {
+		return slots[pos & (count - 1)];
+	}
+};
+
+/**
+ * ring_slots with a dynamic capacity allocates the slots from Allocator
+ * */
+template <typename E, typename Allocator>
+class ring_slots<E, dynamic_capacity, Allocator> {
+private:
+	typedef typename std::allocator_traits<Allocator>::template rebind_alloc<E> allocator_type;
+	typedef std::allocator_traits<allocator_type> traits;
+
+	allocator_type alloc;
+	size_t count;
+	E* slots;
+
+public:
+	explicit ring_slots(size_t capacity, const Allocator& alloc = Allocator())
+	    : alloc(alloc), count(ring_size(capacity)), slots(traits::allocate(this->alloc, count)) {
+		for (size_t i = 0; i < count; i++) {
+			traits::construct(this->alloc, slots + i);
+		}
+	}
+
+	~ring_slots() {
+		for (size_t i = 0; i < count; i++) {
+			traits::destroy(alloc, slots + i);
+		}
+
+		traits::deallocate(alloc, slots, count);
+	}
+
+	ring_slots(const ring_slots& other) = delete;
+	ring_slots& operator=(const ring_slots& other) = delete;
+
+	size_t size() const {
+		return count;
+	}
+
+	E& operator[](size_t pos) {
+		return slots[pos & (count - 1)];
+	}
+};
+
+/**
+ * spsc_ring is a lock free bounded queue for a single producer and a single
+ * consumer. Each side keeps a cached copy of the other side's position, so
+ * the shared positions are only read when the ring looks full or empty.
+ * The capacity is rounded up to a power of two.
+ * */
+template <typename T, size_t Capacity, typename Allocator = std::allocator<T>>
+class spsc_ring {
+private:
+	struct slot {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		T* value() {
+			return reinterpret_cast<T*>(&storage);
+		}
+	};
+
+	ring_slots<slot, Capacity, Allocator> slots;
+
+	// written by the consumer
+	alignas(64) std::atomic<size_t> head;
+	size_t cached_tail;
+
+	// written by the producer
+	alignas(64) std::atomic<size_t> tail;
+	size_t cached_head;
+
+public:
+	explicit spsc_ring(size_t capacity = Capacity, const Allocator& alloc = Allocator())
+	    : slots(capacity, alloc), head(0), cached_tail(0), tail(0), cached_head(0) {}
+
+	~spsc_ring() {
+		for (size_t pos = head.load(); pos != tail.load(); pos++) {
+			slots[pos].value()->~T();
+		}
+	}
+
+	spsc_ring(const spsc_ring& other) = delete;
+	spsc_ring& operator=(const spsc_ring& other) = delete;
+
+	size_t capacity() const {
+		return slots.size();
+	}
+
+	/**
+	 * try_push adds a value, returning false without touching it if the
+	 * ring is full. Only the producer may call it.
+	 * */
+	template <typename U>
+	bool try_push(U&& val) {
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if (t - cached_head == slots.size()) {
+			cached_head = head.load(std::memory_order_acquire);
+
+			if (t - cached_head == slots.size()) {
+				return false;
+			}
+		}
+
+		new (slots[t].value()) T(std::forward<U>(val));
+		tail.store(t + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * try_pop moves the oldest value out, returning false if the ring is
+	 * empty. Only the consumer may call it.
+	 * */
+	bool try_pop(T& valref) {
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if (h == cached_tail) {
+			cached_tail = tail.load(std::memory_order_acquire);
+
+			if (h == cached_tail) {
+				return false;
+			}
+		}
+
+		T* val = slots[h].value();
+		valref = std::move(*val);
+		val->~T();
+
+		head.store(h + 1, std::memory_order_release);
+
+		return true;
+	}
+};
+
+/**
+ * mpmc_ring is a lock free bounded queue for any number of producers and
+ * consumers, after Dmitry Vyukov's bounded MPMC queue. Every slot carries
+ * a sequence number that tells producers and consumers whose turn it is,
+ * so they only contend on the position they claim.
+ * The capacity is rounded up to a power of two.
+ * */
+template <typename T, size_t Capacity, typename Allocator = std::allocator<T>>
+class mpmc_ring {
+private:
+	struct slot {
+		std::atomic<size_t> seq;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		T* value() {
+			return reinterpret_cast<T*>(&storage);
+		}
+	};
+
+	ring_slots<slot, Capacity, Allocator> slots;
+
+	alignas(64) std::atomic<size_t> enqueue_pos;
+	alignas(64) std::atomic<size_t> dequeue_pos;
+
+public:
+	explicit mpmc_ring(size_t capacity = Capacity, const Allocator& alloc = Allocator())
+	    : slots(capacity, alloc), enqueue_pos(0), dequeue_pos(0) {
+		for (size_t i = 0; i < slots.size(); i++) {
+			slots[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~mpmc_ring() {
+		for (size_t pos = dequeue_pos.load(); pos != enqueue_pos.load(); pos++) {
+			if (slots[pos].seq.load() == pos + 1) {
+				slots[pos].value()->~T();
+			}
+		}
+	}
+
+	mpmc_ring(const mpmc_ring& other) = delete;
+	mpmc_ring& operator=(const mpmc_ring& other) = delete;
+
+	size_t capacity() const {
+		return slots.size();
+	}
+
+	/**
+	 * try_push adds a value, returning false without touching it if the
+	 * ring is full
+	 * */
+	template <typename U>
+	bool try_push(U&& val) {
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		slot* s = nullptr;
+
+		while (true) {
+			s = &slots[pos];
+			intptr_t diff = static_cast<intptr_t>(s->seq.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos);
+
+			if (diff == 0) {
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		new (s->value()) T(std::forward<U>(val));
+		s->seq.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * try_pop moves the oldest value out, returning false if the ring is
+	 * empty
+	 * */
+	bool try_pop(T& valref) {
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		slot* s = nullptr;
+
+		while (true) {
+			s = &slots[pos];
+			intptr_t diff = static_cast<intptr_t>(s->seq.load(std::memory_order_acquire)) - static_cast<intptr_t>(pos + 1);
+
+			if (diff == 0) {
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		T* val = s->value();
+		valref = std::move(*val);
+		val->~T();
+
+		s->seq.store(pos + slots.size(), std::memory_order_release);
+
+		return true;
+	}
+};
+
+}  // namespace chan
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "spin_ring.hh"
+
+TEST(spin_ring, capacity) {
+	ASSERT_EQ(1u, chan::ring_size(1));
+	ASSERT_EQ(8u, chan::ring_size(5));
+	ASSERT_EQ(64u, chan::ring_size(64));
+
+	chan::spsc_ring<int, 100> fixed;
+	ASSERT_EQ(128u, fixed.capacity());
+
+	chan::mpmc_ring<int, chan::dynamic_capacity> dynamic(3);
+	ASSERT_EQ(4u, dynamic.capacity());
+}
+
+TEST(spin_ring, spsc_full_empty) {
+	chan::spsc_ring<int, 4> r;
+
+	int x = 0;
+	ASSERT_FALSE(r.try_pop(x));
+
+	for (int round = 0 ; round < 3 ; round++) {
+		for (int i = 0 ; i < 4 ; i++) {
+			ASSERT_TRUE(r.try_push(i));
+		}
+		ASSERT_FALSE(r.try_push(4));
+
+		for (int i = 0 ; i < 4 ; i++) {
+			ASSERT_TRUE(r.try_pop(x));
+			ASSERT_EQ(i, x);
+		}
+		ASSERT_FALSE(r.try_pop(x));
+	}
+}
+
+TEST(spin_ring, mpmc_full_empty) {
+	chan::mpmc_ring<std::string, chan::dynamic_capacity> r(2);
+
+	std::string s;
+	ASSERT_FALSE(r.try_pop(s));
+
+	for (int round = 0 ; round < 3 ; round++) {
+		ASSERT_TRUE(r.try_push(std::string("a")));
+		ASSERT_TRUE(r.try_push(std::string("b")));
+		ASSERT_FALSE(r.try_push(std::string("c")));
+
+		ASSERT_TRUE(r.try_pop(s));
+		ASSERT_EQ("a", s);
+		ASSERT_TRUE(r.try_pop(s));
+		ASSERT_EQ("b", s);
+		ASSERT_FALSE(r.try_pop(s));
+	}
+}
+
+TEST(spin_ring, destroys_remaining) {
+	std::shared_ptr<int> p(new int(1));
+
+	{
+		chan::spsc_ring<std::shared_ptr<int>, 4> a;
+		chan::mpmc_ring<std::shared_ptr<int>, 4> b;
+
+		a.try_push(p);
+		b.try_push(p);
+		b.try_push(p);
+
+		ASSERT_EQ(4, p.use_count());
+	}
+
+	ASSERT_EQ(1, p.use_count());
+}
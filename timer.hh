@@ -0,0 +1,467 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "chan.hh"
+
+namespace chan {
+
+struct timer_invalid_period_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot create a ticker with a non-positive period";
+	}
+} _timer_invalid_period_exception;
+
+typedef std::chrono::steady_clock timer_clock;
+
+class timer_wheel;
+
+/**
+ * timer_node is a single entry in a timer_wheel. Nodes are intrusive and
+ * doubly linked into the slot lists of the wheel, so scheduling and
+ * cancelling a timer are constant time list operations that never
+ * allocate.
+ * */
+class timer_node {
+	friend class timer_wheel;
+
+private:
+	timer_node* next;
+	timer_node** pprev;
+
+	uint64_t expires;
+
+	timer_clock::time_point due;
+	timer_clock::duration period;
+
+public:
+	timer_node() : next(nullptr), pprev(nullptr), expires(0) {}
+	virtual ~timer_node() {}
+
+	/**
+	 * fire is invoked on the timer thread, with the wheel locked, every
+	 * time the node expires. Implementations must not block and must not
+	 * call back into the wheel.
+	 *
+	 *
+	 * @param   now   timer_clock::time_point   the time of expiry
+	 * */
+	virtual void fire(timer_clock::time_point now) = 0;
+};
+
+/**
+ * timer_wheel implements a hierarchical hashed timing wheel, driven by a
+ * single background thread that is shared by every timer in the process.
+ *
+ * There are 4 levels of 256 slots, each level covering 256 times the
+ * span of the level below it. Level 0 has a granularity of
+ * timer_wheel::resolution(). Timers are hashed into a slot on insertion
+ * and moved down a level whenever the level below completes a
+ * revolution, so both insertion and cancellation are O(1) regardless of
+ * the number of pending timers.
+ *
+ * The thread never polls: it sleeps until the next occupied level 0 slot,
+ * or the next cascade, and is woken early only when a timer is scheduled
+ * ahead of that.
+ * */
+class timer_wheel {
+private:
+	static const int level_bits = 8;
+	static const int levels = 4;
+	static const uint64_t slots = 1 << level_bits;
+	static const uint64_t slot_mask = slots - 1;
+
+	timer_node* wheel[levels][slots];
+
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::thread thread;
+	bool stopping;
+
+	timer_clock::time_point epoch;
+	timer_clock::time_point sleep_until;
+
+	// next_tick is the next tick to be processed, every tick before it has
+	// been expired
+	uint64_t next_tick;
+	uint64_t pending;
+
+	timer_wheel()
+	    : stopping(false),
+	      epoch(timer_clock::now()),
+	      sleep_until(timer_clock::time_point::max()),
+	      next_tick(0),
+	      pending(0) {
+		for (int level = 0; level < levels; level++) {
+			for (uint64_t i = 0; i < slots; i++) {
+				wheel[level][i] = nullptr;
+			}
+		}
+
+		thread = std::thread(&timer_wheel::run, this);
+	}
+
+	/**
+	 * tick_of converts a time point to the first tick at or after it
+	 * */
+	uint64_t tick_of(timer_clock::time_point t) const {
+		if (t <= epoch) {
+			return 0;
+		}
+
+		timer_clock::duration res = resolution();
+		return static_cast<uint64_t>((t - epoch + res - timer_clock::duration(1)) / res);
+	}
+
+	/**
+	 * current_tick returns the last tick that has completely elapsed
+	 * */
+	uint64_t current_tick(timer_clock::time_point now) const {
+		return static_cast<uint64_t>((now - epoch) / resolution());
+	}
+
+	void link(timer_node* node, timer_node** head) {
+		node->next = *head;
+		if (node->next) {
+			node->next->pprev = &node->next;
+		}
+
+		*head = node;
+		node->pprev = head;
+	}
+
+	void unlink(timer_node* node) {
+		*node->pprev = node->next;
+		if (node->next) {
+			node->next->pprev = node->pprev;
+		}
+
+		node->next = nullptr;
+		node->pprev = nullptr;
+	}
+
+	/**
+	 * insert hashes a node into the slot covering its expiry, relative to
+	 * next_tick
+	 * */
+	void insert(timer_node* node) {
+		uint64_t expires = node->expires < next_tick ? next_tick : node->expires;
+		uint64_t delta = expires - next_tick;
+
+		int level = 0;
+		while (level < levels - 1 && delta >= (1ULL << ((level + 1) * level_bits))) {
+			level++;
+		}
+
+		// anything beyond the span of the wheel waits in the farthest slot,
+		// and is rehashed when that slot cascades
+		if (delta >= (1ULL << (levels * level_bits))) {
+			expires = next_tick + (1ULL << (levels * level_bits)) - 1;
+		}
+
+		link(node, &wheel[level][(expires >> (level * level_bits)) & slot_mask]);
+	}
+
+	/**
+	 * cascade rehashes every node in a slot, moving it to a lower level
+	 * */
+	void cascade(int level, uint64_t index) {
+		timer_node* list = wheel[level][index];
+		wheel[level][index] = nullptr;
+
+		while (list) {
+			timer_node* node = list;
+			list = list->next;
+
+			node->next = nullptr;
+			node->pprev = nullptr;
+			insert(node);
+		}
+	}
+
+	/**
+	 * advance expires every tick up to and including target
+	 * */
+	void advance(uint64_t target, timer_clock::time_point now) {
+		if (pending == 0) {
+			// nothing to expire, skip the idle ticks entirely
+			if (next_tick <= target) {
+				next_tick = target + 1;
+			}
+
+			return;
+		}
+
+		while (next_tick <= target) {
+			uint64_t index = next_tick & slot_mask;
+
+			if (index == 0) {
+				for (int level = 1; level < levels; level++) {
+					uint64_t i = (next_tick >> (level * level_bits)) & slot_mask;
+					cascade(level, i);
+
+					if (i != 0) {
+						break;
+					}
+				}
+			}
+
+			next_tick++;
+
+			timer_node* expired = wheel[0][index];
+			wheel[0][index] = nullptr;
+			if (expired) {
+				expired->pprev = &expired;
+			}
+
+			while (expired) {
+				timer_node* node = expired;
+				unlink(node);
+				pending--;
+
+				node->fire(now);
+
+				if (node->period > timer_clock::duration::zero()) {
+					node->due += node->period;
+
+					// like go, a ticker that fell behind drops the missed ticks
+					// instead of firing them back to back
+					if (node->due <= now) {
+						node->due += node->period * ((now - node->due) / node->period + 1);
+					}
+
+					node->expires = tick_of(node->due);
+
+					insert(node);
+					pending++;
+				}
+			}
+		}
+	}
+
+	/**
+	 * next_expiry returns the tick that the thread must wake up at. This is
+	 * either the next occupied level 0 slot or the next cascade, whichever
+	 * comes first.
+	 * */
+	uint64_t next_expiry() const {
+		uint64_t index = next_tick & slot_mask;
+		if (index == 0) {
+			return next_tick;
+		}
+
+		for (uint64_t i = index; i < slots; i++) {
+			if (wheel[0][i]) {
+				return (next_tick & ~slot_mask) + i;
+			}
+		}
+
+		return (next_tick | slot_mask) + 1;
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (!stopping) {
+			timer_clock::time_point now = timer_clock::now();
+			advance(current_tick(now), now);
+
+			if (pending == 0) {
+				sleep_until = timer_clock::time_point::max();
+				wakeup.wait(lock);
+			} else {
+				sleep_until = epoch + resolution() * static_cast<timer_clock::rep>(next_expiry());
+				wakeup.wait_until(lock, sleep_until);
+			}
+		}
+	}
+
+public:
+	~timer_wheel() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+			wakeup.notify_one();
+		}
+
+		thread.join();
+	}
+
+	timer_wheel(const timer_wheel& other) = delete;
+	timer_wheel& operator=(const timer_wheel& other) = delete;
+
+	/**
+	 * instance returns the process wide timer wheel, starting its thread
+	 * on first use.
+	 *
+	 * The wheel is never destroyed, so timer channels with static storage
+	 * duration can still cancel their timers when they are destroyed at
+	 * exit, whatever the order of destruction.
+	 * */
+	static timer_wheel& instance() {
+		static timer_wheel* wheel = new timer_wheel();
+		return *wheel;
+	}
+
+	/**
+	 * resolution is the granularity of the lowest level of the wheel
+	 * */
+	static timer_clock::duration resolution() {
+		return std::chrono::microseconds(100);
+	}
+
+	/**
+	 * schedule arms a node to fire at "when", and then every "period" after
+	 * that if period is positive.
+	 *
+	 *
+	 * @param   node     timer_node*               the node to schedule
+	 * @param   when     timer_clock::time_point   the first expiry
+	 * @param   period   timer_clock::duration     the repeat interval
+	 * */
+	void schedule(timer_node* node, timer_clock::time_point when, timer_clock::duration period) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (node->pprev) {
+			unlink(node);
+			pending--;
+		}
+
+		if (pending == 0) {
+			uint64_t now_tick = current_tick(timer_clock::now());
+			if (next_tick < now_tick) {
+				next_tick = now_tick;
+			}
+		}
+
+		node->due = when;
+		node->period = period;
+		node->expires = tick_of(when);
+
+		insert(node);
+		pending++;
+
+		if (when < sleep_until) {
+			wakeup.notify_one();
+		}
+	}
+
+	/**
+	 * cancel removes a node from the wheel. Once it returns the node will
+	 * not be fired again, even if it was just about to expire.
+	 *
+	 *
+	 * @param   node   timer_node*   the node to cancel
+	 *
+	 * @return         bool          true if the node was pending
+	 * */
+	bool cancel(timer_node* node) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (!node->pprev) {
+			return false;
+		}
+
+		unlink(node);
+		pending--;
+		return true;
+	}
+};
+
+/**
+ * timer_chan is a single element buffered channel fed by the shared
+ * timer_wheel. Like go's timer channels, values that cannot be delivered
+ * because the reader has not consumed the previous one are dropped
+ * rather than blocking the timer thread.
+ *
+ * Closing the channel cancels the timer, and drops a value that was not
+ * read yet, so a reader never sees a timer fire after it was stopped, like
+ * go's Timer.Stop since go 1.23.
+ * */
+class timer_chan : public buffered_chan<timer_clock::time_point>, private timer_node {
+private:
+	typedef buffered_chan<timer_clock::time_point> base_chan;
+
+	void fire(timer_clock::time_point now) {
+		this->try_write(now);
+	}
+
+public:
+	timer_chan(timer_clock::time_point when, timer_clock::duration period)
+	    : base_chan(1) {
+		timer_wheel::instance().schedule(this, when, period);
+	}
+
+	~timer_chan() {
+		timer_wheel::instance().cancel(this);
+	}
+
+	timer_chan(const timer_chan& other) = delete;
+	timer_chan& operator=(const timer_chan& other) = delete;
+
+	/**
+	 * close stops the timer, and drops the value it may have fired before,
+	 * before closing the channel
+	 * */
+	bool close() {
+		timer_wheel::instance().cancel(this);
+
+		timer_clock::time_point stale;
+		this->try_read(stale);
+
+		return base_chan::close();
+	}
+};
+
+/**
+ * after returns a channel that receives the current time once the
+ * duration has elapsed, similar to go's time.After
+ *
+ * example usage:
+ *
+ * ```
+ * auto timeout = chan::after(std::chrono::milliseconds(10));
+ *
+ * chan::timer_clock::time_point t;
+ * timeout->read(t);
+ * ```
+ *
+ *
+ * @param   d   std::chrono::duration   the time to wait for
+ *
+ * @return      std::shared_ptr<read_chan<timer_clock::time_point>>
+ * */
+template <typename Rep, typename Period>
+std::shared_ptr<read_chan<timer_clock::time_point>> after(const std::chrono::duration<Rep, Period>& d) {
+	return std::make_shared<timer_chan>(
+	    timer_clock::now() + std::chrono::duration_cast<timer_clock::duration>(d),
+	    timer_clock::duration::zero());
+}
+
+/**
+ * ticker returns a channel that receives the current time every period,
+ * similar to go's time.Ticker. Ticks are dropped for slow readers, and the
+ * ticker keeps running until the channel is closed or destroyed.
+ *
+ *
+ * @param   period   std::chrono::duration   the interval between ticks
+ *
+ * @return           std::shared_ptr<read_chan<timer_clock::time_point>>
+ * */
+template <typename Rep, typename Period>
+std::shared_ptr<read_chan<timer_clock::time_point>> ticker(const std::chrono::duration<Rep, Period>& period) {
+	timer_clock::duration p = std::chrono::duration_cast<timer_clock::duration>(period);
+	if (p <= timer_clock::duration::zero()) {
+		throw _timer_invalid_period_exception;
+	}
+
+	return std::make_shared<timer_chan>(timer_clock::now() + p, p);
+}
+
+}  // namespace chan
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "timer.hh"
+
+TEST(timer, after) {
+	auto start = chan::timer_clock::now();
+	auto c = chan::after(std::chrono::milliseconds(5));
+
+	chan::timer_clock::time_point t;
+	ASSERT_EQ(true, c->read(t));
+
+	auto elapsed = chan::timer_clock::now() - start;
+	ASSERT_GE(elapsed, std::chrono::milliseconds(5));
+	ASSERT_GE(t - start, std::chrono::milliseconds(5));
+}
+
+TEST(timer, after_close) {
+	auto c = chan::after(std::chrono::milliseconds(1));
+	c->close();
+
+	chan::timer_clock::time_point t;
+	ASSERT_EQ(false, c->read(t));
+}
+
+TEST(timer, after_close_fired) {
+	auto c = chan::after(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	// the timer has fired, but the value is dropped with the channel
+	c->close();
+
+	chan::timer_clock::time_point t;
+	ASSERT_EQ(false, c->read(t));
+}
+
+TEST(timer, ticker) {
+	auto start = chan::timer_clock::now();
+	auto c = chan::ticker(std::chrono::milliseconds(2));
+
+	chan::timer_clock::time_point t;
+	for (int i = 1; i <= 5; i++) {
+		ASSERT_EQ(true, c->read(t));
+		ASSERT_GE(t - start, std::chrono::milliseconds(2 * i));
+	}
+
+	c->close();
+	ASSERT_EQ(false, c->read(t));
+}
+
+TEST(timer, ticker_invalid_period) {
+	ASSERT_THROW(chan::ticker(std::chrono::milliseconds(0)), chan::timer_invalid_period_exception);
+}
+
+TEST(timer, many) {
+	const int count = 100000;
+
+	std::vector<std::shared_ptr<chan::read_chan<chan::timer_clock::time_point>>> timers;
+	timers.reserve(count);
+
+	auto start = chan::timer_clock::now();
+	for (int i = 0; i < count; i++) {
+		timers.push_back(chan::after(std::chrono::microseconds(20000 + 10 * (i % 1000))));
+
+		// cancel every other timer
+		if (i % 2 == 0) {
+			timers[i]->close();
+		}
+	}
+
+	chan::timer_clock::time_point t;
+	for (int i = 0; i < count; i++) {
+		if (i % 2 == 0) {
+			ASSERT_EQ(false, timers[i]->read(t));
+		} else {
+			ASSERT_EQ(true, timers[i]->read(t));
+			ASSERT_GE(t - start, std::chrono::microseconds(20000 + 10 * (i % 1000)));
+		}
+	}
+}
+
+// destroyed at exit, after the wheel's first use inside main
+std::shared_ptr<chan::read_chan<chan::timer_clock::time_point>> static_timer;
+
+TEST(timer, static_storage) {
+	static_timer = chan::after(std::chrono::seconds(60));
+	ASSERT_FALSE(static_timer->isClosed());
+}
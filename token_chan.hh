@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+
+#include "chan.hh"
+#include "futex.hh"
+
+namespace chan {
+
+struct token_chan_overflow_exception: public std::exception {
+	virtual const char* what() const throw() {
+		return "cannot release more tokens than a token channel can count";
+	}
+} _token_chan_overflow_exception;
+
+/**
+ * token is the empty value carried by a token_chan
+ * */
+struct token {};
+
+/**
+ * token_chan is a channel of payload free tokens, like a chan struct{} in
+ * go, to be used as a counting semaphore, for example to bound the number
+ * of requests in flight.
+ *
+ * The tokens are a count in a single atomic word, so acquiring and
+ * releasing is one compare and swap or add when tokens are available. An
+ * acquire spins briefly and then parks on a futex only when the tokens are
+ * exhausted, and a release only makes a system call if someone is parked.
+ *
+ * read and acquire take tokens, write and release return them. After
+ * close, the tokens that are left can still be acquired, and acquire
+ * returns false once they run out, like reads of a drained channel.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::token_chan in_flight(64);
+ *
+ * in_flight.acquire();
+ * send_request(req, [&](){ in_flight.release(); });
+ * ```
+ * */
+class token_chan : public read_chan<token>, public write_chan<token> {
+private:
+	static const int spin_limit = 128;
+
+	// the top bit of the word marks the channel closed, the rest count the
+	// tokens
+	static const uint32_t closed = 0x80000000u;
+	static const uint32_t count_mask = 0x7fffffffu;
+
+	std::atomic<uint32_t> word;
+	std::atomic<uint32_t> waiters;
+
+	bool take(uint32_t& s, uint32_t k) {
+		return (s & count_mask) >= k && word.compare_exchange_weak(s, s - k);
+	}
+
+public:
+	/**
+	 * The constructor throws token_chan_overflow_exception for more tokens
+	 * than release accepts, 2^31 - 1.
+	 *
+	 *
+	 * @param   tokens   uint32_t   the number of tokens initially available
+	 * */
+	explicit token_chan(uint32_t tokens = 0) : word(tokens), waiters(0) {
+		if (tokens > count_mask) {
+			throw _token_chan_overflow_exception;
+		}
+	}
+
+	token_chan(const token_chan& other) = delete;
+	token_chan& operator=(const token_chan& other) = delete;
+
+	/**
+	 * available returns the number of tokens that can be acquired right now
+	 * */
+	uint32_t available() const {
+		return word.load() & count_mask;
+	}
+
+	/**
+	 * close closes the channel, waking up all waiting acquires
+	 * */
+	bool close() {
+		if ((word.fetch_or(closed) & closed) != 0) {
+			throw _channel_closed_exception;
+		}
+
+		futex_wake(&word);
+
+		return true;
+	}
+
+	bool isClosed() const {
+		return (word.load() & closed) != 0;
+	}
+
+	/**
+	 * try_acquire takes k tokens if that many are available, without
+	 * waiting
+	 *
+	 *
+	 * @param   k   uint32_t   the number of tokens
+	 *
+	 * @return      bool       true if the tokens were taken
+	 * */
+	bool try_acquire(uint32_t k = 1) {
+		uint32_t s = word.load();
+
+		while ((s & count_mask) >= k) {
+			if (take(s, k)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * acquire takes k tokens at once, blocking until that many are
+	 * available
+	 *
+	 *
+	 * @param   k   uint32_t   the number of tokens
+	 *
+	 * @return      bool       true if the tokens were taken, false if the
+	 *                         channel was closed without enough of them
+	 * */
+	bool acquire(uint32_t k = 1) {
+		uint32_t s = word.load();
+
+		for (int spins = 0; spins < spin_limit; spins++) {
+			if (take(s, k)) {
+				return true;
+			}
+
+			if ((s & count_mask) < k) {
+				if ((s & closed) != 0) {
+					return false;
+				}
+
+				s = word.load();
+			}
+		}
+
+		while (true) {
+			if (take(s, k)) {
+				return true;
+			}
+
+			if ((s & count_mask) >= k) {
+				continue;
+			}
+
+			if ((s & closed) != 0) {
+				return false;
+			}
+
+			waiters.fetch_add(1);
+
+			s = word.load();
+			if ((s & count_mask) < k && (s & closed) == 0) {
+				futex_wait(&word, s);
+				s = word.load();
+			}
+
+			waiters.fetch_sub(1);
+		}
+	}
+
+	/**
+	 * release returns k tokens, waking up waiting acquires. It throws
+	 * closed_channel_write_exception if the channel is closed, and
+	 * token_chan_overflow_exception if the count would go past 2^31 - 1,
+	 * leaving the tokens as they were.
+	 *
+	 *
+	 * @param   k   uint32_t   the number of tokens
+	 * */
+	void release(uint32_t k = 1) {
+		uint32_t s = word.load();
+
+		do {
+			if ((s & closed) != 0) {
+				throw _closed_channel_write_exception;
+			}
+
+			// the count must not carry into the closed bit
+			if (k > count_mask - (s & count_mask)) {
+				throw _token_chan_overflow_exception;
+			}
+		} while (!word.compare_exchange_weak(s, s + k));
+
+		// acquires wait for different numbers of tokens, so all of them
+		// check again
+		if (waiters.load() > 0) {
+			futex_wake(&word);
+		}
+	}
+
+	/**
+	 * read takes a token, see acquire
+	 * */
+	bool read(token& valref) {
+		valref = token();
+		return acquire(1);
+	}
+
+	/**
+	 * write returns a token, see release
+	 * */
+	void write(const token&) {
+		release(1);
+	}
+};
+
+}  // namespace chan
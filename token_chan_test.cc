@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "token_chan.hh"
+
+TEST(token_chan, bounds_concurrency) {
+	chan::token_chan in_flight(3);
+
+	std::atomic<int> active(0);
+	std::atomic<int> peak(0);
+
+	std::vector<std::thread> threads;
+	for (int t = 0 ; t < 8 ; t++) {
+		threads.push_back(std::thread([&](){
+			for (int i = 0 ; i < 200 ; i++) {
+				ASSERT_TRUE(in_flight.acquire());
+
+				int now = ++active;
+				int p = peak.load();
+				while (now > p && !peak.compare_exchange_weak(p, now)) {
+				}
+
+				std::this_thread::yield();
+
+				active--;
+				in_flight.release();
+			}
+		}));
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	ASSERT_LE(peak.load(), 3);
+	ASSERT_EQ(3u, in_flight.available());
+}
+
+TEST(token_chan, batch) {
+	chan::token_chan c(2);
+
+	ASSERT_FALSE(c.try_acquire(3));
+	ASSERT_TRUE(c.try_acquire(2));
+	ASSERT_EQ(0u, c.available());
+
+	std::atomic<bool> acquired(false);
+	std::thread t([&](){
+		ASSERT_TRUE(c.acquire(4));
+		acquired = true;
+	});
+
+	c.release(1);
+	c.release(2);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_FALSE(acquired.load());
+
+	c.release(1);
+	t.join();
+
+	ASSERT_TRUE(acquired.load());
+	ASSERT_EQ(0u, c.available());
+}
+
+TEST(token_chan, close) {
+	chan::token_chan c(1);
+
+	std::thread t([&](){
+		chan::token tok;
+		ASSERT_TRUE(c.read(tok));
+		ASSERT_FALSE(c.read(tok));
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	c.close();
+	t.join();
+
+	ASSERT_TRUE(c.isClosed());
+	ASSERT_THROW(c.release(), chan::closed_channel_write_exception);
+	ASSERT_THROW(c.close(), chan::channel_closed_exception);
+}
+
+TEST(token_chan, overflow) {
+	chan::token_chan c(0x7ffffff0u);
+
+	// a release that does not fit is refused, instead of closing the channel
+	ASSERT_THROW(c.release(0x20), chan::token_chan_overflow_exception);
+	ASSERT_FALSE(c.isClosed());
+	ASSERT_EQ(0x7ffffff0u, c.available());
+
+	c.release(0xf);
+	ASSERT_EQ(0x7fffffffu, c.available());
+	ASSERT_THROW(c.release(), chan::token_chan_overflow_exception);
+
+	// counts that would set the closed bit are refused up front as well
+	ASSERT_THROW(chan::token_chan(0x80000000u), chan::token_chan_overflow_exception);
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+/**
+ * Opt in tracing of channel operations, enabled by compiling with
+ * -DCHAN_TRACE. Without it the hooks in the channels expand to nothing.
+ *
+ * Each thread records events into its own buffer, a list of fixed size
+ * chunks that only that thread appends to, so recording takes no lock and
+ * shares no cache lines. Chunks that write_json has written are handed
+ * back to their thread and reused, so a long running process that writes
+ * its trace periodically keeps a bounded buffer. The events are:
+ *
+ * - block begin and end, around every wait of a reader or writer
+ * - handoff, when a reader takes the value of a writer of an unbuffered
+ * channel. Buffered channels don't record it, it would cost an event per
+ * value, the block events show when their peers wait on each other.
+ * - close
+ * - depth samples of buffered channels, on a fraction of writes
+ *
+ * write_json writes the events recorded since the previous write_json in
+ * the Chrome trace event format, which chrome://tracing and
+ * https://ui.perfetto.dev open.
+ *
+ * Compiling with -DCHAN_TRACE_USDT as well adds USDT probes, provider
+ * "chan", for every event, see <sys/sdt.h>, which can be traced with
+ * bpftrace, perf or systemtap without rebuilding.
+ *
+ * example usage:
+ *
+ * ```
+ * // g++ -DCHAN_TRACE ...
+ * run_pipeline();
+ * chan::trace::write_json("pipeline.json");
+ * ```
+ * */
+
+#ifdef CHAN_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#ifdef CHAN_TRACE_USDT
+#include <sys/sdt.h>
+#endif
+
+namespace chan {
+namespace trace {
+
+enum class event_type : uint8_t {
+	block_begin,
+	block_end,
+	handoff,
+	close,
+	depth,
+};
+
+enum class op : uint8_t {
+	none,
+	read,
+	write,
+};
+
+struct event {
+	uint64_t ts;
+	const void* chan;
+	int64_t value;
+	event_type type;
+	op operation;
+};
+
+/**
+ * depth_interval is the number of writes of a thread per depth sample
+ * */
+const uint32_t depth_interval = 64;
+
+const size_t chunk_size = 4096;
+
+struct chunk {
+	event events[chunk_size];
+
+	// published with release after the event is written, so a flush from
+	// another thread only reads complete events
+	std::atomic<size_t> count;
+	std::atomic<chunk*> next;
+
+	chunk() : count(0), next(nullptr) {}
+};
+
+struct thread_buffer {
+	uint32_t tid;
+
+	// the chunk the thread appends to, and the chunks written already, that
+	// it reuses before allocating
+	chunk* last;
+	chunk* free;
+	std::atomic<chunk*> recycled;
+
+	uint32_t depth_tick;
+
+	// the oldest chunk not written yet, and how many of its events were
+	// written, only used by write_json
+	chunk* first;
+	size_t consumed;
+
+	explicit thread_buffer(uint32_t tid)
+	    : tid(tid), last(new chunk()), free(nullptr), recycled(nullptr), depth_tick(0), first(last), consumed(0) {}
+
+	/**
+	 * fresh returns an empty chunk, a recycled one if there is one
+	 * */
+	chunk* fresh() {
+		if (free == nullptr) {
+			free = recycled.exchange(nullptr, std::memory_order_acquire);
+		}
+
+		if (free == nullptr) {
+			return new chunk();
+		}
+
+		chunk* c = free;
+		free = c->next.load(std::memory_order_relaxed);
+
+		c->count.store(0, std::memory_order_relaxed);
+		c->next.store(nullptr, std::memory_order_relaxed);
+
+		return c;
+	}
+
+	/**
+	 * recycle hands a chunk the thread has moved past back to it
+	 * */
+	void recycle(chunk* c) {
+		chunk* head = recycled.load(std::memory_order_relaxed);
+
+		do {
+			c->next.store(head, std::memory_order_relaxed);
+		} while (!recycled.compare_exchange_weak(head, c, std::memory_order_release, std::memory_order_relaxed));
+	}
+};
+
+/**
+ * registry owns the buffers of all threads that recorded events. Buffers
+ * are kept after their thread exits, so its events can still be written.
+ * */
+struct registry {
+	std::mutex mutex;
+
+	// serializes write_json, which consumes the buffers
+	std::mutex flush_mutex;
+
+	std::vector<thread_buffer*> buffers;
+	std::chrono::steady_clock::time_point start;
+
+	registry() : start(std::chrono::steady_clock::now()) {}
+
+	thread_buffer* add() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		buffers.push_back(new thread_buffer(static_cast<uint32_t>(buffers.size() + 1)));
+		return buffers.back();
+	}
+};
+
+inline registry& global() {
+	static registry r;
+	return r;
+}
+
+inline thread_buffer& local() {
+	static thread_local thread_buffer* buffer = nullptr;
+
+	if (buffer == nullptr) {
+		buffer = global().add();
+	}
+
+	return *buffer;
+}
+
+inline void record(event_type type, const void* c, op operation, int64_t value) {
+	thread_buffer& b = local();
+
+	size_t n = b.last->count.load(std::memory_order_relaxed);
+	if (n == chunk_size) {
+		chunk* fresh = b.fresh();
+		b.last->next.store(fresh, std::memory_order_release);
+		b.last = fresh;
+		n = 0;
+	}
+
+	event& e = b.last->events[n];
+	e.ts = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - global().start).count();
+	e.chan = c;
+	e.value = value;
+	e.type = type;
+	e.operation = operation;
+
+	b.last->count.store(n + 1, std::memory_order_release);
+}
+
+/**
+ * sample_depth checks if this write should record a depth sample
+ * */
+inline bool sample_depth() {
+	return local().depth_tick++ % depth_interval == 0;
+}
+
+inline const char* name_of(const event& e) {
+	switch (e.type) {
+		case event_type::block_begin:
+		case event_type::block_end:
+			return e.operation == op::read ? "read blocked" : "write blocked";
+		case event_type::handoff:
+			return e.operation == op::read ? "handoff to reader" : "handoff to writer";
+		case event_type::close:
+			return "close";
+		default:
+			return "depth";
+	}
+}
+
+inline void write_event(FILE* out, const event& e, uint32_t tid, bool& first) {
+	const char* sep = first ? "\n" : ",\n";
+	first = false;
+
+	double ts = e.ts / 1000.0;
+
+	switch (e.type) {
+		case event_type::block_begin:
+		case event_type::block_end:
+			fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"chan\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"chan\":\"%p\"}}",
+			        sep, name_of(e), e.type == event_type::block_begin ? "B" : "E", ts, tid, e.chan);
+			break;
+		case event_type::depth:
+			fprintf(out, "%s{\"name\":\"depth %p\",\"cat\":\"chan\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"depth\":%lld}}",
+			        sep, e.chan, ts, tid, static_cast<long long>(e.value));
+			break;
+		default:
+			fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"chan\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"chan\":\"%p\"}}",
+			        sep, name_of(e), ts, tid, e.chan);
+			break;
+	}
+}
+
+/**
+ * write_json writes the events recorded by all threads since the previous
+ * call as a Chrome trace, and recycles the chunks it has written. It can
+ * be called while other threads record, their newer events are left for
+ * the next call. A block that spans two calls has its begin and its end
+ * in different traces.
+ *
+ *
+ * @param   out   FILE*    the file to write to
+ *
+ * @return        size_t   the number of events written
+ * */
+inline size_t write_json(FILE* out) {
+	std::unique_lock<std::mutex> flush_lock(global().flush_mutex);
+
+	std::vector<thread_buffer*> buffers;
+
+	{
+		std::unique_lock<std::mutex> lock(global().mutex);
+		buffers = global().buffers;
+	}
+
+	size_t written = 0;
+	bool first = true;
+
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	for (size_t i = 0; i < buffers.size(); i++) {
+		uint32_t tid = buffers[i]->tid;
+
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+		        first ? "\n" : ",\n", tid, tid);
+		first = false;
+
+		thread_buffer* b = buffers[i];
+
+		while (true) {
+			chunk* c = b->first;
+			size_t n = c->count.load(std::memory_order_acquire);
+
+			for (size_t j = b->consumed; j < n; j++) {
+				write_event(out, c->events[j], tid, first);
+				written++;
+			}
+
+			b->consumed = n;
+
+			// a chunk is only done with once the thread has moved on to the
+			// next one, it still appends to the last
+			chunk* next = c->next.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				break;
+			}
+
+			b->first = next;
+			b->consumed = 0;
+			b->recycle(c);
+		}
+	}
+
+	fprintf(out, "\n]}\n");
+
+	return written;
+}
+
+/**
+ * write_json to a path creates or truncates the file, and returns false
+ * if it cannot be opened
+ * */
+inline bool write_json(const char* path) {
+	FILE* out = fopen(path, "w");
+	if (out == nullptr) {
+		return false;
+	}
+
+	write_json(out);
+	fclose(out);
+
+	return true;
+}
+
+}  // namespace trace
+}  // namespace chan
+
+#ifdef CHAN_TRACE_USDT
+#define CHAN_TRACE_PROBE(name, ch, value) DTRACE_PROBE2(chan, name, ch, value)
+#else
+#define CHAN_TRACE_PROBE(name, ch, value) \
+	do {                                  \
+	} while (0)
+#endif
+
+#define CHAN_TRACE_BLOCK_BEGIN(ch, operation)                                                                        \
+	do {                                                                                                             \
+		CHAN_TRACE_PROBE(block_begin, ch, static_cast<int>(::chan::trace::op::operation));                           \
+		::chan::trace::record(::chan::trace::event_type::block_begin, ch, ::chan::trace::op::operation, 0);          \
+	} while (0)
+
+#define CHAN_TRACE_BLOCK_END(ch, operation)                                                                          \
+	do {                                                                                                             \
+		CHAN_TRACE_PROBE(block_end, ch, static_cast<int>(::chan::trace::op::operation));                             \
+		::chan::trace::record(::chan::trace::event_type::block_end, ch, ::chan::trace::op::operation, 0);            \
+	} while (0)
+
+#define CHAN_TRACE_HANDOFF(ch, operation)                                                                            \
+	do {                                                                                                             \
+		CHAN_TRACE_PROBE(handoff, ch, static_cast<int>(::chan::trace::op::operation));                               \
+		::chan::trace::record(::chan::trace::event_type::handoff, ch, ::chan::trace::op::operation, 0);              \
+	} while (0)
+
+#define CHAN_TRACE_CLOSE(ch)                                                                                         \
+	do {                                                                                                             \
+		CHAN_TRACE_PROBE(close, ch, 0);                                                                              \
+		::chan::trace::record(::chan::trace::event_type::close, ch, ::chan::trace::op::none, 0);                     \
+	} while (0)
+
+#define CHAN_TRACE_DEPTH(ch, n)                                                                                      \
+	do {                                                                                                             \
+		if (::chan::trace::sample_depth()) {                                                                         \
+			CHAN_TRACE_PROBE(depth, ch, n);                                                                          \
+			::chan::trace::record(::chan::trace::event_type::depth, ch, ::chan::trace::op::none, n);                 \
+		}                                                                                                            \
+	} while (0)
+
+#else
+
+#define CHAN_TRACE_BLOCK_BEGIN(ch, operation) \
+	do {                                      \
+	} while (0)
+
+#define CHAN_TRACE_BLOCK_END(ch, operation) \
+	do {                                    \
+	} while (0)
+
+#define CHAN_TRACE_HANDOFF(ch, operation) \
+	do {                                  \
+	} while (0)
+
+#define CHAN_TRACE_CLOSE(ch) \
+	do {                     \
+	} while (0)
+
+#define CHAN_TRACE_DEPTH(ch, n) \
+	do {                        \
+	} while (0)
+
+#endif
@@ -0,0 +1,106 @@
+#define CHAN_TRACE
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "chan.hh"
+
+namespace {
+
+std::string dump() {
+	char* buf = nullptr;
+	size_t len = 0;
+
+	FILE* out = open_memstream(&buf, &len);
+	chan::trace::write_json(out);
+	fclose(out);
+
+	std::string result(buf, len);
+	free(buf);
+
+	return result;
+}
+
+size_t count(const std::string& s, const std::string& needle) {
+	size_t n = 0;
+	for (size_t pos = s.find(needle); pos != std::string::npos; pos = s.find(needle, pos + 1)) {
+		n++;
+	}
+
+	return n;
+}
+
+}  // namespace
+
+TEST(trace, unbuffered) {
+	chan::unbuffered_chan<int> c;
+
+	std::thread t([&](){
+		for (int i = 0 ; i < 10 ; i++) {
+			c << i;
+		}
+	});
+
+	int x = 0;
+	for (int i = 0 ; i < 10 ; i++) {
+		c >> x;
+	}
+
+	t.join();
+	c.close();
+
+	std::string json = dump();
+
+	ASSERT_EQ(0u, json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+	ASSERT_GE(count(json, "\"name\":\"handoff to reader\""), 10u);
+	ASSERT_GE(count(json, "\"name\":\"close\""), 1u);
+
+	// every block begin has its end
+	ASSERT_EQ(count(json, "\"ph\":\"B\""), count(json, "\"ph\":\"E\""));
+	ASSERT_GT(count(json, "\"ph\":\"B\""), 0u);
+}
+
+TEST(trace, buffered_depth) {
+	chan::buffered_chan<int> c(1024);
+
+	for (int i = 0 ; i < 512 ; i++) {
+		c << i;
+	}
+
+	std::string json = dump();
+
+	ASSERT_GE(count(json, "\"ph\":\"C\""), 512u / chan::trace::depth_interval);
+	ASSERT_NE(std::string::npos, json.find("\"args\":{\"depth\":"));
+}
+
+TEST(trace, write_consumes) {
+	const void* tag = &tag;
+
+	for (size_t i = 0 ; i < 3 * chan::trace::chunk_size ; i++) {
+		chan::trace::record(chan::trace::event_type::close, tag, chan::trace::op::none, 0);
+	}
+
+	std::string json = dump();
+	ASSERT_GE(count(json, "\"name\":\"close\""), 3 * chan::trace::chunk_size);
+
+	// the chunks that were written go back to the thread, instead of being
+	// written again
+	chan::trace::thread_buffer& b = chan::trace::local();
+	ASSERT_NE(nullptr, b.recycled.load());
+
+	chan::trace::record(chan::trace::event_type::close, tag, chan::trace::op::none, 0);
+
+	json = dump();
+	ASSERT_EQ(1u, count(json, "\"name\":\"close\""));
+
+	// and are reused before anything new is allocated
+	for (size_t i = 0 ; i < 2 * chan::trace::chunk_size ; i++) {
+		chan::trace::record(chan::trace::event_type::close, tag, chan::trace::op::none, 0);
+	}
+
+	ASSERT_EQ(nullptr, b.recycled.load());
+	ASSERT_EQ(2 * chan::trace::chunk_size, count(dump(), "\"name\":\"close\""));
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "chan.hh"
+#include "simd.hh"
+
+namespace chan {
+
+/**
+ * filter_stage is a pipeline stage that passes on the values of a channel
+ * that satisfy a predicate, working on whole batches instead of a value
+ * per read.
+ *
+ * It reads up to batch_size values at a time with read_range, and filters
+ * them with simd::filter straight into the ring of the output channel,
+ * with write_transform, so the values that pass are copied once. With the
+ * predicates in simd.hh, numeric values are compared a vector at a time.
+ *
+ * When the input is closed and drained, the output is closed. If the
+ * output is closed, the stage stops.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::buffered_chan<int> in(4096), out(4096);
+ * chan::filter_stage<int, chan::simd::multiple_of<int>> f(in, out, {3});
+ * ```
+ * */
+template <typename T, typename Pred>
+class filter_stage {
+private:
+	static_assert(std::is_trivially_copyable<T>::value, "filter_stage needs trivially copyable values");
+
+	buffered_chan<T>& in;
+	buffered_chan<T>& out;
+
+	Pred pred;
+	int batch_size;
+
+	std::thread thread;
+
+	void run() {
+		std::vector<T> batch(batch_size);
+
+		try {
+			int n = 0;
+
+			while ((n = in.read_range(batch.data(), batch_size)) > 0) {
+				const T* vals = batch.data();
+
+				out.write_transform(n, [&](T* slots, int offset, int count) {
+					return simd::filter(vals + offset, count, slots, pred);
+				});
+			}
+		} catch (closed_channel_write_exception&) {
+			return;
+		}
+
+		try {
+			out.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+public:
+	/**
+	 * @param   in           buffered_chan<T>&   the channel to read from
+	 * @param   out          buffered_chan<T>&   the channel the values that pass are written to
+	 * @param   pred         Pred                bool(T)
+	 * @param   batch_size   int                 the most values read at a time
+	 * */
+	filter_stage(buffered_chan<T>& in, buffered_chan<T>& out, Pred pred, int batch_size = 1024)
+	    : in(in), out(out), pred(pred), batch_size(batch_size > 0 ? batch_size : 1) {
+		thread = std::thread(&filter_stage::run, this);
+	}
+
+	/**
+	 * The destructor waits for the stage to finish, see batcher
+	 * */
+	~filter_stage() { join(); }
+
+	filter_stage(const filter_stage& other) = delete;
+	filter_stage& operator=(const filter_stage& other) = delete;
+
+	void join() {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+};
+
+/**
+ * map_stage is a pipeline stage that writes op(x) for every value x of a
+ * channel, a batch at a time, with simd::map storing the results straight
+ * into the ring of the output channel. It closes the output like
+ * filter_stage.
+ *
+ * example usage:
+ *
+ * ```
+ * chan::map_stage<float, chan::simd::affine<float>> celsius(in, out, {5.0f / 9, -160.0f / 9});
+ * ```
+ * */
+template <typename T, typename Op>
+class map_stage {
+private:
+	static_assert(std::is_trivially_copyable<T>::value, "map_stage needs trivially copyable values");
+
+	buffered_chan<T>& in;
+	buffered_chan<T>& out;
+
+	Op op;
+	int batch_size;
+
+	std::thread thread;
+
+	void run() {
+		std::vector<T> batch(batch_size);
+
+		try {
+			int n = 0;
+
+			while ((n = in.read_range(batch.data(), batch_size)) > 0) {
+				const T* vals = batch.data();
+
+				out.write_transform(n, [&](T* slots, int offset, int count) {
+					simd::map(vals + offset, count, slots, op);
+					return count;
+				});
+			}
+		} catch (closed_channel_write_exception&) {
+			return;
+		}
+
+		try {
+			out.close();
+		} catch (channel_closed_exception&) {
+		}
+	}
+
+public:
+	/**
+	 * @param   in           buffered_chan<T>&   the channel to read from
+	 * @param   out          buffered_chan<T>&   the channel the results are written to
+	 * @param   op           Op                  T(T)
+	 * @param   batch_size   int                 the most values read at a time
+	 * */
+	map_stage(buffered_chan<T>& in, buffered_chan<T>& out, Op op, int batch_size = 1024)
+	    : in(in), out(out), op(op), batch_size(batch_size > 0 ? batch_size : 1) {
+		thread = std::thread(&map_stage::run, this);
+	}
+
+	~map_stage() { join(); }
+
+	map_stage(const map_stage& other) = delete;
+	map_stage& operator=(const map_stage& other) = delete;
+
+	void join() {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+};
+
+/**
+ * reduce reads a channel until it is closed and drained, a batch at a
+ * time, and folds the values with op, one of simd::sum, simd::minimum and
+ * simd::maximum, or any type with a static identity() and T(T, T).
+ *
+ * example usage:
+ *
+ * ```
+ * int total = chan::reduce(out, chan::simd::sum<int>());
+ * ```
+ * */
+template <typename T, typename Op>
+T reduce(buffered_chan<T>& in, Op op, int batch_size = 1024) {
+	std::vector<T> batch(batch_size > 0 ? batch_size : 1);
+
+	T acc = Op::identity();
+	int n = 0;
+
+	while ((n = in.read_range(batch.data(), static_cast<int>(batch.size()))) > 0) {
+		acc = simd::reduce(batch.data(), n, acc, op);
+	}
+
+	return acc;
+}
+
+}  // namespace chan
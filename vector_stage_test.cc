@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "vector_stage.hh"
+
+TEST(vector_stage, filter_map_reduce) {
+	const int n = 100000;
+
+	// small channels, so the output ring wraps and fills up
+	chan::buffered_chan<int> source(100), multiples(37), scaled(53);
+
+	chan::filter_stage<int, chan::simd::multiple_of<int>> f(source, multiples, {3}, 64);
+	chan::map_stage<int, chan::simd::affine<int>> m(multiples, scaled, {2, 1}, 64);
+
+	std::thread producer([&](){
+		std::vector<int> vals(1000);
+
+		for (int i = 0; i < n; i += 1000) {
+			for (int j = 0; j < 1000; j++) {
+				vals[j] = i + j;
+			}
+
+			source.write_range(vals.data(), 1000);
+		}
+
+		source.close();
+	});
+
+	long long total = 0;
+	int count = 0;
+	int last = -1;
+
+	int x = 0;
+	while (scaled.read(x)) {
+		ASSERT_EQ(0, (x - 1) / 2 % 3);
+		ASSERT_LT(last, x);
+
+		last = x;
+		total += x;
+		count++;
+	}
+
+	producer.join();
+
+	long long expected = 0;
+	for (int i = 0; i < n; i += 3) {
+		expected += 2 * i + 1;
+	}
+
+	ASSERT_EQ((n + 2) / 3, count);
+	ASSERT_EQ(expected, total);
+}
+
+TEST(vector_stage, reduce) {
+	chan::buffered_chan<int> in(16);
+
+	std::thread producer([&](){
+		for (int i = 1; i <= 1000; i++) {
+			in << i;
+		}
+
+		in.close();
+	});
+
+	ASSERT_EQ(500500, chan::reduce(in, chan::simd::sum<int>(), 100));
+	producer.join();
+}
+
+TEST(vector_stage, output_closed) {
+	chan::buffered_chan<int> in(16), out(4);
+
+	chan::filter_stage<int, chan::simd::greater<int>> f(in, out, {0});
+	out.close();
+
+	in << 1;
+	in.close();
+
+	// the stage stops instead of blocking on the full output
+	f.join();
+}
+
+TEST(buffered_chan, write_transform) {
+	chan::buffered_chan<int> c(4);
+
+	int vals[6] = {1, 2, 3, 4, 5, 6};
+	int x = 0;
+
+	c << 0;
+	c >> x;
+
+	std::thread writer([&](){
+		c.write_transform(6, [&](int* slots, int offset, int count) {
+			for (int i = 0; i < count; i++) {
+				slots[i] = vals[offset + i] * 10;
+			}
+
+			return count;
+		});
+	});
+
+	for (int i = 1; i <= 6; i++) {
+		c >> x;
+		ASSERT_EQ(i * 10, x);
+	}
+
+	writer.join();
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "context.hh"
+
+namespace chan {
+
+enum class wait_status {
+	notified,
+	cancelled,
+	timeout,
+};
+
+/**
+ * wait_queue is a condition variable that keeps its waiters in a FIFO
+ * list, each sleeping on its own condition variable.
+ *
+ * Like std::condition_variable, it is used together with a mutex that
+ * protects the waited on state, and every operation on it must be made
+ * with that mutex held. Waits can return spuriously.
+ *
+ * Since every waiter can be woken up individually, a wait can be tied to
+ * a context, and cancelling the context wakes up only the waiters under
+ * it, without disturbing the rest of the queue. Those waiters sleep on a
+ * mutex of their own, since the context cannot take the queue's mutex.
+ * */
+class wait_queue {
+private:
+	enum state {
+		waiting,
+		notified,
+		cancelled,
+		timeout,
+	};
+
+	struct waiter : public context_listener {
+		waiter* next;
+		waiter* prev;
+		bool linked;
+
+		// whether the waiter sleeps on its own mutex, rather than the
+		// queue's
+		bool guarded;
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		state status;
+
+		explicit waiter(bool guarded)
+		    : next(nullptr), prev(nullptr), linked(false), guarded(guarded), status(waiting) {}
+
+		/**
+		 * wake moves a waiting waiter to "to", and does nothing if it was
+		 * already woken up.
+		 *
+		 * The waiter cannot go away before the caller releases the queue's
+		 * mutex, or the context, so it is notified after unlocking, and
+		 * doesn't wake up just to block on its own mutex.
+		 * */
+		bool wake(state to) {
+			if (!guarded) {
+				if (status != waiting) {
+					return false;
+				}
+
+				status = to;
+				cv.notify_one();
+
+				return true;
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (status != waiting) {
+				return false;
+			}
+
+			status = to;
+			lock.unlock();
+
+			cv.notify_one();
+			return true;
+		}
+
+		void on_cancel() {
+			wake(cancelled);
+		}
+	};
+
+	waiter* head;
+	waiter* tail;
+
+	void push(waiter* w) {
+		w->next = nullptr;
+		w->prev = tail;
+
+		if (tail != nullptr) {
+			tail->next = w;
+		} else {
+			head = w;
+		}
+
+		tail = w;
+		w->linked = true;
+	}
+
+	void unlink(waiter* w) {
+		if (w->prev != nullptr) {
+			w->prev->next = w->next;
+		} else {
+			head = w->next;
+		}
+
+		if (w->next != nullptr) {
+			w->next->prev = w->prev;
+		} else {
+			tail = w->prev;
+		}
+
+		w->next = nullptr;
+		w->prev = nullptr;
+		w->linked = false;
+	}
+
+	/**
+	 * block queues a waiter, and sleeps until it is notified, its context
+	 * is cancelled or the deadline passes. lock is released while
+	 * sleeping, and held again when it returns.
+	 * */
+	template <typename Clock, typename Duration>
+	wait_status block(
+	    std::unique_lock<std::mutex>& lock,
+	    context* ctx,
+	    const std::chrono::time_point<Clock, Duration>* deadline) {
+		waiter w(ctx != nullptr);
+
+		if (ctx == nullptr) {
+			push(&w);
+
+			while (w.status == waiting) {
+				if (deadline == nullptr) {
+					w.cv.wait(lock);
+				} else if (w.cv.wait_until(lock, *deadline) == std::cv_status::timeout) {
+					if (w.status == waiting) {
+						w.status = timeout;
+					}
+				}
+			}
+
+			if (w.linked) {
+				unlink(&w);
+			}
+
+			return w.status == timeout ? wait_status::timeout : wait_status::notified;
+		}
+
+		if (!ctx->add(&w)) {
+			return wait_status::cancelled;
+		}
+
+		push(&w);
+
+		// the waiter's mutex is taken before the queue's is released, so a
+		// notification cannot be missed
+		std::unique_lock<std::mutex> waiter_lock(w.mutex);
+		lock.unlock();
+
+		while (w.status == waiting) {
+			if (deadline == nullptr) {
+				w.cv.wait(waiter_lock);
+			} else if (w.cv.wait_until(waiter_lock, *deadline) == std::cv_status::timeout) {
+				if (w.status == waiting) {
+					w.status = timeout;
+				}
+			}
+		}
+
+		state status = w.status;
+
+		waiter_lock.unlock();
+		lock.lock();
+
+		if (w.linked) {
+			unlink(&w);
+		}
+
+		ctx->remove(&w);
+
+		switch (status) {
+		case cancelled:
+			return wait_status::cancelled;
+		case timeout:
+			return wait_status::timeout;
+		default:
+			return wait_status::notified;
+		}
+	}
+
+public:
+	wait_queue() : head(nullptr), tail(nullptr) {}
+
+	wait_queue(const wait_queue& other) = delete;
+	wait_queue& operator=(const wait_queue& other) = delete;
+
+	void wait(std::unique_lock<std::mutex>& lock) {
+		block<std::chrono::steady_clock, std::chrono::steady_clock::duration>(lock, nullptr, nullptr);
+	}
+
+	template <typename Clock, typename Duration>
+	std::cv_status wait_until(std::unique_lock<std::mutex>& lock, const std::chrono::time_point<Clock, Duration>& deadline) {
+		if (block(lock, nullptr, &deadline) == wait_status::timeout) {
+			return std::cv_status::timeout;
+		}
+
+		return std::cv_status::no_timeout;
+	}
+
+	/**
+	 * wait blocks until the waiter is notified, or ctx is cancelled or
+	 * expires
+	 *
+	 *
+	 * @param   lock   std::unique_lock<std::mutex>&   the lock protecting the waited on state
+	 * @param   ctx    context&                        the context of the operation
+	 *
+	 * @return         wait_status                     what ended the wait
+	 * */
+	wait_status wait(std::unique_lock<std::mutex>& lock, context& ctx) {
+		context::clock::time_point deadline = ctx.deadline();
+
+		if (deadline == context::clock::time_point::max()) {
+			return block<context::clock, context::clock::duration>(lock, &ctx, nullptr);
+		}
+
+		return block(lock, &ctx, &deadline);
+	}
+
+	/**
+	 * notify_one wakes up the oldest waiter that is still waiting
+	 * */
+	void notify_one() {
+		while (head != nullptr) {
+			waiter* w = head;
+			unlink(w);
+
+			if (w->wake(notified)) {
+				return;
+			}
+		}
+	}
+
+	void notify_all() {
+		while (head != nullptr) {
+			waiter* w = head;
+			unlink(w);
+			w->wake(notified);
+		}
+	}
+};
+
+}  // namespace chan